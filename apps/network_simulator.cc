@@ -4,7 +4,10 @@
 
 #include <iostream>
 #include <list>
+#include <string>
+#include <tuple>
 #include <unordered_map>
+#include <vector>
 
 using namespace std;
 
@@ -205,7 +208,7 @@ class Network {
     }
 
   public:
-    Network()
+    explicit Network(const size_t batch_size)
         : default_id(_router.add_interface({random_router_ethernet_address(), {"171.67.76.46"}}))
         , eth0_id(_router.add_interface({random_router_ethernet_address(), {"10.0.0.1"}}))
         , eth1_id(_router.add_interface({random_router_ethernet_address(), {"172.16.0.1"}}))
@@ -230,6 +233,8 @@ class Network {
         _router.add_route(ip("143.195.128.0"), 18, host("hs_router").address(), hs4_id);
         _router.add_route(ip("143.195.192.0"), 19, host("hs_router").address(), hs4_id);
         _router.add_route(ip("128.30.76.255"), 16, Address{"128.30.0.1"}, mit5_id);
+
+        _router.set_batch_size(batch_size);
     }
 
     void simulate_physical_connections() {
@@ -269,12 +274,13 @@ class Network {
     }
 };
 
-void network_simulator() {
+void network_simulator(const size_t batch_size) {
     const string green = "\033[32;1m", normal = "\033[m";
 
-    cerr << green << "Constructing network." << normal << "\n";
+    cerr << green << "Constructing network (router forwards " << batch_size << " datagram(s) at a time)." << normal
+         << "\n";
 
-    Network network;
+    Network network{batch_size};
 
     cout << green << "\n\nTesting traffic between two ordinary hosts (applesauce to cherrypie)..." << normal << "\n\n";
     {
@@ -331,6 +337,22 @@ void network_simulator() {
         network.simulate();
     }
 
+    cout << green << "\n\nSuccess! Testing several datagrams to different next hops at once..." << normal << "\n\n";
+    {
+        for (const auto &[from, to, next_hop] : vector<tuple<string, string, string>>{
+                 {"applesauce", "192.168.0.2", "cherrypie"},
+                 {"applesauce", "143.195.131.17", "hs_router"},
+                 {"cherrypie", "1.2.3.4", "default_router"},
+                 {"applesauce", "143.195.193.52", "hs_router"},
+                 {"cherrypie", "10.0.0.2", "applesauce"},
+                 {"applesauce", "5.6.7.8", "default_router"}}) {
+            auto dgram_sent = network.host(from).send_to({to});
+            dgram_sent.header().ttl--;
+            network.host(next_hop).expect(dgram_sent);
+        }
+        network.simulate();
+    }
+
     cout << green << "\n\nSuccess! Testing TTL expiration..." << normal << "\n\n";
     {
         auto dgram_sent = network.host("applesauce").send_to({"1.2.3.4"}, 1);
@@ -345,7 +367,8 @@ void network_simulator() {
 
 int main() {
     try {
-        network_simulator();
+        network_simulator(1);
+        network_simulator(8);
     } catch (const exception &e) {
         cerr << "\n\n\n";
         cerr << "\033[31;1mError: " << e.what() << "\033[m\n";
@@ -0,0 +1,549 @@
+#include "arp_message.hh"
+#include "prefix_trie.hh"
+#include "router.hh"
+#include "util.hh"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t SYNTHETIC_ROUTES_DFLT = 900000;
+constexpr size_t LOOKUPS_DFLT = 20000000;
+constexpr size_t DATAGRAMS_DFLT = 2000000;
+constexpr size_t INTERFACES_DFLT = 8;
+constexpr size_t BATCH_SIZE_DFLT = 32;
+
+//! Next hops per interface in a synthetic table
+constexpr uint32_t NEXT_HOPS_PER_INTERFACE = 4;
+
+//! Datagrams handed to the router per call to Router::route (also the unit of the latency measurement)
+constexpr size_t DATAGRAMS_PER_ROUTE = 64;
+
+//! Distinct datagrams built for the forwarding benchmark (they are reused round-robin)
+constexpr size_t DATAGRAM_POOL = 65536;
+
+auto rd = get_random_generator();
+
+struct Route {
+    uint32_t prefix;
+    uint8_t length;
+    optional<uint32_t> next_hop;
+    size_t interface_num;
+};
+
+static void show_usage(const char *argv0, const char *msg) {
+    cout << "Usage: " << argv0 << " [options]\n\n"
+         << "   Option                                                          Default\n"
+         << "   --                                                              --\n\n"
+
+         << "   -r <file>       Load routes from <file>, one per line:          (synthetic table)\n"
+         << "                   <prefix>/<len> <next hop or -> <interface>\n"
+         << "   -g <count>      Size of the synthetic route table               " << SYNTHETIC_ROUTES_DFLT << "\n"
+         << "   -i <count>      Interfaces in the synthetic table               " << INTERFACES_DFLT << "\n\n"
+
+         << "   -t <file>       Also look up the addresses in <file>, one per line\n"
+         << "   -n <count>      Lookups per address set                         " << LOOKUPS_DFLT << "\n"
+         << "   -p <count>      Datagrams forwarded per address set             " << DATAGRAMS_DFLT << "\n"
+         << "   -b <count>      Batch size for batched forwarding               " << BATCH_SIZE_DFLT << "\n"
+         << "   -w <0|1>        Also forward with a worker thread per interface 0\n"
+         << "   -c <slots>      Size of the router's destination cache          0 (no cache)\n\n"
+
+         << "   -h              Show this message.\n\n";
+
+    if (msg != nullptr) {
+        cout << msg;
+    }
+    cout << endl;
+}
+
+static void check_argc(int argc, char **argv, int curr, const char *err) {
+    if (curr + 1 >= argc) {
+        show_usage(argv[0], err);
+        exit(1);
+    }
+}
+
+static optional<uint32_t> parse_ipv4(const string &str) {
+    in_addr addr{};
+    if (inet_pton(AF_INET, str.c_str(), &addr) != 1) {
+        return nullopt;
+    }
+    return ntohl(addr.s_addr);
+}
+
+static string ipv4_to_string(const uint32_t addr) { return Address::from_ipv4_numeric(addr).ip(); }
+
+static vector<Route> load_routes(const string &filename) {
+    ifstream file{filename};
+    if (not file) {
+        throw runtime_error("cannot open " + filename);
+    }
+
+    vector<Route> routes;
+    string line;
+    for (size_t line_no = 1; getline(file, line); line_no++) {
+        const auto error = [&](const string &what) {
+            return runtime_error(filename + ":" + to_string(line_no) + ": " + what);
+        };
+        if (line.empty() or line[0] == '#') {
+            continue;
+        }
+
+        istringstream fields{line};
+        string prefix_str, next_hop_str;
+        size_t interface_num = 0;
+        if (not(fields >> prefix_str >> next_hop_str >> interface_num)) {
+            throw error("expected <prefix>/<len> <next hop or -> <interface>");
+        }
+
+        const auto slash = prefix_str.find('/');
+        const auto prefix = parse_ipv4(prefix_str.substr(0, slash));
+        if (slash == string::npos or not prefix.has_value()) {
+            throw error("bad prefix " + prefix_str);
+        }
+        const char *length_str = prefix_str.c_str() + slash + 1;
+        char *length_end = nullptr;
+        const unsigned long length = strtoul(length_str, &length_end, 10);
+        if (length_end == length_str or *length_end != '\0' or length > 32) {
+            throw error("bad prefix length in " + prefix_str);
+        }
+
+        optional<uint32_t> next_hop;
+        if (next_hop_str != "-") {
+            next_hop = parse_ipv4(next_hop_str);
+            if (not next_hop.has_value()) {
+                throw error("bad next hop " + next_hop_str);
+            }
+        }
+
+        routes.push_back({prefix.value(), static_cast<uint8_t>(length), next_hop, interface_num});
+    }
+    return routes;
+}
+
+//! Address of interface `interface_num` in a synthetic table, and of its next hops
+static uint32_t synthetic_address(const size_t interface_num, const uint32_t host) {
+    return (10u << 24) | (static_cast<uint32_t>(interface_num) << 16) | host;
+}
+
+//! A table whose prefix lengths are distributed roughly like a BGP full table (mostly /24s),
+//! plus a default route
+static vector<Route> synthetic_routes(const size_t count, const size_t num_interfaces) {
+    // {prefix length, weight}
+    const vector<pair<uint8_t, unsigned>> length_weights = {
+        {8, 1},   {12, 1},  {14, 2},  {15, 2},  {16, 30}, {17, 10}, {18, 20}, {19, 35}, {20, 50},  {21, 55},
+        {22, 100}, {23, 90}, {24, 560}, {25, 4}, {26, 4},  {27, 3},  {28, 3},  {29, 3},  {30, 2},   {32, 5}};
+    unsigned total_weight = 0;
+    for (const auto &[length, weight] : length_weights) {
+        total_weight += weight;
+    }
+
+    vector<Route> routes;
+    routes.reserve(count);
+    routes.push_back({0, 0, synthetic_address(0, 2), 0});
+    while (routes.size() < count) {
+        unsigned pick = rd() % total_weight;
+        uint8_t length = 0;
+        for (const auto &[l, weight] : length_weights) {
+            length = l;
+            if (pick < weight) {
+                break;
+            }
+            pick -= weight;
+        }
+        const size_t interface_num = rd() % num_interfaces;
+        const uint32_t next_hop = synthetic_address(interface_num, 2 + rd() % NEXT_HOPS_PER_INTERFACE);
+        routes.push_back({static_cast<uint32_t>(rd()), length, next_hop, interface_num});
+    }
+    return routes;
+}
+
+static vector<uint32_t> load_trace(const string &filename) {
+    ifstream file{filename};
+    if (not file) {
+        throw runtime_error("cannot open " + filename);
+    }
+
+    vector<uint32_t> addresses;
+    string line;
+    for (size_t line_no = 1; getline(file, line); line_no++) {
+        if (line.empty() or line[0] == '#') {
+            continue;
+        }
+        const auto addr = parse_ipv4(line);
+        if (not addr.has_value()) {
+            throw runtime_error(filename + ":" + to_string(line_no) + ": bad address " + line);
+        }
+        addresses.push_back(addr.value());
+    }
+    if (addresses.empty()) {
+        throw runtime_error(filename + ": no addresses");
+    }
+    return addresses;
+}
+
+//! Addresses drawn uniformly from the whole address space
+static vector<uint32_t> random_addresses(const size_t count) {
+    vector<uint32_t> addresses(count);
+    for (auto &addr : addresses) {
+        addr = rd();
+    }
+    return addresses;
+}
+
+//! Addresses inside randomly chosen routes, so that most lookups end at a long prefix
+static vector<uint32_t> addresses_in_table(const vector<Route> &routes, const size_t count) {
+    vector<uint32_t> addresses(count);
+    for (auto &addr : addresses) {
+        const auto &route = routes[rd() % routes.size()];
+        const uint32_t host_mask = route.length == 0 ? 0xffffffff : (uint64_t(1) << (32 - route.length)) - 1;
+        addr = (route.prefix & ~host_mask) | (static_cast<uint32_t>(rd()) & host_mask);
+    }
+    return addresses;
+}
+
+static double percentile(const vector<double> &sorted, const double p) {
+    return sorted.at(min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size()))));
+}
+
+static double mib(const size_t bytes) { return static_cast<double>(bytes) / (1024 * 1024); }
+
+static void benchmark_lookups(const PrefixTrie &trie, const vector<uint32_t> &addresses, const size_t count) {
+    size_t matched = 0;
+    const auto start = steady_clock::now();
+    for (size_t i = 0, j = 0; i < count; i++) {
+        matched += trie.lookup(addresses[j]).has_value();
+        if (++j == addresses.size()) {
+            j = 0;
+        }
+    }
+    const auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+
+    cout << "    PrefixTrie::lookup:            " << setw(8) << static_cast<double>(count) * 1000 / static_cast<double>(ns)
+         << " M lookups/s (" << static_cast<double>(ns) / static_cast<double>(count) << " ns each, "
+         << 100.0 * static_cast<double>(matched) / static_cast<double>(count) << "% matched)\n";
+}
+
+//! A router with the table's interfaces and every next hop's Ethernet address already learned
+class BenchmarkRouter {
+    Router _router{};
+    vector<EthernetAddress> _ethernet_addresses{};
+    vector<uint32_t> _ip_addresses{};
+
+    static EthernetAddress random_ethernet_address() {
+        EthernetAddress addr;
+        for (auto &byte : addr) {
+            byte = rd();
+        }
+        addr.at(0) |= 0x02;  // locally administered
+        addr.at(0) &= 0xfe;  // unicast
+        return addr;
+    }
+
+    //! Tell the interface the next hop's Ethernet address, as an ARP reply would
+    void learn(const size_t interface_num, const uint32_t next_hop) {
+        ARPMessage arp;
+        arp.opcode = ARPMessage::OPCODE_REPLY;
+        arp.sender_ethernet_address = random_ethernet_address();
+        arp.sender_ip_address = next_hop;
+        arp.target_ethernet_address = _ethernet_addresses[interface_num];
+        arp.target_ip_address = _ip_addresses[interface_num];
+
+        EthernetFrame frame;
+        frame.header().type = EthernetHeader::TYPE_ARP;
+        frame.header().src = arp.sender_ethernet_address;
+        frame.header().dst = arp.target_ethernet_address;
+        frame.payload() = arp.serialize();
+        _router.interface(interface_num).recv_frame(frame);
+    }
+
+  public:
+    explicit BenchmarkRouter(const vector<Route> &routes) {
+        size_t num_interfaces = 1;
+        for (const auto &route : routes) {
+            num_interfaces = max(num_interfaces, route.interface_num + 1);
+        }
+        for (size_t i = 0; i < num_interfaces; i++) {
+            _ethernet_addresses.push_back(random_ethernet_address());
+            _ip_addresses.push_back(synthetic_address(i, 1));
+            _router.add_interface(
+                AsyncNetworkInterface{_ethernet_addresses.back(), Address::from_ipv4_numeric(_ip_addresses.back())});
+        }
+
+        // load the whole table as one batch, so it is built once instead of once per route
+        RouteUpdate update;
+        vector<pair<size_t, uint32_t>> next_hops;
+        for (const auto &route : routes) {
+            update.add(route.prefix,
+                       route.length,
+                       route.next_hop.has_value() ? optional<Address>{Address::from_ipv4_numeric(route.next_hop.value())}
+                                                  : nullopt,
+                       route.interface_num);
+            if (route.next_hop.has_value()) {
+                next_hops.emplace_back(route.interface_num, route.next_hop.value());
+            }
+        }
+        _router.update_routes(update);
+        sort(next_hops.begin(), next_hops.end());
+        next_hops.erase(unique(next_hops.begin(), next_hops.end()), next_hops.end());
+        for (const auto &[interface_num, next_hop] : next_hops) {
+            learn(interface_num, next_hop);
+        }
+    }
+
+    Router &router() { return _router; }
+
+    size_t num_interfaces() const { return _ethernet_addresses.size(); }
+};
+
+//! Datagrams to (the first DATAGRAM_POOL of) `addresses`, as they would arrive: parsed from the wire
+static vector<InternetDatagram> datagram_pool(const vector<uint32_t> &addresses) {
+    vector<InternetDatagram> pool;
+    for (size_t i = 0; i < min(addresses.size(), DATAGRAM_POOL); i++) {
+        InternetDatagram dgram;
+        dgram.header().src = synthetic_address(0, 100);
+        dgram.header().dst = addresses[i];
+        dgram.header().ttl = 64;
+        dgram.payload() = string(64, 'x');
+        dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+        pool.emplace_back();
+        if (pool.back().parse(dgram.serialize().concatenate()) != ParseResult::NoError) {
+            throw runtime_error("could not parse a datagram");
+        }
+    }
+    return pool;
+}
+
+//! \note Destinations that only match a directly-attached route are resolved by ARP as usual,
+//! so their datagrams wait in the interface instead of being counted as forwarded.
+static void benchmark_forwarding(BenchmarkRouter &bench,
+                                 const vector<uint32_t> &addresses,
+                                 const size_t count,
+                                 const size_t batch_size) {
+    const auto pool = datagram_pool(addresses);
+
+    Router &router = bench.router();
+    router.set_batch_size(batch_size);
+    const uint64_t hits_before = router.route_cache_hits();
+    vector<double> latencies;
+    latencies.reserve(count / DATAGRAMS_PER_ROUTE + 1);
+    size_t forwarded = 0;
+    uint64_t total_ns = 0;
+    for (size_t sent = 0, next = 0; sent < count; sent += DATAGRAMS_PER_ROUTE) {
+        auto &queue = router.interface(0).datagrams_out();
+        for (size_t i = 0; i < DATAGRAMS_PER_ROUTE; i++) {
+            queue.push(pool[next]);
+            if (++next == pool.size()) {
+                next = 0;
+            }
+        }
+
+        const auto start = steady_clock::now();
+        router.route();
+        const auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        total_ns += ns;
+        latencies.push_back(static_cast<double>(ns) / DATAGRAMS_PER_ROUTE);
+
+        for (size_t i = 0; i < bench.num_interfaces(); i++) {
+            auto &frames = router.interface(i).frames_out();
+            while (not frames.empty()) {
+                forwarded += frames.front().header().type == EthernetHeader::TYPE_IPv4;
+                frames.pop();
+            }
+        }
+    }
+
+    const size_t routed = latencies.size() * DATAGRAMS_PER_ROUTE;
+    const uint64_t hits = router.route_cache_hits() - hits_before;
+    sort(latencies.begin(), latencies.end());
+    const string label = batch_size > 1 ? "batches of " + to_string(batch_size) + ":" : "one at a time:";
+    cout << "    Router::route, " << left << setw(16) << label << right << setw(8)
+         << static_cast<double>(routed) * 1000 / static_cast<double>(total_ns) << " M datagrams/s ("
+         << 100.0 * static_cast<double>(forwarded) / static_cast<double>(routed) << "% forwarded, "
+         << 100.0 * static_cast<double>(hits) / static_cast<double>(routed) << "% cache hits)\n"
+         << "        ns per datagram, over calls with " << DATAGRAMS_PER_ROUTE << " datagrams: p50 "
+         << percentile(latencies, 0.5) << ", p90 " << percentile(latencies, 0.9) << ", p99 "
+         << percentile(latencies, 0.99) << ", p99.9 " << percentile(latencies, 0.999) << ", max " << latencies.back()
+         << "\n";
+}
+
+//! Every interface receives count / (number of interfaces) datagrams, forwarded by the router's worker threads
+//! \note `trie` maps addresses to `routes` like the router's table does. Datagrams without a route are dropped
+//! and those that only match a directly-attached route wait for ARP, so only the others are waited for.
+static void benchmark_parallel(BenchmarkRouter &bench,
+                               const PrefixTrie &trie,
+                               const vector<Route> &routes,
+                               const vector<uint32_t> &addresses,
+                               const size_t count) {
+    const auto pool = datagram_pool(addresses);
+    const size_t n = bench.num_interfaces();
+    const size_t per_interface = count / n;
+
+    vector<bool> forwardable(pool.size());
+    for (size_t j = 0; j < pool.size(); j++) {
+        const auto match = trie.lookup(pool[j].header().dst);
+        forwardable[j] = match.has_value() and routes[match.value()].next_hop.has_value();
+    }
+    const auto datagram = [&](const size_t i, const size_t k) { return (i * per_interface + k) % pool.size(); };
+    size_t expected = 0;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = 0; k < per_interface; k++) {
+            expected += forwardable[datagram(i, k)];
+        }
+    }
+
+    // bound the forwardable datagrams inside the router; the rest are dropped when a ring between workers is full
+    const size_t max_in_flight = n * 256;
+
+    vector<size_t> injected(n);  // each element is only touched by its interface's worker
+    atomic<size_t> sent{0}, forwarded{0};
+
+    Router &router = bench.router();
+    const uint64_t drops_before = router.handoff_drops();
+    const auto drops = [&] { return router.handoff_drops() - drops_before; };
+    const auto start = steady_clock::now();
+    router.start([&](const size_t i, AsyncNetworkInterface &interface) {
+        size_t k = 0, in_flight = 0;
+        while (k < DATAGRAMS_PER_ROUTE and injected[i] < per_interface and
+               sent + in_flight < forwarded + drops() + max_in_flight) {
+            const size_t j = datagram(i, injected[i]);
+            interface.datagrams_out().push(pool[j]);
+            in_flight += forwardable[j];
+            injected[i]++, k++;
+        }
+        sent += in_flight;
+
+        size_t out = 0;
+        while (not interface.frames_out().empty()) {
+            out += interface.frames_out().front().header().type == EthernetHeader::TYPE_IPv4;
+            interface.frames_out().pop();
+        }
+        forwarded += out;
+    });
+    while (forwarded + drops() < expected) {
+        this_thread::sleep_for(microseconds(100));
+    }
+    const auto ns = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    router.stop();
+
+    cout << "    Router::start, " << left << setw(16) << (to_string(n) + " workers:") << right << setw(8)
+         << static_cast<double>(per_interface * n) * 1000 / static_cast<double>(ns) << " M datagrams/s ("
+         << drops() << " dropped between workers, " << thread::hardware_concurrency()
+         << " CPUs)\n";
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        if (argc <= 0) {
+            abort();  // For sticklers: don't try to access argv[0] if argc <= 0.
+        }
+
+        string route_file, trace_file;
+        size_t synthetic_count = SYNTHETIC_ROUTES_DFLT;
+        size_t num_interfaces = INTERFACES_DFLT;
+        size_t lookups = LOOKUPS_DFLT;
+        size_t datagrams = DATAGRAMS_DFLT;
+        size_t batch_size = BATCH_SIZE_DFLT;
+        bool parallel = false;
+        size_t cache_size = 0;
+
+        for (int curr = 1; curr < argc; curr += 2) {
+            if (strncmp("-h", argv[curr], 3) == 0) {
+                show_usage(argv[0], nullptr);
+                return EXIT_SUCCESS;
+            }
+            check_argc(argc, argv, curr, (string("ERROR: ") + argv[curr] + " requires one argument.").c_str());
+            const char *value = argv[curr + 1];
+            if (strncmp("-r", argv[curr], 3) == 0) {
+                route_file = value;
+            } else if (strncmp("-g", argv[curr], 3) == 0) {
+                synthetic_count = max(1ul, strtoul(value, nullptr, 0));
+            } else if (strncmp("-i", argv[curr], 3) == 0) {
+                num_interfaces = max(1ul, strtoul(value, nullptr, 0));
+            } else if (strncmp("-t", argv[curr], 3) == 0) {
+                trace_file = value;
+            } else if (strncmp("-n", argv[curr], 3) == 0) {
+                lookups = strtoul(value, nullptr, 0);
+            } else if (strncmp("-p", argv[curr], 3) == 0) {
+                datagrams = strtoul(value, nullptr, 0);
+            } else if (strncmp("-b", argv[curr], 3) == 0) {
+                batch_size = max(1ul, strtoul(value, nullptr, 0));
+            } else if (strncmp("-w", argv[curr], 3) == 0) {
+                parallel = strtoul(value, nullptr, 0) != 0;
+            } else if (strncmp("-c", argv[curr], 3) == 0) {
+                cache_size = strtoul(value, nullptr, 0);
+            } else {
+                show_usage(argv[0], string("ERROR: unrecognized option " + string(argv[curr])).c_str());
+                return EXIT_FAILURE;
+            }
+        }
+
+        const auto routes =
+            route_file.empty() ? synthetic_routes(synthetic_count, num_interfaces) : load_routes(route_file);
+        if (routes.empty()) {
+            throw runtime_error("no routes");
+        }
+
+        cout << fixed << setprecision(2);
+
+        auto start = steady_clock::now();
+        PrefixTrie trie;
+        for (size_t i = 0; i < routes.size(); i++) {
+            trie.add(routes[i].prefix, routes[i].length, i);
+        }
+        cout << "Loaded " << routes.size() << " routes " << (route_file.empty() ? "(synthetic)" : "from " + route_file)
+             << "\n    PrefixTrie::add:               " << duration_cast<milliseconds>(steady_clock::now() - start).count()
+             << " ms, " << mib(trie.memory_usage()) << " MiB\n";
+
+        start = steady_clock::now();
+        BenchmarkRouter bench{routes};
+        bench.router().set_route_cache_size(cache_size);
+        cout << "    Router::update_routes:         " << duration_cast<milliseconds>(steady_clock::now() - start).count()
+             << " ms, " << bench.num_interfaces() << " interfaces\n";
+
+        vector<pair<string, vector<uint32_t>>> address_sets;
+        address_sets.emplace_back("random addresses", random_addresses(1 << 20));
+        address_sets.emplace_back("addresses within routes", addresses_in_table(routes, 1 << 20));
+        if (not trace_file.empty()) {
+            address_sets.emplace_back("trace " + trace_file, load_trace(trace_file));
+        }
+
+        for (const auto &[name, addresses] : address_sets) {
+            cout << "\n" << name << " (" << addresses.size() << " distinct, e.g. " << ipv4_to_string(addresses[0])
+                 << "):\n";
+            benchmark_lookups(trie, addresses, lookups);
+            benchmark_forwarding(bench, addresses, datagrams, 1);
+            if (batch_size > 1) {
+                benchmark_forwarding(bench, addresses, datagrams, batch_size);
+            }
+            if (parallel) {
+                benchmark_parallel(bench, trie, routes, addresses, datagrams);
+            }
+        }
+
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        cout << "\nMaximum resident set size: " << static_cast<double>(usage.ru_maxrss) / 1024 << " MiB\n";
+    } catch (const exception &e) {
+        cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,20 @@
 find_library (LIBPCAP pcap)
 find_library (LIBPTHREAD pthread)
+
+# io_uring backend for EventLoop: needs kernel headers with multishot receives and provided buffer rings
+include (CheckCXXSourceCompiles)
+option (SPONGE_IO_URING "Build the io_uring backend for EventLoop, if the kernel headers support it" ON)
+if (SPONGE_IO_URING)
+    check_cxx_source_compiles ("
+        #include <linux/io_uring.h>
+        #include <sys/syscall.h>
+        int main() {
+            return __NR_io_uring_setup + IORING_REGISTER_PBUF_RING + IORING_RECV_MULTISHOT + IORING_ASYNC_CANCEL_ANY;
+        }" HAVE_IO_URING)
+    if (HAVE_IO_URING)
+        add_definitions (-DHAVE_IO_URING)
+    endif ()
+endif ()
 macro (add_sponge_exec exec_name)
     add_executable ("${exec_name}" "${exec_name}.cc")
     target_link_libraries ("${exec_name}" ${ARGN} sponge ${LIBPTHREAD})
@@ -22,10 +22,31 @@ size_t ByteStream::write(const string &data) {
     return ret;
 }
 
+//! \details The stream keeps a reference to (a prefix of) `data` instead of copying it
+size_t ByteStream::write(Buffer data) {
+    auto ret = min(data.size(), remaining_capacity());
+    if (ret == 0) return 0;
+    data.remove_suffix(data.size() - ret);
+    _buffer.push_back(std::move(data));
+    _written_cnt += ret;
+    return ret;
+}
+
+size_t ByteStream::write(const BufferList &data) {
+    size_t ret = 0;
+    for (const auto &buffer : data.buffers()) {
+        auto n = write(buffer);
+        ret += n;
+        if (n < buffer.size()) break;
+    }
+    return ret;
+}
+
 //! \param[in] len bytes will be copied from the output side of the buffer
 string ByteStream::peek_output(const size_t len) const {
     string ret;
     auto n = min(len, buffer_size());
+    ret.reserve(n);
     for (const auto &buffer : _buffer) {
         if (n >= buffer.size()) {
             n -= buffer.size();
@@ -38,6 +59,19 @@ string ByteStream::peek_output(const size_t len) const {
     return ret;
 }
 
+//! \param[in] len bytes will be exposed from the output side of the buffer
+BufferViewList ByteStream::peek_views(const size_t len) const {
+    BufferViewList ret;
+    auto n = min(len, buffer_size());
+    for (const auto &buffer : _buffer) {
+        if (n == 0) break;
+        const auto view = buffer.str().substr(0, n);
+        ret.append(view);
+        n -= view.size();
+    }
+    return ret;
+}
+
 //! \param[in] len bytes will be removed from the output side of the buffer
 void ByteStream::pop_output(const size_t len) {
     auto n = min(len, buffer_size());
@@ -62,6 +96,29 @@ string ByteStream::read(const size_t len) {
     return ret;
 }
 
+//! \param[in] len bytes will be popped and returned
+//! \returns the popped bytes; whole Buffers are moved out and only the last one may be split
+BufferList ByteStream::read_buffers(const size_t len) {
+    BufferList ret;
+    auto n = min(len, buffer_size());
+    _read_cnt += n;
+    while (n > 0) {
+        auto &front = _buffer.front();
+        if (n >= front.size()) {
+            n -= front.size();
+            ret.append(std::move(front));
+            _buffer.pop_front();
+        } else {
+            Buffer head = front;
+            head.remove_suffix(front.size() - n);
+            front.remove_prefix(n);
+            ret.append(std::move(head));
+            break;
+        }
+    }
+    return ret;
+}
+
 void ByteStream::end_input() { _input_ended_flag = true; }
 
 bool ByteStream::input_ended() const { return _input_ended_flag; }
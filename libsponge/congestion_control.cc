@@ -0,0 +1,107 @@
+#include "congestion_control.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+size_t NoCongestionControl::cwnd() const { return numeric_limits<size_t>::max(); }
+
+//! \param[in] mss the sender maximum segment size, in bytes
+RenoCongestionControl::RenoCongestionControl(const size_t mss)
+    : _mss(mss)
+    , _cwnd(TCPConfig::INITIAL_CWND_SEGMENTS * mss)
+    , _ssthresh(numeric_limits<size_t>::max())
+    , _acked_accum(0) {}
+
+//! \details In slow start, the window grows by at most one MSS per ACK; in congestion
+//! avoidance it grows by one MSS once a full window of bytes has been acknowledged.
+void RenoCongestionControl::on_ack(const size_t acked_bytes, const uint64_t /* now_ms */) {
+    if (_cwnd < _ssthresh) {
+        _cwnd += min(acked_bytes, _mss);
+        return;
+    }
+    _acked_accum += acked_bytes;
+    while (_acked_accum >= _cwnd) {
+        _acked_accum -= _cwnd;
+        _cwnd += _mss;
+    }
+}
+
+void RenoCongestionControl::on_loss(const size_t bytes_in_flight, const uint64_t /* now_ms */) {
+    _ssthresh = max(bytes_in_flight / 2, 2 * _mss);
+    _cwnd = _ssthresh;
+    _acked_accum = 0;
+}
+
+void RenoCongestionControl::on_rto(const size_t bytes_in_flight, const uint64_t /* now_ms */) {
+    _ssthresh = max(bytes_in_flight / 2, 2 * _mss);
+    _cwnd = _mss;
+    _acked_accum = 0;
+}
+
+//! \param[in] mss the sender maximum segment size, in bytes
+CubicCongestionControl::CubicCongestionControl(const size_t mss)
+    : _mss(mss), _cwnd(TCPConfig::INITIAL_CWND_SEGMENTS), _ssthresh(numeric_limits<double>::infinity()) {}
+
+size_t CubicCongestionControl::cwnd() const { return max(static_cast<size_t>(_cwnd * _mss), _mss); }
+
+//! \details Outside slow start, the window follows W_cubic(t) = C * (t - K)^3 + W_max,
+//! where t is the time since the current epoch began, but never grows slower than the
+//! Reno-friendly estimate W_est.
+void CubicCongestionControl::on_ack(const size_t acked_bytes, const uint64_t now_ms) {
+    const double acked = static_cast<double>(acked_bytes) / _mss;
+    if (_cwnd < _ssthresh) {
+        _cwnd += acked;
+        return;
+    }
+
+    if (!_in_epoch) {
+        _in_epoch = true;
+        _epoch_start = now_ms;
+        _k = _cwnd < _w_max ? cbrt((_w_max - _cwnd) / C) : 0;
+        _w_max = max(_w_max, _cwnd);
+        _w_est = _cwnd;
+    }
+
+    const double t = static_cast<double>(now_ms - _epoch_start) / 1000;
+    const double w_cubic = C * pow(t - _k, 3) + _w_max;
+    _w_est += 3 * (1 - BETA) / (1 + BETA) * acked / _cwnd;
+
+    const double target = clamp(max(w_cubic, _w_est), _cwnd, 1.5 * _cwnd);
+    _cwnd += (target - _cwnd) / _cwnd * acked;
+}
+
+void CubicCongestionControl::_reduce() {
+    // fast convergence: release bandwidth faster if the window did not reach its previous maximum
+    _w_max = _cwnd < _w_max ? _cwnd * (1 + BETA) / 2 : _cwnd;
+    _ssthresh = max(_cwnd * BETA, 2.0);
+    _in_epoch = false;
+}
+
+void CubicCongestionControl::on_loss(const size_t /* bytes_in_flight */, const uint64_t /* now_ms */) {
+    _reduce();
+    _cwnd = _ssthresh;
+}
+
+void CubicCongestionControl::on_rto(const size_t /* bytes_in_flight */, const uint64_t /* now_ms */) {
+    _reduce();
+    _cwnd = 1;
+}
+
+//! \param[in] algorithm which algorithm to construct
+//! \param[in] mss the sender maximum segment size, in bytes
+unique_ptr<CongestionControl> make_congestion_control(const TCPConfig::CongestionControlAlgorithm algorithm,
+                                                      const size_t mss) {
+    switch (algorithm) {
+        case TCPConfig::CongestionControlAlgorithm::None:
+            return make_unique<NoCongestionControl>();
+        case TCPConfig::CongestionControlAlgorithm::Reno:
+            return make_unique<RenoCongestionControl>(mss);
+        case TCPConfig::CongestionControlAlgorithm::Cubic:
+            return make_unique<CubicCongestionControl>(mss);
+    }
+    throw runtime_error("make_congestion_control: unknown algorithm");
+}
@@ -0,0 +1,89 @@
+#ifndef SPONGE_LIBSPONGE_CONGESTION_CONTROL_HH
+#define SPONGE_LIBSPONGE_CONGESTION_CONTROL_HH
+
+#include "tcp_config.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+//! \brief Interface of a congestion-control algorithm driven by the TCPSender
+//!
+//! The TCPSender reports acknowledgments, losses and retransmission timeouts,
+//! and never has more than cwnd() bytes (in sequence space) in flight.
+class CongestionControl {
+  public:
+    virtual ~CongestionControl() = default;
+
+    //! \brief `acked_bytes` bytes of sequence space were newly acknowledged at time `now_ms`
+    virtual void on_ack(const size_t acked_bytes, const uint64_t now_ms) = 0;
+
+    //! \brief A loss was inferred without a timeout (e.g. from duplicate ACKs)
+    virtual void on_loss(const size_t bytes_in_flight, const uint64_t now_ms) = 0;
+
+    //! \brief The retransmission timer expired
+    virtual void on_rto(const size_t bytes_in_flight, const uint64_t now_ms) = 0;
+
+    //! \brief The congestion window, in bytes
+    virtual size_t cwnd() const = 0;
+};
+
+//! \brief No congestion control: the window is limited only by the receiver
+class NoCongestionControl : public CongestionControl {
+  public:
+    void on_ack(const size_t, const uint64_t) override {}
+    void on_loss(const size_t, const uint64_t) override {}
+    void on_rto(const size_t, const uint64_t) override {}
+    size_t cwnd() const override;
+};
+
+//! \brief [Reno](\ref rfc::rfc5681) slow start and congestion avoidance
+class RenoCongestionControl : public CongestionControl {
+  private:
+    size_t _mss;          //!< Sender maximum segment size
+    size_t _cwnd;         //!< Congestion window, in bytes
+    size_t _ssthresh;     //!< Slow-start threshold, in bytes
+    size_t _acked_accum;  //!< Bytes acknowledged since cwnd last grew in congestion avoidance
+
+  public:
+    explicit RenoCongestionControl(const size_t mss);
+
+    void on_ack(const size_t acked_bytes, const uint64_t now_ms) override;
+    void on_loss(const size_t bytes_in_flight, const uint64_t now_ms) override;
+    void on_rto(const size_t bytes_in_flight, const uint64_t now_ms) override;
+    size_t cwnd() const override { return _cwnd; }
+};
+
+//! \brief [CUBIC](\ref rfc::rfc8312) window growth with a Reno-friendly region
+//! \note Windows are kept in units of segments, as in the RFC.
+class CubicCongestionControl : public CongestionControl {
+  private:
+    static constexpr double C = 0.4;     //!< Cubic scaling constant
+    static constexpr double BETA = 0.7;  //!< Multiplicative decrease factor
+
+    size_t _mss;                //!< Sender maximum segment size
+    double _cwnd;               //!< Congestion window, in segments
+    double _ssthresh;           //!< Slow-start threshold, in segments
+    double _w_max = 0;          //!< Window size just before the last reduction, in segments
+    double _w_est = 0;          //!< Reno-friendly window estimate, in segments
+    double _k = 0;              //!< Seconds the cubic function takes to grow back to _w_max
+    uint64_t _epoch_start = 0;  //!< Time the current congestion-avoidance epoch started
+    bool _in_epoch = false;     //!< Has the current congestion-avoidance epoch started?
+
+    //! Shrink the window after a congestion event, remembering where it was
+    void _reduce();
+
+  public:
+    explicit CubicCongestionControl(const size_t mss);
+
+    void on_ack(const size_t acked_bytes, const uint64_t now_ms) override;
+    void on_loss(const size_t bytes_in_flight, const uint64_t now_ms) override;
+    void on_rto(const size_t bytes_in_flight, const uint64_t now_ms) override;
+    size_t cwnd() const override;
+};
+
+//! \brief Construct the congestion-control algorithm selected by a TCPConfig
+std::unique_ptr<CongestionControl> make_congestion_control(const TCPConfig::CongestionControlAlgorithm algorithm,
+                                                           const size_t mss = TCPConfig::MAX_PAYLOAD_SIZE);
+
+#endif  // SPONGE_LIBSPONGE_CONGESTION_CONTROL_HH
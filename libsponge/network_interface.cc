@@ -4,6 +4,7 @@
 #include "ethernet_frame.hh"
 
 #include <iostream>
+#include <stdexcept>
 
 // Dummy implementation of a network interface
 // Translates from {IP datagram, next hop address} to link-layer frame, and from link-layer frame to IP datagram
@@ -59,7 +60,8 @@ void NetworkInterface::send_datagram(const InternetDatagram &dgram, const Addres
             _send(ETHERNET_BROADCAST, EthernetHeader::TYPE_ARP, arp_msg.serialize());
 
             // 加入等待回复 ARP 报文的记录表中
-            _waiting_arp_response_ip_addr[next_hop_ip] = ARP_RESPONSE_TTL_MS;
+            _waiting_arp_response_ip_addr[next_hop_ip] =
+                _start_timer(ARP_RESPONSE_TTL_MS, _arp_response_cookie(next_hop_ip));
         }
         // 加入 IP 报文等待发送列表
         _waiting_internet_datagrams[next_hop_ip].emplace_back(next_hop, dgram);
@@ -67,6 +69,24 @@ void NetworkInterface::send_datagram(const InternetDatagram &dgram, const Addres
 
 }
 
+//! \param[in] first, last the datagrams to be sent
+//! \param[in] next_hop the IP address of the interface to send them to
+void NetworkInterface::send_datagrams(vector<InternetDatagram>::const_iterator first,
+                                      vector<InternetDatagram>::const_iterator last,
+                                      const Address &next_hop) {
+    auto it = _arp_table.find(next_hop.ipv4_numeric());
+    if (it == _arp_table.end()) {
+        // ARP 表不命中时与逐个发送相同：第一个数据报触发 ARP 查询，其余的一起等待回复
+        for (; first != last; ++first) {
+            send_datagram(*first, next_hop);
+        }
+        return;
+    }
+    for (; first != last; ++first) {
+        _send(it->second.eth_addr, EthernetHeader::TYPE_IPv4, first->serialize());
+    }
+}
+
 //! \param[in] frame the incoming Ethernet frame
 optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &frame) {
     // 如果不是广播帧或者 MAC 地址不是本机，则直接过滤
@@ -100,8 +120,13 @@ optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &fra
             _send(arp_msg.sender_ethernet_address, EthernetHeader::TYPE_ARP, arp_reply.serialize());
         }
         // 从 ARP 报文中学习新的 ARP 表项（即使不是发给我的也可以学，比如广播但目标 IP 不是本机）
-        _arp_table[src_ip] = {arp_msg.sender_ethernet_address,  ARP_ENTRY_TTL_MS};
-        
+        // 已有的条目重新计时
+        const auto entry = _arp_table.find(src_ip);
+        if (entry != _arp_table.end()) {
+            _stop_timer(entry->second.timer);
+        }
+        _arp_table[src_ip] = {arp_msg.sender_ethernet_address, _start_timer(ARP_ENTRY_TTL_MS, _arp_entry_cookie(src_ip))};
+
         // 如果该 IP 地址有等待发送的数据报，则全部发送出去
         auto it = _waiting_internet_datagrams.find(src_ip);
         if (it != _waiting_internet_datagrams.end()) {
@@ -117,27 +142,60 @@ optional<InternetDatagram> NetworkInterface::recv_frame(const EthernetFrame &fra
 
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void NetworkInterface::tick(const size_t ms_since_last_tick) {
+    if (_timer_wheel) {
+        throw runtime_error("NetworkInterface::tick() on a shared TimerWheel");
+    }
     // 删除 ARP 表中过期条目
     for (auto it = _arp_table.begin(); it != _arp_table.end(); ) {
-        if (it->second.ttl <= ms_since_last_tick) {
+        if (it->second.timer.ttl <= ms_since_last_tick) {
             it = _arp_table.erase(it);
         } else {
-            it->second.ttl -= ms_since_last_tick;
+            it->second.timer.ttl -= ms_since_last_tick;
             it = std::next(it);
         }
     }
     // 删除等待 ARP 报文回复超时的记录，不作重发处理
     for (auto it = _waiting_arp_response_ip_addr.begin(); it != _waiting_arp_response_ip_addr.end(); ) {
-        if (it->second <= ms_since_last_tick) {
+        if (it->second.ttl <= ms_since_last_tick) {
             // 如果还有等待发往该未回复的 IP 地址的数据报，则直接丢弃
-            auto it2 = _waiting_internet_datagrams.find(it->first);
-            if (it2 != _waiting_internet_datagrams.end())
-                _waiting_internet_datagrams.erase(it2);
-
+            _waiting_internet_datagrams.erase(it->first);
             it = _waiting_arp_response_ip_addr.erase(it);
         } else {
-            it->second -= ms_since_last_tick;
+            it->second.ttl -= ms_since_last_tick;
             it = std::next(it);
         }
     }
 }
+
+void NetworkInterface::set_timer_wheel(shared_ptr<TimerWheel> wheel, const uint64_t tag) {
+    if (!_arp_table.empty() || !_waiting_arp_response_ip_addr.empty()) {
+        throw runtime_error("NetworkInterface::set_timer_wheel() with ARP timers running");
+    }
+    _timer_wheel = std::move(wheel);
+    _timer_tag = tag;
+}
+
+NetworkInterface::ARPTimer NetworkInterface::_start_timer(const uint32_t ttl, const uint64_t cookie) {
+    if (_timer_wheel) {
+        return {0, _timer_wheel->start(ttl, _timer_tag, cookie)};
+    }
+    return {ttl, 0};
+}
+
+void NetworkInterface::_stop_timer(const ARPTimer &timer) {
+    if (_timer_wheel) {
+        _timer_wheel->stop(timer.id);
+    }
+}
+
+void NetworkInterface::timer_expired(const uint64_t cookie) {
+    const uint32_t ip = cookie >> 1;
+    if ((cookie & 1) == 0) {
+        // 删除 ARP 表中过期条目
+        _arp_table.erase(ip);
+        return;
+    }
+    // 删除等待 ARP 报文回复超时的记录，不作重发处理；如果还有等待发往该未回复的 IP 地址的数据报，则直接丢弃
+    _waiting_internet_datagrams.erase(ip);
+    _waiting_arp_response_ip_addr.erase(ip);
+}
@@ -5,14 +5,17 @@
 #include "ethernet_frame.hh"
 #include "ethernet_header.hh"
 #include "tcp_over_ip.hh"
+#include "timer_wheel.hh"
 #include "tun.hh"
 
 #include <cstddef>
 #include <cstdint>
 #include <list>
+#include <memory>
 #include <optional>
 #include <queue>
 #include <unordered_map>
+#include <vector>
 
 //! \brief A "network interface" that connects IP (the internet layer, or network layer)
 //! with Ethernet (the network access layer, or link layer).
@@ -37,10 +40,16 @@
 //! and learns or replies as necessary.
 class NetworkInterface {
   private:
+    //! ARP 定时器：自己计时时记录剩余时间（ms），由 tick() 递减；共享 TimerWheel 时记录 wheel 上的定时器
+    struct ARPTimer {
+      size_t ttl;
+      TimerWheel::TimerId id;
+    };
+
     //! ARP 条目
     struct ARPEntry {
       EthernetAddress eth_addr;
-      size_t ttl;
+      ARPTimer timer;
     };
 
     //! Ethernet (known as hardware, network-access-layer, or link-layer) address of the interface
@@ -55,12 +64,26 @@ class NetworkInterface {
     //! ARP 表
     std::unordered_map<uint32_t, ARPEntry> _arp_table{};
 
-    //! 正在查询的 ARP 报文。如果发送了 ARP 请求后，在过期时间内没有返回响应，则丢弃等待的 IP 报文
-    std::unordered_map<uint32_t, size_t> _waiting_arp_response_ip_addr{};
+    //! 正在查询的 ARP 报文及其定时器。如果发送了 ARP 请求后，在过期时间内没有返回响应，则丢弃等待的 IP 报文
+    std::unordered_map<uint32_t, ARPTimer> _waiting_arp_response_ip_addr{};
 
     //! 等待 ARP 报文返回的待处理 IP 报文，每一个 IP 地址映射到一个 IP 报文等待发送列表
     std::unordered_map<uint32_t, std::list<std::pair<Address, InternetDatagram> > > _waiting_internet_datagrams{};
 
+    //! 与其他接口共享的 TimerWheel，由它的所有者推进；默认为空，此时 ARP 定时器自己计时，由 tick() 推进
+    std::shared_ptr<TimerWheel> _timer_wheel{};
+    uint64_t _timer_tag = 0;
+
+    //! 定时器的 cookie：IP 地址左移一位，最低位区分 ARP 条目过期（0）和 ARP 请求等待超时（1）
+    static uint64_t _arp_entry_cookie(const uint32_t ip) { return uint64_t(ip) << 1; }
+    static uint64_t _arp_response_cookie(const uint32_t ip) { return (uint64_t(ip) << 1) | 1; }
+
+    //! \brief 开始一个 ARP 定时器
+    ARPTimer _start_timer(const uint32_t ttl, const uint64_t cookie);
+
+    //! \brief 停止一个 ARP 定时器（自己计时时无需操作）
+    void _stop_timer(const ARPTimer &timer);
+
     //! \brief 发送以太网帧
     void _send(const EthernetAddress &dst, const uint16_t type, BufferList &&payload);
 
@@ -83,6 +106,11 @@ class NetworkInterface {
     //! ("Sending" is accomplished by pushing the frame onto the frames_out queue.)
     void send_datagram(const InternetDatagram &dgram, const Address &next_hop);
 
+    //! \brief Sends several IPv4 datagrams to the same next hop, looking up its Ethernet address once
+    void send_datagrams(std::vector<InternetDatagram>::const_iterator first,
+                        std::vector<InternetDatagram>::const_iterator last,
+                        const Address &next_hop);
+
     //! \brief Receives an Ethernet frame and responds appropriately.
 
     //! If type is IPv4, returns the datagram.
@@ -91,7 +119,16 @@ class NetworkInterface {
     std::optional<InternetDatagram> recv_frame(const EthernetFrame &frame);
 
     //! \brief Called periodically when time elapses
+    //! \note Not for an interface on a shared TimerWheel; the wheel's owner calls timer_expired() instead.
     void tick(const size_t ms_since_last_tick);
+
+    //! \brief Run the interface's ARP timers on `wheel`, which others share and its owner advances
+    //! \details When a timer with this `tag` expires, the owner calls timer_expired() with its cookie.
+    //! Call before sending or receiving anything, and don't call tick().
+    void set_timer_wheel(std::shared_ptr<TimerWheel> wheel, const uint64_t tag);
+
+    //! \brief An ARP timer of the interface, identified by `cookie`, expired on a shared TimerWheel
+    void timer_expired(const uint64_t cookie);
 };
 
 #endif  // SPONGE_LIBSPONGE_NETWORK_INTERFACE_HH
@@ -0,0 +1,152 @@
+#include "prefix_trie.hh"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+using namespace std;
+
+PrefixTrie::PrefixTrie() : _slots(size_t(1) << ROOT_STRIDE), _lengths(size_t(1) << ROOT_STRIDE) {}
+
+void PrefixTrie::_push(const size_t slot, const uint32_t value, const uint8_t length) {
+    if (_slots[slot] & CHILD) {
+        const size_t child = _slots[slot] & ~CHILD;
+        for (size_t i = 0; i < (size_t(1) << STRIDE); i++) {
+            _push(child + i, value, length);
+        }
+        return;
+    }
+    if (_slots[slot] == 0 or length > _lengths[slot]) {
+        _slots[slot] = value;
+        _lengths[slot] = length;
+    }
+}
+
+void PrefixTrie::_replace(const size_t slot, const uint8_t length, const uint32_t value, const uint8_t value_length) {
+    if (_slots[slot] & CHILD) {
+        const size_t child = _slots[slot] & ~CHILD;
+        for (size_t i = 0; i < (size_t(1) << STRIDE); i++) {
+            _replace(child + i, length, value, value_length);
+        }
+        return;
+    }
+    // within the prefix's addresses, only the prefix itself has its length
+    if (_slots[slot] != 0 and _lengths[slot] == length) {
+        _slots[slot] = value;
+        _lengths[slot] = value_length;
+    }
+}
+
+void PrefixTrie::lookup(const uint32_t *addresses, optional<size_t> *values, const size_t count) const {
+    constexpr size_t CHUNK = 64;
+    array<uint32_t, CHUNK> slots{};
+    for (size_t start = 0; start < count; start += CHUNK) {
+        const size_t n = min(CHUNK, count - start);
+        const uint32_t *const chunk = addresses + start;
+
+        bool descend = false;
+        for (size_t i = 0; i < n; i++) {
+            slots[i] = _slots[chunk[i] >> (32 - ROOT_STRIDE)];
+            descend |= (slots[i] & CHILD) != 0;
+        }
+        if (descend) {
+            for (size_t i = 0; i < n; i++) {
+                if (slots[i] & CHILD) {
+                    slots[i] = _slots[(slots[i] & ~CHILD) + ((chunk[i] >> STRIDE) & 0xff)];
+                }
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (slots[i] & CHILD) {
+                    slots[i] = _slots[(slots[i] & ~CHILD) + (chunk[i] & 0xff)];
+                }
+            }
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            values[start + i] = slots[i] == 0 ? nullopt : optional<size_t>{slots[i] - 1};
+        }
+    }
+}
+
+void PrefixTrie::add(const uint32_t prefix, const uint8_t length, const size_t value) {
+    if (length > 32) {
+        throw invalid_argument("PrefixTrie::add: prefix length is longer than 32 bits");
+    }
+    if (value >= CHILD - 1) {
+        throw invalid_argument("PrefixTrie::add: value is too large");
+    }
+    const uint32_t masked = length == 0 ? 0 : prefix & ~((uint64_t(1) << (32 - length)) - 1);
+    const uint32_t stored = value + 1;
+
+    size_t node = 0;
+    unsigned consumed = 0;
+    unsigned stride = ROOT_STRIDE;
+    while (true) {
+        const size_t index = (masked >> (32 - consumed - stride)) & ((size_t(1) << stride) - 1);
+
+        // the prefix ends within this level: expand it over all the slots it covers
+        if (length <= consumed + stride) {
+            const size_t count = size_t(1) << (consumed + stride - length);
+            const size_t first = index & ~(count - 1);
+            for (size_t i = first; i < first + count; i++) {
+                _push(node + i, stored, length);
+            }
+            break;
+        }
+
+        // otherwise descend, creating the child node with the slot's current value pushed into it
+        const size_t slot = node + index;
+        if (not(_slots[slot] & CHILD)) {
+            const uint32_t inherited_value = _slots[slot];
+            const uint8_t inherited_length = _lengths[slot];
+            const size_t child = _slots.size();
+            _slots.resize(child + (size_t(1) << STRIDE), inherited_value);
+            _lengths.resize(child + (size_t(1) << STRIDE), inherited_length);
+            _slots[slot] = CHILD | child;
+        }
+        node = _slots[slot] & ~CHILD;
+        consumed += stride;
+        stride = STRIDE;
+    }
+    _size++;
+}
+
+void PrefixTrie::remove(const uint32_t prefix,
+                        const uint8_t length,
+                        const optional<size_t> fallback,
+                        const uint8_t fallback_length) {
+    if (length > 32) {
+        throw invalid_argument("PrefixTrie::remove: prefix length is longer than 32 bits");
+    }
+    if (fallback.has_value() and (fallback.value() >= CHILD - 1 or fallback_length >= length)) {
+        throw invalid_argument("PrefixTrie::remove: bad fallback");
+    }
+    const uint32_t masked = length == 0 ? 0 : prefix & ~((uint64_t(1) << (32 - length)) - 1);
+    const uint32_t fallback_stored = fallback.has_value() ? fallback.value() + 1 : 0;
+
+    size_t node = 0;
+    unsigned consumed = 0;
+    unsigned stride = ROOT_STRIDE;
+    while (true) {
+        const size_t index = (masked >> (32 - consumed - stride)) & ((size_t(1) << stride) - 1);
+
+        if (length <= consumed + stride) {
+            const size_t count = size_t(1) << (consumed + stride - length);
+            const size_t first = index & ~(count - 1);
+            for (size_t i = first; i < first + count; i++) {
+                _replace(node + i, length, fallback_stored, fallback_length);
+            }
+            _size--;
+            return;
+        }
+
+        // a longer prefix needs a child node, so without one the prefix was never added
+        const size_t slot = node + index;
+        if (not(_slots[slot] & CHILD)) {
+            throw invalid_argument("PrefixTrie::remove: prefix not in the trie");
+        }
+        node = _slots[slot] & ~CHILD;
+        consumed += stride;
+        stride = STRIDE;
+    }
+}
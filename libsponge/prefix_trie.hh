@@ -0,0 +1,88 @@
+#ifndef SPONGE_LIBSPONGE_PREFIX_TRIE_HH
+#define SPONGE_LIBSPONGE_PREFIX_TRIE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+//! \brief A longest-prefix-match table for IPv4 addresses
+//!
+//! A multibit trie with strides of 16, 8 and 8 bits (like DIR-24-8, but with a 16-bit
+//! first level so that a small table stays small). Prefixes are expanded to the stride
+//! boundaries and pushed down to the leaves, so every slot holds either the value of the
+//! longest prefix covering it or a pointer to the next level. A lookup is at most three
+//! array reads, however many prefixes the table holds.
+class PrefixTrie {
+  private:
+    static constexpr unsigned ROOT_STRIDE = 16;
+    static constexpr unsigned STRIDE = 8;
+    static constexpr uint32_t CHILD = 1u << 31;  //!< set in a slot that points to a child node
+
+    //! Each slot is 0 (no matching prefix), value + 1, or CHILD | (offset of the child node).
+    //! The root node is at offset 0; the other nodes follow it, `1 << STRIDE` slots each.
+    std::vector<uint32_t> _slots;
+
+    //! For each slot that holds a value, the length of the prefix it came from
+    std::vector<uint8_t> _lengths;
+
+    //! Number of prefixes added and not removed
+    size_t _size = 0;
+
+    //! Store `value` in the slot (and in its whole subtree) unless a longer prefix got there first
+    void _push(const size_t slot, const uint32_t value, const uint8_t length);
+
+    //! Replace what a prefix of `length` bits left in the slot (and in its whole subtree)
+    void _replace(const size_t slot, const uint8_t length, const uint32_t value, const uint8_t value_length);
+
+  public:
+    PrefixTrie();
+
+    //! \brief Add a prefix
+    //! \note If the same prefix is added twice, the first value is kept.
+    //! \param[in] prefix the prefix (bits past `length` are ignored)
+    //! \param[in] length how many high-order bits of `prefix` must match (0 to 32)
+    //! \param[in] value the value to return for addresses that match this prefix best (less than 2^31 - 1)
+    void add(const uint32_t prefix, const uint8_t length, const size_t value);
+
+    //! \brief Remove a prefix
+    //! \details The trie does not remember shorter prefixes that a longer one hides, so the caller
+    //! names the longest remaining prefix covering this one, which takes over its addresses.
+    //! Nodes that become unnecessary are not freed.
+    //! \note Only remove a prefix that was added (and not already removed).
+    //! \param[in] prefix, length the prefix to remove
+    //! \param[in] fallback the value of the longest other prefix covering this one, if any
+    //! \param[in] fallback_length that prefix's length (shorter than `length`)
+    void remove(const uint32_t prefix,
+                const uint8_t length,
+                const std::optional<size_t> fallback = {},
+                const uint8_t fallback_length = 0);
+
+    //! \brief The value of the longest prefix that matches `address`, if any
+    std::optional<size_t> lookup(const uint32_t address) const {
+        uint32_t slot = _slots[address >> (32 - ROOT_STRIDE)];
+        if (slot & CHILD) {
+            slot = _slots[(slot & ~CHILD) + ((address >> STRIDE) & 0xff)];
+            if (slot & CHILD) {
+                slot = _slots[(slot & ~CHILD) + (address & 0xff)];
+            }
+        }
+        if (slot == 0) {
+            return std::nullopt;
+        }
+        return slot - 1;
+    }
+
+    //! \brief Look up `count` addresses at once, storing the results in `values`
+    //! \details The lookups advance one level of the trie at a time, so the memory accesses of
+    //! different lookups are independent and their cache misses overlap.
+    void lookup(const uint32_t *addresses, std::optional<size_t> *values, const size_t count) const;
+
+    //! \brief Number of prefixes added and not removed
+    size_t size() const { return _size; }
+
+    //! \brief Approximate memory used by the table, in bytes
+    size_t memory_usage() const { return _slots.capacity() * sizeof(uint32_t) + _lengths.capacity(); }
+};
+
+#endif  // SPONGE_LIBSPONGE_PREFIX_TRIE_HH
@@ -0,0 +1,46 @@
+#include "route_cache.hh"
+
+using namespace std;
+
+static unsigned log2_at_least(const size_t n) {
+    unsigned bits = 1;
+    while ((size_t(1) << bits) < n) {
+        bits++;
+    }
+    return bits;
+}
+
+RouteCache::RouteCache(const size_t capacity)
+    : _slots(size_t(1) << log2_at_least(capacity)), _shift(32 - log2_at_least(capacity)) {}
+
+void RouteCache::lookup(const PrefixTrie &trie,
+                        const uint64_t generation,
+                        const uint32_t *addresses,
+                        optional<size_t> *values,
+                        const size_t count) {
+    _miss_addresses.clear();
+    _miss_positions.clear();
+    for (size_t i = 0; i < count; i++) {
+        const Slot &slot = _slots[_index(addresses[i])];
+        if (slot.generation == generation + 1 and slot.address == addresses[i]) {
+            values[i] = slot.value == 0 ? nullopt : optional<size_t>{slot.value - 1};
+        } else {
+            _miss_addresses.push_back(addresses[i]);
+            _miss_positions.push_back(i);
+        }
+    }
+    _count(_hits, count - _miss_addresses.size());
+    _count(_misses, _miss_addresses.size());
+    if (_miss_addresses.empty()) {
+        return;
+    }
+
+    _miss_values.resize(_miss_addresses.size());
+    trie.lookup(_miss_addresses.data(), _miss_values.data(), _miss_addresses.size());
+    for (size_t k = 0; k < _miss_addresses.size(); k++) {
+        const auto &value = _miss_values[k];
+        values[_miss_positions[k]] = value;
+        _slots[_index(_miss_addresses[k])] = {
+            _miss_addresses[k], value.has_value() ? static_cast<uint32_t>(value.value() + 1) : 0, generation + 1};
+    }
+}
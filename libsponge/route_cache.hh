@@ -0,0 +1,86 @@
+#ifndef SPONGE_LIBSPONGE_ROUTE_CACHE_HH
+#define SPONGE_LIBSPONGE_ROUTE_CACHE_HH
+
+#include "prefix_trie.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+//! \brief A direct-mapped cache of longest-prefix-match results, in front of a PrefixTrie
+//!
+//! Each destination address hashes to one slot, which remembers the last address looked up
+//! there and the value the trie returned for it (including "no match"). Traffic tends to go to
+//! a few thousand destinations, whose slots stay in the CPU cache while the trie is far bigger.
+//!
+//! Every lookup names the generation of the table it is looking in; slots filled for an older
+//! generation count as empty, so changing the table invalidates the whole cache in O(1).
+//! A cache belongs to one thread, but its counters may be read from any thread.
+class RouteCache {
+  private:
+    struct Slot {
+        uint32_t address = 0;
+        uint32_t value = 0;       //!< as in PrefixTrie: 0 for no match, otherwise value + 1
+        uint64_t generation = 0;  //!< the table's generation + 1, or 0 for an empty slot
+    };
+
+    std::vector<Slot> _slots;
+    unsigned _shift;
+
+    //! Written only by the owning thread
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+
+    //! Scratch space for the misses of a batched lookup
+    std::vector<uint32_t> _miss_addresses{};
+    std::vector<size_t> _miss_positions{};
+    std::vector<std::optional<size_t>> _miss_values{};
+
+    size_t _index(const uint32_t address) const { return (address * 0x9e3779b1u) >> _shift; }
+
+    static void _count(std::atomic<uint64_t> &counter, const uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+  public:
+    //! \param[in] capacity the number of slots (rounded up to a power of two, at least 2)
+    explicit RouteCache(const size_t capacity);
+
+    //! \brief The value of the longest prefix in `trie` that matches `address`, if any
+    //! \param[in] generation identifies the trie's contents; it must change whenever they do
+    std::optional<size_t> lookup(const PrefixTrie &trie, const uint64_t generation, const uint32_t address) {
+        Slot &slot = _slots[_index(address)];
+        if (slot.generation == generation + 1 and slot.address == address) {
+            _count(_hits, 1);
+        } else {
+            _count(_misses, 1);
+            const auto value = trie.lookup(address);
+            slot = {address, value.has_value() ? static_cast<uint32_t>(value.value() + 1) : 0, generation + 1};
+        }
+        if (slot.value == 0) {
+            return std::nullopt;
+        }
+        return slot.value - 1;
+    }
+
+    //! \brief Look up `count` addresses at once, storing the results in `values`
+    //! \details The misses are looked up in the trie together (see PrefixTrie::lookup).
+    void lookup(const PrefixTrie &trie,
+                const uint64_t generation,
+                const uint32_t *addresses,
+                std::optional<size_t> *values,
+                const size_t count);
+
+    //! \brief Number of slots
+    size_t capacity() const { return _slots.size(); }
+
+    //! \brief Number of lookups answered from the cache
+    uint64_t hits() const { return _hits.load(std::memory_order_relaxed); }
+
+    //! \brief Number of lookups that went to the trie
+    uint64_t misses() const { return _misses.load(std::memory_order_relaxed); }
+};
+
+#endif  // SPONGE_LIBSPONGE_ROUTE_CACHE_HH
@@ -1,6 +1,12 @@
 #include "router.hh"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
 
 using namespace std;
 
@@ -26,11 +32,282 @@ void Router::add_route(const uint32_t route_prefix,
                        const uint8_t prefix_length,
                        const optional<Address> next_hop,
                        const size_t interface_num) {
-    cerr << "DEBUG: adding route " << Address::from_ipv4_numeric(route_prefix).ip() << "/" << int(prefix_length)
-         << " => " << (next_hop.has_value() ? next_hop->ip() : "(direct)") << " on interface " << interface_num << "\n";
-
     // Your code here.
-    _route_table.emplace_back(route_prefix, prefix_length, next_hop, interface_num);
+    RouteUpdate update;
+    update.add(route_prefix, prefix_length, next_hop, interface_num);
+    update_routes(update);
+}
+
+void Router::add_route(const uint32_t route_prefix, const uint8_t prefix_length, const vector<RoutePath> &paths) {
+    RouteUpdate update;
+    update.add(route_prefix, prefix_length, paths);
+    update_routes(update);
+}
+
+void Router::withdraw_route(const uint32_t route_prefix, const uint8_t prefix_length) {
+    RouteUpdate update;
+    update.withdraw(route_prefix, prefix_length);
+    update_routes(update);
+}
+
+//! 前缀去掉长度之外的位后，与长度一起作为 _route_index 的键
+static uint64_t route_key(const uint32_t route_prefix, const uint8_t prefix_length) {
+    const uint32_t mask = prefix_length == 0 ? 0 : ~((uint64_t(1) << (32 - prefix_length)) - 1);
+    return (uint64_t(route_prefix & mask) << 8) | prefix_length;
+}
+
+void Router::_resolve(const RouteUpdate::Change &change, vector<TableChange> &out) {
+    const uint64_t key = route_key(change.route_prefix, change.prefix_length);
+    const auto existing = _route_index.find(key);
+    RouteEntry entry{change.route_prefix, change.prefix_length, 0};
+
+    switch (change.kind) {
+        case RouteUpdate::Change::Kind::Add:
+        case RouteUpdate::Change::Kind::Replace: {
+            // 已有这个前缀的路由时，添加则保留原来的
+            if (existing != _route_index.end() && change.kind == RouteUpdate::Change::Kind::Add) {
+                return;
+            }
+
+            // 找到（或新建）这些路径的下一跳组
+            vector<NextHop> group;
+            for (const auto &path : change.paths) {
+                optional<uint32_t> address;
+                if (path.next_hop.has_value()) {
+                    address = path.next_hop->ipv4_numeric();
+                }
+                group.push_back({address, path.interface_num});
+            }
+            entry.group = _acquire_group(std::move(group), out);
+
+            // 替换时只需改条目，trie 不变；先取得新的组再放弃旧的组，组不变时就不会被回收
+            if (existing != _route_index.end()) {
+                _release_group(existing->second.group, out);
+                existing->second.group = entry.group;
+                out.push_back({TableChange::Kind::Update, existing->second.entry, entry, nullopt, {}});
+                return;
+            }
+            size_t index = _route_index.size() + _free_entries.size();
+            if (!_free_entries.empty()) {
+                index = _free_entries.back();
+                _free_entries.pop_back();
+            }
+            _route_index.emplace(key, IndexedRoute{index, entry.group});
+            out.push_back({TableChange::Kind::Insert, index, entry, nullopt, {}});
+            return;
+        }
+        case RouteUpdate::Change::Kind::Withdraw: {
+            if (existing == _route_index.end()) {
+                return;
+            }
+            // 覆盖这个前缀的、更短的前缀中最长的那个接管它的地址
+            optional<size_t> fallback;
+            for (int length = change.prefix_length - 1; length >= 0 && !fallback.has_value(); length--) {
+                const auto covering = _route_index.find(route_key(change.route_prefix, static_cast<uint8_t>(length)));
+                if (covering != _route_index.end()) {
+                    fallback = covering->second.entry;
+                }
+            }
+            out.push_back({TableChange::Kind::Erase, existing->second.entry, entry, fallback, {}});
+            _release_group(existing->second.group, out);
+            _free_entries.push_back(existing->second.entry);
+            _route_index.erase(existing);
+            return;
+        }
+    }
+}
+
+uint32_t Router::_acquire_group(vector<NextHop> &&group, vector<TableChange> &out) {
+    const auto found = _group_index.find(group);
+    if (found != _group_index.end()) {
+        _group_uses[found->second].refs++;
+        return found->second;
+    }
+
+    uint32_t index = _group_uses.size();
+    if (!_free_groups.empty()) {
+        index = _free_groups.back();
+        _free_groups.pop_back();
+    } else {
+        _group_uses.emplace_back();
+    }
+    const auto it = _group_index.emplace(group, index).first;
+    _group_uses[index] = {it, 1};
+    out.push_back({TableChange::Kind::AddGroup, index, {}, nullopt, std::move(group)});
+    return index;
+}
+
+void Router::_release_group(const uint32_t group, vector<TableChange> &out) {
+    auto &use = _group_uses[group];
+    if (--use.refs > 0) {
+        return;
+    }
+    _group_index.erase(use.it);
+    use.it = _group_index.end();
+    _free_groups.push_back(group);
+    out.push_back({TableChange::Kind::RemoveGroup, group, {}, nullopt, {}});
+}
+
+void Router::_apply(RouteTable &table, const TableChange &change) {
+    switch (change.kind) {
+        case TableChange::Kind::Insert:
+            if (change.index == table.entries.size()) {
+                table.entries.push_back(change.entry);
+            } else {
+                table.entries[change.index] = change.entry;
+            }
+            table.trie.add(change.entry.route_prefix, change.entry.prefix_length, change.index);
+            return;
+        case TableChange::Kind::Update:
+            table.entries[change.index] = change.entry;
+            return;
+        case TableChange::Kind::Erase: {
+            const auto &entry = table.entries[change.index];
+            const uint8_t fallback_length =
+                change.fallback.has_value() ? table.entries[change.fallback.value()].prefix_length : 0;
+            table.trie.remove(entry.route_prefix, entry.prefix_length, change.fallback, fallback_length);
+            return;
+        }
+        case TableChange::Kind::AddGroup:
+            if (change.index == table.groups.size()) {
+                table.groups.push_back(change.group);
+            } else {
+                table.groups[change.index] = change.group;
+            }
+            return;
+        case TableChange::Kind::RemoveGroup:
+            // 释放路径的内存；没有条目再引用这个下标
+            table.groups[change.index] = {};
+            return;
+    }
+}
+
+//! 五元组（源地址、目的地址、协议，以及 TCP 和 UDP 的源端口、目的端口）的哈希。
+//! 分片后只有第一片带有端口，所以分片的数据报不计端口，让同一个数据报的各片走同一条路径
+static uint64_t flow_hash(const InternetDatagram &dgram) {
+    const auto &header = dgram.header();
+    uint32_t ports = 0;
+    const bool has_ports = (header.proto == IPv4Header::PROTO_TCP || header.proto == IPv4Header::PROTO_UDP) &&
+                           !header.mf && header.offset == 0;
+    if (has_ports) {
+        const auto &buffers = dgram.payload().buffers();
+        if (!buffers.empty() && buffers.front().size() >= 4) {
+            const auto bytes = buffers.front().str();
+            for (size_t i = 0; i < 4; i++) {
+                ports = (ports << 8) | static_cast<uint8_t>(bytes[i]);
+            }
+        } else if (dgram.payload().size() >= 4) {
+            const string bytes = dgram.payload().concatenate();
+            for (size_t i = 0; i < 4; i++) {
+                ports = (ports << 8) | static_cast<uint8_t>(bytes[i]);
+            }
+        }
+    }
+
+    // 混合各个字段（MurmurHash3 的 64 位收尾函数）
+    uint64_t hash = (uint64_t(header.src) << 32) | header.dst;
+    hash ^= ((uint64_t(ports) << 8) | header.proto) * 0x9e3779b97f4a7c15;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+const Router::NextHop &Router::RouteTable::path(const RouteEntry &entry, const InternetDatagram &dgram) const {
+    const auto &paths = groups[entry.group];
+    if (paths.size() == 1) {
+        return paths.front();
+    }
+    // 把哈希的高 32 位按比例映射到 [0, 路径数)，不用取模
+    return paths[((flow_hash(dgram) >> 32) * paths.size()) >> 32];
+}
+
+void Router::update_routes(const RouteUpdate &update) {
+    // 先检查完所有变化，这样出错时路由表保持原样
+    for (const auto &change : update.changes()) {
+        if (change.prefix_length > 32) {
+            throw invalid_argument("Router::update_routes: prefix length is longer than 32 bits");
+        }
+        if (change.kind != RouteUpdate::Change::Kind::Withdraw && change.paths.empty()) {
+            throw invalid_argument("Router::update_routes: a route needs at least one path");
+        }
+    }
+
+    if (!_running.load()) {
+        // 没有 worker 在读，直接修改当前的路由表；备用的快照就此过时
+        _spare_routes.reset();
+        _spare_changes.clear();
+        _retired_routes.clear();
+        vector<TableChange> changes;
+        for (const auto &change : update.changes()) {
+            changes.clear();
+            _resolve(change, changes);
+            for (const auto &table_change : changes) {
+                _apply(*_current_routes, table_change);
+            }
+        }
+        _routes_version.fetch_add(1, memory_order_release);
+        return;
+    }
+
+    // 释放已经没有 worker 使用的旧快照
+    _retired_routes.erase(remove_if(_retired_routes.begin(),
+                                    _retired_routes.end(),
+                                    [&](const auto &routes) { return !_routes_in_use(routes.get()); }),
+                          _retired_routes.end());
+
+    // 准备新的路由表：备用快照已经没有 worker 使用时，补上它错过的修改；否则只好复制当前的路由表。
+    // 备用快照已不是 _routes，worker 不会再开始使用它，所以检查之后它一直空闲
+    unique_ptr<RouteTable> routes;
+    if (_spare_routes && !_routes_in_use(_spare_routes.get())) {
+        routes = std::move(_spare_routes);
+        for (const auto &table_change : _spare_changes) {
+            _apply(*routes, table_change);
+        }
+    } else {
+        routes = make_unique<RouteTable>(*_current_routes);
+        if (_spare_routes) {
+            _retired_routes.push_back(std::move(_spare_routes));
+        }
+    }
+
+    vector<TableChange> changes;
+    for (const auto &change : update.changes()) {
+        _resolve(change, changes);
+    }
+    for (const auto &table_change : changes) {
+        _apply(*routes, table_change);
+    }
+
+    // 替换后，旧的路由表留作下一次更新的备用快照
+    _spare_routes = std::move(_current_routes);
+    _spare_changes = std::move(changes);
+    _current_routes = std::move(routes);
+    _routes.store(_current_routes.get());
+    _routes_version.fetch_add(1, memory_order_release);
+}
+
+//! \details 与 _acquire_routes 配对：两边都用顺序一致的原子操作，所以只要这里看不到某个 worker 声明使用
+//! 一份已被替换下来的快照，那个 worker 之后也不会再使用它
+bool Router::_routes_in_use(const RouteTable *routes) const {
+    return any_of(
+        _worker_routes.begin(), _worker_routes.end(), [&](const auto &used) { return used.load() == routes; });
+}
+
+const Router::RouteTable *Router::_acquire_routes(const size_t interface_num) {
+    auto &used = _worker_routes[interface_num];
+    const RouteTable *routes = _routes.load();
+    // 声明之后再确认它仍是当前的快照：否则 update_routes 可能在声明之前就已检查过并复用了它
+    while (true) {
+        used.store(routes);
+        const RouteTable *const current = _routes.load();
+        if (current == routes) {
+            return routes;
+        }
+        routes = current;
+    }
 }
 
 //! \param[in] dgram The datagram to be routed
@@ -38,24 +315,17 @@ void Router::route_one_datagram(InternetDatagram &dgram) {
     // Your code here.
     // 取出 IP 字段，在路由表中进行最长前缀匹配
     auto ip = dgram.header().dst;
-    auto best_match_it = _route_table.end();
-    for (auto it = _route_table.begin(); it != _route_table.end(); it = std::next(it)) {
-        // 前缀匹配成功
-        //! NOTE: 根据 CSAPP，在 32 位整数下，右移量只取低 5 位（即 mod 32），因此右移 32 位等价于右移 0 位，因此这里需要特判右移 32 位的情况 
-        // cerr << "DEBUG route table: " << ((it->route_prefix ^ ip) >> (32 - it->prefix_length)) << '\n';
-        if (it->prefix_length == 0 ||  (it->route_prefix ^ ip) >> (32 - it->prefix_length) == 0) {
-            if (best_match_it == _route_table.end() || it->prefix_length > best_match_it->prefix_length) {
-                best_match_it = it;
-            }
-        }
-    }
+    const auto best_match = _route_cache ? _route_cache->lookup(_current_routes->trie, _routes_version.load(), ip)
+                                         : _current_routes->trie.lookup(ip);
     // 匹配到路由规则并且 TTL 大于 1
-    if (best_match_it != _route_table.end() && dgram.header().ttl > 1) {
-        --dgram.header().ttl;
-        auto &next_interface = interface(best_match_it->interface_num);
+    if (best_match.has_value() && dgram.header().ttl > 1) {
+        const auto &path = _current_routes->path(_current_routes->entries[best_match.value()], dgram);
+        // 增量更新校验和（RFC 1624），发送时直接复用收到的首部字节
+        dgram.decrement_ttl();
+        auto &next_interface = interface(path.interface_num);
         // 如果路由器直接连接到相关网络，则下一跳就是目的 IP 地址，否则为下一跳路由器的 IP 地址
-        if (best_match_it->next_hop.has_value()) {
-            next_interface.send_datagram(dgram, best_match_it->next_hop.value());
+        if (path.address.has_value()) {
+            next_interface.send_datagram(dgram, Address::from_ipv4_numeric(path.address.value()));
         } else {
             next_interface.send_datagram(dgram, Address::from_ipv4_numeric(ip));
         }
@@ -63,13 +333,256 @@ void Router::route_one_datagram(InternetDatagram &dgram) {
     // 其余情况数据报则直接丢弃，也不作 ICMP 回复
 }
 
+void Router::route_batch(queue<InternetDatagram> &queue) {
+    _batch.clear();
+    while (not queue.empty() && _batch.size() < _batch_size) {
+        _batch.push_back(std::move(queue.front()));
+        queue.pop();
+    }
+
+    // 一起查路由表，让各次查找的访存重叠
+    _batch_dst.resize(_batch.size());
+    _batch_match.resize(_batch.size());
+    for (size_t i = 0; i < _batch.size(); i++) {
+        _batch_dst[i] = _batch[i].header().dst;
+    }
+    if (_route_cache) {
+        _route_cache->lookup(
+            _current_routes->trie, _routes_version.load(), _batch_dst.data(), _batch_match.data(), _batch.size());
+    } else {
+        _current_routes->trie.lookup(_batch_dst.data(), _batch_match.data(), _batch.size());
+    }
+
+    // 按 (出接口, 下一跳) 排序；下标也参与比较，所以同一下一跳的数据报保持原来的顺序
+    _batch_order.clear();
+    for (size_t i = 0; i < _batch.size(); i++) {
+        if (!_batch_match[i].has_value() || _batch[i].header().ttl <= 1) {
+            continue;
+        }
+        const auto &path = _current_routes->path(_current_routes->entries[_batch_match[i].value()], _batch[i]);
+        const uint32_t next_hop = path.address.value_or(_batch_dst[i]);
+        _batch[i].decrement_ttl();
+        _batch_order.emplace_back((uint64_t(path.interface_num) << 32) | next_hop, i);
+    }
+    sort(_batch_order.begin(), _batch_order.end());
+
+    _batch_grouped.clear();
+    for (const auto &[key, i] : _batch_order) {
+        _batch_grouped.push_back(std::move(_batch[i]));
+    }
+
+    // 每组只查一次 ARP 表，连续地发出
+    for (size_t first = 0; first < _batch_order.size();) {
+        const uint64_t key = _batch_order[first].first;
+        size_t last = first + 1;
+        while (last < _batch_order.size() && _batch_order[last].first == key) {
+            ++last;
+        }
+        interface(key >> 32).send_datagrams(_batch_grouped.begin() + first,
+                                            _batch_grouped.begin() + last,
+                                            Address::from_ipv4_numeric(key & 0xffffffff));
+        first = last;
+    }
+}
+
+void Router::set_route_cache_size(const size_t slots) {
+    if (_running.load()) {
+        throw runtime_error("Router::set_route_cache_size: the worker threads are forwarding");
+    }
+    _route_cache_size = slots;
+    _route_cache = slots > 0 ? make_unique<RouteCache>(slots) : nullptr;
+    _worker_route_caches.clear();
+}
+
+uint64_t Router::route_cache_hits() const {
+    uint64_t hits = _route_cache ? _route_cache->hits() : 0;
+    for (const auto &cache : _worker_route_caches) {
+        hits += cache->hits();
+    }
+    return hits;
+}
+
+uint64_t Router::route_cache_misses() const {
+    uint64_t misses = _route_cache ? _route_cache->misses() : 0;
+    for (const auto &cache : _worker_route_caches) {
+        misses += cache->misses();
+    }
+    return misses;
+}
+
 void Router::route() {
+    if (_running.load()) {
+        throw runtime_error("Router::route: the worker threads are forwarding");
+    }
     // Go through all the interfaces, and route every incoming datagram to its proper outgoing interface.
     for (auto &interface : _interfaces) {
         auto &queue = interface.datagrams_out();
+        if (_batch_size > 1) {
+            while (not queue.empty()) {
+                route_batch(queue);
+            }
+            continue;
+        }
         while (not queue.empty()) {
             route_one_datagram(queue.front());
             queue.pop();
         }
     }
 }
+
+void Router::start(const InterfacePoll &poll) {
+    if (_running.exchange(true)) {
+        throw runtime_error("Router::start: already running");
+    }
+    const size_t n = _interfaces.size();
+    _handoff_rings.clear();
+    for (size_t i = 0; i < n * n; i++) {
+        _handoff_rings.push_back(make_unique<SPSCRing<Handoff>>(HANDOFF_RING_CAPACITY));
+    }
+    // 每个 worker 一个缓存；再次启动时沿用，计数也随之累计
+    if (_route_cache_size > 0 && _worker_route_caches.size() != n) {
+        _worker_route_caches.clear();
+        for (size_t i = 0; i < n; i++) {
+            _worker_route_caches.push_back(make_unique<RouteCache>(_route_cache_size));
+        }
+    }
+    _worker_errors.assign(n, nullptr);
+    _worker_routes = vector<atomic<const RouteTable *>>(n);
+    for (size_t i = 0; i < n; i++) {
+        _workers.emplace_back([this, i, poll] { _worker_main(i, poll); });
+    }
+}
+
+Router::~Router() {
+    try {
+        stop();
+    } catch (const exception &e) {
+        cerr << "Exception in router worker thread: " << e.what() << endl;
+    }
+}
+
+void Router::stop() {
+    if (!_running.exchange(false)) {
+        return;
+    }
+    for (auto &worker : _workers) {
+        worker.join();
+    }
+    _workers.clear();
+    _retired_routes.clear();
+
+    // 发出还留在队列里的数据报
+    const size_t n = _interfaces.size();
+    Handoff handoff;
+    for (size_t from = 0; from < n; from++) {
+        for (size_t to = 0; to < n; to++) {
+            while (_handoff_rings[from * n + to]->pop(handoff)) {
+                _interfaces[to].send_datagram(handoff.dgram, Address::from_ipv4_numeric(handoff.next_hop));
+            }
+        }
+    }
+    _handoff_rings.clear();
+
+    for (auto &error : _worker_errors) {
+        if (error) {
+            rethrow_exception(exchange(error, nullptr));
+        }
+    }
+}
+
+void Router::_worker_main(const size_t interface_num, const InterfacePoll &poll) {
+    try {
+        auto &my_interface = _interfaces[interface_num];
+        auto &queue = my_interface.datagrams_out();
+        const size_t n = _interfaces.size();
+        RouteCache *const cache = _worker_route_caches.empty() ? nullptr : _worker_route_caches[interface_num].get();
+
+        const RouteTable *routes = nullptr;
+        uint64_t routes_version = 0;
+
+        vector<InternetDatagram> batch;
+        vector<uint32_t> batch_dst;
+        vector<optional<size_t>> batch_match;
+        Handoff handoff;
+        size_t idle_rounds = 0;
+
+        while (_running.load(memory_order_acquire)) {
+            poll(interface_num, my_interface);
+
+            // 路由表变化后换用新的快照
+            const uint64_t version = _routes_version.load(memory_order_acquire);
+            if (!routes || version != routes_version) {
+                routes = _acquire_routes(interface_num);
+                routes_version = version;
+            }
+
+            bool busy = false;
+
+            // 转发本接口收到的数据报：发往本接口的直接发送，其余的交给出接口的 worker
+            while (!queue.empty()) {
+                batch.clear();
+                while (!queue.empty() && batch.size() < WORKER_BATCH_SIZE) {
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop();
+                }
+                batch_dst.resize(batch.size());
+                batch_match.resize(batch.size());
+                for (size_t i = 0; i < batch.size(); i++) {
+                    batch_dst[i] = batch[i].header().dst;
+                }
+                if (cache) {
+                    cache->lookup(routes->trie, routes_version, batch_dst.data(), batch_match.data(), batch.size());
+                } else {
+                    routes->trie.lookup(batch_dst.data(), batch_match.data(), batch.size());
+                }
+
+                for (size_t i = 0; i < batch.size(); i++) {
+                    if (!batch_match[i].has_value() || batch[i].header().ttl <= 1) {
+                        continue;
+                    }
+                    const auto &path = routes->path(routes->entries[batch_match[i].value()], batch[i]);
+                    if (path.interface_num >= n) {
+                        continue;
+                    }
+                    const uint32_t next_hop = path.address.value_or(batch_dst[i]);
+                    batch[i].decrement_ttl();
+                    if (path.interface_num == interface_num) {
+                        my_interface.send_datagram(batch[i], Address::from_ipv4_numeric(next_hop));
+                        continue;
+                    }
+                    auto &ring = *_handoff_rings[interface_num * n + path.interface_num];
+                    if (!ring.push({std::move(batch[i]), next_hop})) {
+                        _handoff_drops.fetch_add(1, memory_order_relaxed);
+                    }
+                }
+                busy = true;
+            }
+
+            // 发送其他 worker 交过来的数据报
+            for (size_t from = 0; from < n; from++) {
+                if (from == interface_num) {
+                    continue;
+                }
+                auto &ring = *_handoff_rings[from * n + interface_num];
+                while (ring.pop(handoff)) {
+                    my_interface.send_datagram(handoff.dgram, Address::from_ipv4_numeric(handoff.next_hop));
+                    busy = true;
+                }
+            }
+
+            // 空闲时先让出 CPU，持续空闲则逐步加长睡眠时间，避免空转占满 CPU
+            if (busy) {
+                idle_rounds = 0;
+            } else if (++idle_rounds <= WORKER_IDLE_SPINS) {
+                this_thread::yield();
+            } else {
+                const size_t shift = min(idle_rounds - WORKER_IDLE_SPINS - 1, WORKER_MAX_SLEEP_SHIFT);
+                this_thread::sleep_for(chrono::microseconds(1 << shift));
+            }
+        }
+    } catch (...) {
+        // 异常不能离开线程（否则 std::terminate），留给 stop() 重新抛出；这个 worker 就此停止
+        _worker_errors[interface_num] = current_exception();
+    }
+    _worker_routes[interface_num].store(nullptr);
+}
@@ -3,11 +3,25 @@
 
 #include "network_interface.hh"
 #include "address.hh"
+#include "prefix_trie.hh"
+#include "route_cache.hh"
+#include "spsc_ring.hh"
 
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
 #include <optional>
 #include <queue>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 //! \brief A wrapper for NetworkInterface that makes the host-side
@@ -22,7 +36,7 @@ class AsyncNetworkInterface : public NetworkInterface {
     using NetworkInterface::NetworkInterface;
 
     //! Construct from a NetworkInterface
-    AsyncNetworkInterface(NetworkInterface &&interface) : NetworkInterface(interface) {}
+    AsyncNetworkInterface(NetworkInterface &&interface) : NetworkInterface(std::move(interface)) {}
 
     //! \brief Receives and Ethernet frame and responds appropriately.
 
@@ -42,42 +56,269 @@ class AsyncNetworkInterface : public NetworkInterface {
     std::queue<InternetDatagram> &datagrams_out() { return _datagrams_out; }
 };
 
+//! \brief One of a route's paths: the interface to send datagrams out on, and the next hop
+struct RoutePath {
+    //! The IP address of the next hop, or empty if the network is directly attached to the router
+    std::optional<Address> next_hop{};
+    size_t interface_num = 0;
+};
+
+//! \brief A list of route changes that Router::update_routes() makes take effect together
+//! \details Changes apply in the order they were added to the list. A route is identified by its
+//! prefix and length (bits past the length are ignored).
+class RouteUpdate {
+  public:
+    //! One change to the route table
+    struct Change {
+        enum class Kind { Add, Replace, Withdraw };
+        Kind kind;
+        uint32_t route_prefix;
+        uint8_t prefix_length;
+        std::vector<RoutePath> paths;  //!< empty for Withdraw
+    };
+
+  private:
+    std::vector<Change> _changes{};
+
+  public:
+    //! \brief Add a route, unless there already is one for the prefix (like Router::add_route)
+    void add(const uint32_t route_prefix,
+             const uint8_t prefix_length,
+             const std::optional<Address> next_hop,
+             const size_t interface_num) {
+        add(route_prefix, prefix_length, {{next_hop, interface_num}});
+    }
+
+    //! \brief Add a route with several equal-cost paths (see Router::add_route)
+    void add(const uint32_t route_prefix, const uint8_t prefix_length, const std::vector<RoutePath> &paths) {
+        _changes.push_back({Change::Kind::Add, route_prefix, prefix_length, paths});
+    }
+
+    //! \brief Add a route, or change the next hop and interface of the existing route for the prefix
+    void replace(const uint32_t route_prefix,
+                 const uint8_t prefix_length,
+                 const std::optional<Address> next_hop,
+                 const size_t interface_num) {
+        replace(route_prefix, prefix_length, {{next_hop, interface_num}});
+    }
+
+    //! \brief Add a route, or change the paths of the existing route for the prefix
+    void replace(const uint32_t route_prefix, const uint8_t prefix_length, const std::vector<RoutePath> &paths) {
+        _changes.push_back({Change::Kind::Replace, route_prefix, prefix_length, paths});
+    }
+
+    //! \brief Remove the route for a prefix, if there is one
+    void withdraw(const uint32_t route_prefix, const uint8_t prefix_length) {
+        _changes.push_back({Change::Kind::Withdraw, route_prefix, prefix_length, {}});
+    }
+
+    //! \brief The changes, in order
+    const std::vector<Change> &changes() const { return _changes; }
+
+    //! \brief Number of changes
+    size_t size() const { return _changes.size(); }
+
+    //! \brief Forget all the changes
+    void clear() { _changes.clear(); }
+};
+
 //! \brief A router that has multiple network interfaces and
 //! performs longest-prefix-match routing between them.
 class Router {
     //! The router's collection of network interfaces
     std::vector<AsyncNetworkInterface> _interfaces{};
 
-    //! 路由表条目
+    //! 路由的一条路径：出接口和下一跳（保存为数值形式的 IPv4 地址；直连网络时为空）
+    struct NextHop {
+        std::optional<uint32_t> address{};
+        size_t interface_num = 0;
+
+        bool operator<(const NextHop &other) const {
+            return std::tie(address, interface_num) < std::tie(other.address, other.interface_num);
+        }
+    };
+
+    //! 路由表条目。路径不直接存放在条目里，而是引用一个下一跳组：大量路由共用少数几组路径，
+    //! 这样条目保持小巧，复制路由表也便宜
     struct RouteEntry {
-        uint32_t route_prefix;
-        uint8_t prefix_length;
-        std::optional<Address> next_hop;
-        size_t interface_num;
-
-        RouteEntry() = default;
-        RouteEntry(const uint32_t _route_prefix, const uint8_t _prefix_length, \
-        const std::optional<Address> &_next_hop, const size_t _interface_num) :
-            route_prefix(_route_prefix),
-            prefix_length(_prefix_length),
-            next_hop(_next_hop),
-            interface_num(_interface_num)
-            {}
+        uint32_t route_prefix = 0;
+        uint8_t prefix_length = 0;
+        uint32_t group = 0;
     };
 
-    //! 路由表
-    std::vector<RouteEntry> _route_table{};
+    //! 路由表，以及最长前缀匹配用的多级 trie（保存的是路由表条目的下标，查找开销与路由表大小无关）。
+    //! 撤销的路由留在 entries 里，但 trie 中不再有指向它的下标，它的位置会被之后添加的路由复用
+    struct RouteTable {
+        std::vector<RouteEntry> entries{};
+        //! 下一跳组，每组是一条路由的等价路径；没有路由引用的组被清空，它的下标留给之后新建的组
+        std::vector<std::vector<NextHop>> groups{};
+        PrefixTrie trie{};
+
+        //! 为数据报选择路由的一条路径。有多条路径时按五元组的哈希选择（ECMP），
+        //! 同一个流的数据报总是走同一条路径，不同的流分散到各条路径上
+        const NextHop &path(const RouteEntry &entry, const InternetDatagram &dgram) const;
+    };
+
+    //! 对路由表的一次修改，已经确定了条目和下一跳组的下标，所以可以在另一份相同的路由表上原样重放
+    struct TableChange {
+        enum class Kind { Insert, Update, Erase, AddGroup, RemoveGroup };
+        Kind kind;
+        size_t index;
+        RouteEntry entry;
+        //! 删除时接管其地址的、覆盖它的最长前缀的下标
+        std::optional<size_t> fallback;
+        //! 新的下一跳组
+        std::vector<NextHop> group;
+    };
+
+    //! 当前的路由表。并行转发时它是只读的快照：update_routes 在另一份路由表上修改好后，把原子指针
+    //! _routes 换成指向它，worker 线程发现版本号变化后换用新快照（类似 RCU）。
+    //! 每次修改路由表都会增加版本号，它也是路由缓存的代数
+    std::unique_ptr<RouteTable> _current_routes{std::make_unique<RouteTable>()};
+    std::atomic<const RouteTable *> _routes{_current_routes.get()};
+    std::atomic<uint64_t> _routes_version{0};
+
+    //! 每个 worker 正在使用的快照（hazard pointer）。被替换下来的快照要等没有 worker 声明使用它之后才能复用或释放
+    std::vector<std::atomic<const RouteTable *>> _worker_routes{};
+
+    //! 上一次被替换下来的快照，以及之后对路由表的修改。没有 worker 再使用它时，
+    //! 重放这些修改就能把它变成当前的路由表，下一次更新因此不必复制整个路由表
+    std::unique_ptr<RouteTable> _spare_routes{};
+    std::vector<TableChange> _spare_changes{};
+
+    //! 更早被替换下来、还有 worker 在使用的快照，没有 worker 使用后释放
+    std::vector<std::unique_ptr<RouteTable>> _retired_routes{};
+
+    //! 有没有 worker 正在使用这份快照
+    bool _routes_in_use(const RouteTable *routes) const;
+
+    //! worker 取得当前的快照，并声明自己正在使用它
+    const RouteTable *_acquire_routes(const size_t interface_num);
+
+    //! 修改路由表的一方记录的一条路由：条目下标和它使用的下一跳组
+    struct IndexedRoute {
+        size_t entry = 0;
+        uint32_t group = 0;
+    };
+
+    //! 只有修改路由表的一方使用：(前缀 << 8 | 长度) 到路由的映射，以及空闲的条目下标
+    std::unordered_map<uint64_t, IndexedRoute> _route_index{};
+    std::vector<size_t> _free_entries{};
+
+    using GroupIndex = std::map<std::vector<NextHop>, uint32_t>;
+
+    //! 下一跳组在 _group_index 中的位置，以及引用它的路由数
+    struct GroupUse {
+        GroupIndex::iterator it{};
+        size_t refs = 0;
+    };
+
+    //! 只有修改路由表的一方使用：下一跳组到其下标的映射，每组的引用计数，以及空闲的组下标
+    GroupIndex _group_index{};
+    std::vector<GroupUse> _group_uses{};
+    std::vector<uint32_t> _free_groups{};
+
+    //! 把一条路由变化落实为对路由表的修改（更新 _route_index、_free_entries 和下一跳组的引用计数）
+    void _resolve(const RouteUpdate::Change &change, std::vector<TableChange> &out);
+
+    //! 为一条路由找到（或新建）这些路径的下一跳组，并增加其引用计数
+    uint32_t _acquire_group(std::vector<NextHop> &&group, std::vector<TableChange> &out);
+
+    //! 减少下一跳组的引用计数，不再有路由使用时回收它
+    void _release_group(const uint32_t group, std::vector<TableChange> &out);
+
+    //! 在路由表上执行一次修改
+    static void _apply(RouteTable &table, const TableChange &change);
 
     //! Send a single datagram from the appropriate outbound interface to the next hop,
     //! as specified by the route with the longest prefix_length that matches the
     //! datagram's destination address.
     void route_one_datagram(InternetDatagram &dgram);
 
+    //! 批量转发时每次从一个接口取出的数据报个数上限，为 1 时逐个转发
+    size_t _batch_size = 1;
+
+    //! 目的地址缓存的槽数，为 0 时不使用缓存
+    size_t _route_cache_size = 0;
+
+    //! route() 使用的目的地址缓存，以及每个 worker 线程各自的缓存
+    std::unique_ptr<RouteCache> _route_cache{};
+    std::vector<std::unique_ptr<RouteCache>> _worker_route_caches{};
+
+    //! 批量转发用的缓冲区（作为成员复用，避免每批重新分配）
+    std::vector<InternetDatagram> _batch{};
+    std::vector<InternetDatagram> _batch_grouped{};
+    std::vector<uint32_t> _batch_dst{};
+    std::vector<std::optional<size_t>> _batch_match{};
+    std::vector<std::pair<uint64_t, size_t>> _batch_order{};
+
+    //! 从队列中取出至多 _batch_size 个数据报，一起查路由表，再按出接口和下一跳分组发送
+    void route_batch(std::queue<InternetDatagram> &queue);
+
+  public:
+    //! \brief Exchanges frames between an interface and the outside world during parallel forwarding
+    //! \details Called over and over on the interface's worker thread with the interface's index and
+    //! the interface, e.g. to read frames from a device and pass them to recv_frame(), and to write
+    //! out the interface's frames_out().
+    using InterfacePoll = std::function<void(size_t, AsyncNetworkInterface &)>;
+
+  private:
+    //! 并行转发时交给另一个接口的 worker 发送的数据报，及其下一跳
+    struct Handoff {
+        InternetDatagram dgram{};
+        uint32_t next_hop = 0;
+    };
+
+    //! 每个 worker 线程每次最多从自己的接口取出的数据报个数
+    static constexpr size_t WORKER_BATCH_SIZE = 32;
+
+    //! 每对接口之间的环形队列容量
+    static constexpr size_t HANDOFF_RING_CAPACITY = 1024;
+
+    //! worker 连续空闲这么多轮之后开始睡眠，睡眠时间从 1 微秒起每轮加倍，最多 2^WORKER_MAX_SLEEP_SHIFT 微秒
+    static constexpr size_t WORKER_IDLE_SPINS = 64;
+    static constexpr size_t WORKER_MAX_SLEEP_SHIFT = 8;
+
+    //! 每个接口一个 worker 线程
+    std::vector<std::thread> _workers{};
+
+    //! 每个 worker 抛出的异常。抛出异常的 worker 随即退出，异常在 stop() 中重新抛出
+    std::vector<std::exception_ptr> _worker_errors{};
+
+    //! 接口之间传递数据报的单生产者单消费者队列，_handoff_rings[from * 接口数 + to]
+    std::vector<std::unique_ptr<SPSCRing<Handoff>>> _handoff_rings{};
+
+    std::atomic<bool> _running{false};
+
+    //! 因为队列满而丢弃的数据报数
+    std::atomic<uint64_t> _handoff_drops{0};
+
+    //! worker 线程的主循环
+    void _worker_main(const size_t interface_num, const InterfacePoll &poll);
+
   public:
+    Router() = default;
+
+    //! Stops the worker threads, if they are running
+    ~Router();
+
+    //! \name
+    //! The worker threads refer to the router, so it cannot be moved or copied
+
+    //!@{
+    Router(const Router &) = delete;
+    Router(Router &&) = delete;
+    Router &operator=(const Router &) = delete;
+    Router &operator=(Router &&) = delete;
+    //!@}
+
     //! Add an interface to the router
     //! \param[in] interface an already-constructed network interface
     //! \returns The index of the interface after it has been added to the router
     size_t add_interface(AsyncNetworkInterface &&interface) {
+        if (_running.load()) {
+            throw std::runtime_error("Router::add_interface: the worker threads are forwarding");
+        }
         _interfaces.push_back(std::move(interface));
         return _interfaces.size() - 1;
     }
@@ -86,13 +327,77 @@ class Router {
     AsyncNetworkInterface &interface(const size_t N) { return _interfaces.at(N); }
 
     //! Add a route (a forwarding rule)
+    //! \note May be called while the workers are running; see update_routes().
     void add_route(const uint32_t route_prefix,
                    const uint8_t prefix_length,
                    const std::optional<Address> next_hop,
                    const size_t interface_num);
 
+    //! \brief Add a route with several equal-cost paths
+    //! \details Each datagram takes one of the paths, chosen by a hash of its source and destination
+    //! addresses, protocol, and (for TCP and UDP) ports, so all the datagrams of a flow take the same
+    //! path while different flows spread over all of them.
+    //! \note May be called while the workers are running; see update_routes().
+    void add_route(const uint32_t route_prefix, const uint8_t prefix_length, const std::vector<RoutePath> &paths);
+
+    //! \brief Apply a list of route changes, all at once
+    //! \details May be called while the workers are running (from one thread at a time). The changes are
+    //! made to a second copy of the table, which then atomically replaces the one the workers read, so
+    //! forwarding never pauses and never sees half of an update. The replaced copy is reclaimed once no
+    //! worker uses it any more; usually it becomes the second copy for the next update, so an update costs
+    //! time in proportion to the number of changes rather than to the size of the table. Group changes that
+    //! arrive together (e.g. a burst of BGP updates) into one call.
+    void update_routes(const RouteUpdate &update);
+
+    //! \brief Remove the route for a prefix, if there is one
+    //! \note May be called while the workers are running; see update_routes().
+    void withdraw_route(const uint32_t route_prefix, const uint8_t prefix_length);
+
+    //! \brief The number of distinct sets of paths in use (routes with the same paths share one)
+    size_t next_hop_groups() const { return _group_index.size(); }
+
     //! Route packets between the interfaces
     void route();
+
+    //! \brief Forward up to `batch_size` datagrams from each interface at a time
+    //! \details The batch's routes are looked up together, and its datagrams are sent grouped by
+    //! outbound interface and next hop. Datagrams to the same next hop keep their order, but
+    //! datagrams to different next hops may leave in a different order than they arrived.
+    //! A batch size of 1 (the default) forwards one datagram at a time.
+    void set_batch_size(const size_t batch_size) { _batch_size = std::max<size_t>(batch_size, 1); }
+
+    //! \brief Cache the routes of recently seen destination addresses
+    //! \details A direct-mapped cache (see RouteCache) answers most lookups in one memory access when
+    //! traffic goes to a limited set of destinations. Any change to the routes invalidates it. route()
+    //! and each worker thread have their own cache of this size. Setting the size resets the counters.
+    //! \param[in] slots the number of cached destinations (rounded up to a power of two), or 0 (the default)
+    //! for no cache
+    void set_route_cache_size(const size_t slots);
+
+    //! \brief Route lookups answered by the destination cache, over route() and all the worker threads
+    uint64_t route_cache_hits() const;
+
+    //! \brief Route lookups that missed the destination cache (and went to the full table)
+    uint64_t route_cache_misses() const;
+
+    //! \brief Forward in parallel, with one worker thread per interface, until stop() is called
+    //! \details Each worker owns its interface: it runs `poll` to exchange frames with the outside, routes
+    //! the datagrams the interface received, and sends the datagrams that other workers routed to it.
+    //! Datagrams cross between workers through lock-free single-producer, single-consumer rings, one for
+    //! each ordered pair of interfaces. While the workers run, only `poll` may touch the interfaces, and
+    //! route() must not be called.
+    void start(const InterfacePoll &poll);
+
+    //! \brief Stop the worker threads and send any datagrams still waiting in the rings
+    //! \details A worker that throws (e.g. from `poll`) stops on its own, while the others keep forwarding;
+    //! stop() then rethrows the first such exception, after all the workers have been joined.
+    void stop();
+
+    //! \brief Are the worker threads running?
+    bool running() const { return _running.load(); }
+
+    //! \brief Datagrams dropped because the ring to the outbound interface's worker was full
+    uint64_t handoff_drops() const { return _handoff_drops.load(); }
 };
 
 #endif  // SPONGE_LIBSPONGE_ROUTER_HH
@@ -13,7 +13,7 @@ void DUMMY_CODE(Targs &&... /* unused */) {}
 using namespace std;
 
 StreamReassembler::StreamReassembler(const size_t capacity) : _output(capacity), _capacity(capacity), 
-                                                              _stream(capacity), _cur_index(0),
+                                                              _cur_index(0),
                                                               _eof_index(numeric_limits<uint64_t>::max()), 
                                                               _unassembled_bytes_cnt(0) {}
 
@@ -21,31 +21,103 @@ StreamReassembler::StreamReassembler(const size_t capacity) : _output(capacity),
 //! possibly out-of-order, from the logical stream, and assembles any newly
 //! contiguous substrings and writes them into the output stream in order.
 void StreamReassembler::push_substring(const string &data, const size_t index, const bool eof) {
-    auto st = max(index, _cur_index);
-    auto ed = min(index + data.size(), min(_cur_index + _capacity - _output.buffer_size(), _eof_index));
-    if (eof) {
-        if (_eof_index == numeric_limits<uint64_t>::max()) _eof_index = index + data.size();
-        else if (_eof_index != index + data.size())
-            throw runtime_error("StreamReassembler::push_substring: Inconsistent EOF indexes!");
+    _set_eof(index + data.size(), eof);
+    // Trim to the window before copying, so bytes that would be discarded are never copied
+    const uint64_t st = max(index, _cur_index);
+    const uint64_t ed = min(index + data.size(), _window_end());
+    if (st < ed) _push_slice(Buffer(data.substr(st - index, ed - st)), st);
+    if (_cur_index == _eof_index) _output.end_input();
+}
+
+void StreamReassembler::push_substring(const Buffer &data, const size_t index, const bool eof) {
+    _set_eof(index + data.size(), eof);
+    const uint64_t st = max(index, _cur_index);
+    const uint64_t ed = min(index + data.size(), _window_end());
+    if (st < ed) {
+        Buffer slice = data;
+        slice.remove_prefix(st - index);
+        slice.remove_suffix(index + data.size() - ed);
+        _push_slice(std::move(slice), st);
     }
-    for (size_t i = st, j = st - index; i < ed; ++i, ++j) {
-        auto &t = _stream[i % _capacity];
-        if (t.second == true) {
-            if (t.first != data[j])
-                throw runtime_error("StreamReassembler::push_substring: Inconsistent substrings!");
-        } else {
-            t = make_pair(data[j], true);
-            ++_unassembled_bytes_cnt;
+    if (_cur_index == _eof_index) _output.end_input();
+}
+
+void StreamReassembler::_set_eof(const uint64_t end, const bool eof) {
+    if (!eof) return;
+    if (_eof_index == numeric_limits<uint64_t>::max()) _eof_index = end;
+    else if (_eof_index != end)
+        throw runtime_error("StreamReassembler::push_substring: Inconsistent EOF indexes!");
+}
+
+void StreamReassembler::_push_slice(Buffer &&slice, const uint64_t index) {
+    if (index == _cur_index && _pending.empty()) {
+        // In-order substring with nothing pending: hand it straight to the output stream
+        _cur_index += slice.size();
+        _output.write(std::move(slice));
+    } else {
+        _insert_pending(slice, index);
+        _flush_pending();
+    }
+}
+
+//! \details Only the gaps between already-stored substrings are inserted, as slices that
+//! share the storage of `data`, so the stored intervals never overlap. A slice much smaller
+//! than that storage is copied instead, so it doesn't pin the rest of a large segment in memory
+//! while it waits. Bytes that are already stored must agree with `data`.
+void StreamReassembler::_insert_pending(const Buffer &data, const uint64_t index) {
+    const uint64_t end = index + data.size();
+    uint64_t pos = index;
+
+    // Start from the last stored substring beginning at or before `index`, if it reaches past `index`
+    auto it = _pending.upper_bound(pos);
+    if (it != _pending.begin()) {
+        auto prev = std::prev(it);
+        if (prev->first + prev->second.size() > pos) it = prev;
+    }
+
+    while (pos < end) {
+        const uint64_t gap_end = (it == _pending.end()) ? end : min(it->first, end);
+        if (pos < gap_end) {
+            Buffer slice = data;
+            slice.remove_prefix(pos - index);
+            slice.remove_suffix(end - gap_end);
+            if (slice.size() * COMPACT_RATIO < slice.storage_size()) slice = Buffer(slice.copy());
+            _pending.emplace_hint(it, pos, std::move(slice));
+            _unassembled_bytes_cnt += gap_end - pos;
+            pos = gap_end;
         }
+        if (pos == end) break;
+
+        // [pos, overlap_end) is already stored in `it`
+        const uint64_t overlap_end = min(it->first + it->second.size(), end);
+        if (data.str().substr(pos - index, overlap_end - pos) !=
+            it->second.str().substr(pos - it->first, overlap_end - pos))
+            throw runtime_error("StreamReassembler::push_substring: Inconsistent substrings!");
+        pos = overlap_end;
+        ++it;
+    }
+}
+
+void StreamReassembler::_flush_pending() {
+    while (!_pending.empty() && _pending.begin()->first == _cur_index && _cur_index < _eof_index) {
+        const auto &buf = _pending.begin()->second;
+        _output.write(buf);
+        _cur_index += buf.size();
+        _unassembled_bytes_cnt -= buf.size();
+        _pending.erase(_pending.begin());
     }
-    string str;
-    while (_cur_index < _eof_index && _stream[_cur_index % _capacity].second == true) {
-        str.push_back(_stream[_cur_index % _capacity].first);
-        _stream[_cur_index % _capacity] = { 0, false };
-        --_unassembled_bytes_cnt, ++_cur_index;
+}
+
+vector<pair<uint64_t, uint64_t>> StreamReassembler::pending_ranges() const {
+    vector<pair<uint64_t, uint64_t>> ranges;
+    for (const auto &[index, buf] : _pending) {
+        if (!ranges.empty() && ranges.back().second == index) {
+            ranges.back().second += buf.size();
+        } else {
+            ranges.emplace_back(index, index + buf.size());
+        }
     }
-    _output.write(str);
-    if (_cur_index == _eof_index) _output.end_input();
+    return ranges;
 }
 
 size_t StreamReassembler::unassembled_bytes() const { return _unassembled_bytes_cnt; }
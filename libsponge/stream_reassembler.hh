@@ -9,6 +9,7 @@
 #include <utility>
 #include <limits>
 #include <algorithm>
+#include <map>
 #include <stdexcept>
 #include <vector>
 
@@ -20,11 +21,29 @@ class StreamReassembler {
 
     ByteStream _output;  //!< The reassembled in-order byte stream
     size_t _capacity;    //!< The maximum number of bytes
-    std::vector<std::pair<char, bool> > _stream; //!< The current part of the unreassembled byte stream
+    std::map<uint64_t, Buffer> _pending{};  //!< Non-overlapping unreassembled substrings, keyed by stream index
     uint64_t _cur_index;   //!< The index of the first byte of the unreassembled byte stream
     uint64_t _eof_index;         //!< The index of the last byte of the entire stream
     size_t _unassembled_bytes_cnt; //!< The number of bytes that have not yet been reassembled
 
+    //! A stored slice smaller than 1/COMPACT_RATIO of its buffer is copied, so it doesn't keep the rest alive
+    static constexpr size_t COMPACT_RATIO = 4;
+
+    //! The stream index just past the last byte that fits in the window
+    uint64_t _window_end() const { return std::min(_cur_index + _capacity - _output.buffer_size(), _eof_index); }
+
+    //! Record the end of the stream if `eof` is set, checking it against an earlier one
+    void _set_eof(const uint64_t end, const bool eof);
+
+    //! Write or store `slice`, which starts at stream index `index` and lies within the window
+    void _push_slice(Buffer &&slice, const uint64_t index);
+
+    //! Store the parts of `data` (starting at stream index `index`) not already covered by `_pending`
+    void _insert_pending(const Buffer &data, const uint64_t index);
+
+    //! Write the pending substrings that have become contiguous with the output stream
+    void _flush_pending();
+
   public:
     //! \brief Construct a `StreamReassembler` that will store up to `capacity` bytes.
     //! \note This capacity limits both the bytes that have been reassembled,
@@ -41,6 +60,13 @@ class StreamReassembler {
     //! \param eof the last byte of `data` will be the last byte in the entire stream
     void push_substring(const std::string &data, const uint64_t index, const bool eof);
 
+    //! \brief Receive a substring held in a Buffer; the accepted bytes are stored
+    //! and written into the stream as slices of `data`, without copying.
+    //! \param data the substring
+    //! \param index indicates the index (place in sequence) of the first byte in `data`
+    //! \param eof the last byte of `data` will be the last byte in the entire stream
+    void push_substring(const Buffer &data, const uint64_t index, const bool eof);
+
     //! \name Access the reassembled byte stream
     //!@{
     const ByteStream &stream_out() const { return _output; }
@@ -53,6 +79,10 @@ class StreamReassembler {
     //! should only be counted once for the purpose of this function.
     size_t unassembled_bytes() const;
 
+    //! \brief The stream-index ranges [first, second) held but not yet reassembled, in increasing order
+    //! \note Adjacent stored substrings are reported as one range.
+    std::vector<std::pair<uint64_t, uint64_t>> pending_ranges() const;
+
     //! \brief Is the internal state empty (other than the output stream)?
     //! \returns `true` if no substrings are waiting to be assembled
     bool empty() const;
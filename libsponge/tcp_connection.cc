@@ -1,6 +1,8 @@
 #include "tcp_connection.hh"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 // Dummy implementation of a TCP connection
 
@@ -12,17 +14,33 @@ void DUMMY_CODE(Targs &&... /* unused */) {}
 
 using namespace std;
 
+//! 能让 capacity 右移后放进 16 位窗口字段的最小位移
+static uint8_t window_shift_for(const size_t capacity) {
+    uint8_t shift = 0;
+    while (shift < TCPConfig::MAX_WINDOW_SCALE && (capacity >> shift) > numeric_limits<uint16_t>::max()) {
+        shift++;
+    }
+    return shift;
+}
+
 size_t TCPConnection::remaining_outbound_capacity() const { return _sender.stream_in().remaining_capacity(); }
 
 size_t TCPConnection::bytes_in_flight() const { return _sender.bytes_in_flight(); }
 
 size_t TCPConnection::unassembled_bytes() const { return _receiver.unassembled_bytes(); }
 
-size_t TCPConnection::time_since_last_segment_received() const { return _time_since_last_segment_received; }
+size_t TCPConnection::time_since_last_segment_received() const {
+    if (_timer_wheel) return _timer_wheel->now() - _last_segment_received_ms;
+    return _time_since_last_segment_received;
+}
 
 void TCPConnection::segment_received(const TCPSegment &seg) {
     // 计时清零
-    _time_since_last_segment_received = 0;
+    if (_timer_wheel) {
+        _last_segment_received_ms = _timer_wheel->now();
+    } else {
+        _time_since_last_segment_received = 0;
+    }
 
     const auto& header =  seg.header();
 
@@ -32,18 +50,44 @@ void TCPConnection::segment_received(const TCPSegment &seg) {
         return;
     }
 
+    // 只有对方的第一个 SYN 参与协商，握手之后重传的 SYN 不能再改变协商结果
+    const bool handshake_syn = header.syn && !_receiver.ackno().has_value();
+
     // 将包交给 TCPReceiver，由于代码足够鲁棒，可以不经过任何过滤
     _receiver.segment_received(seg);
 
+    // 握手时根据对方通告的 MSS 协商每个报文的最大 payload，不能超过对方的 MSS；只对明显无效的值（如 0）设下限
+    if (handshake_syn && header.options.mss.has_value()) {
+        const uint16_t peer_mss = max(header.options.mss.value(), TCPConfig::MIN_PEER_MSS);
+        _sender.set_mss(min(_cfg.mss, peer_mss));
+    }
+
+    // 握手时协商窗口缩放和 SACK
+    if (handshake_syn) {
+        _peer_offered_window_scale = header.options.wscale.has_value();
+        if (_cfg.window_scaling && _peer_offered_window_scale) {
+            _send_window_shift = min(header.options.wscale.value(), TCPConfig::MAX_WINDOW_SCALE);
+            _recv_window_shift = window_shift_for(_cfg.recv_capacity);
+        }
+        _peer_offered_sack = header.options.sack_permitted;
+        _sender.set_sack_enabled(_cfg.sack && _peer_offered_sack);
+    }
+
     // 是否需要发送一个不占序列空间的空 ack 包，因为收到任何占序列空间的 TCP 段都需要 ack，或者 keep-alive 也需要空 ack 包
     bool need_empty_ack = seg.length_in_sequence_space() > 0;
 
     // 如果设置了 ack，交给 TCPSender 处理 ack
     if (header.ack) {
         // 实际上在 ack_received 的时候就已经 fill_window() 了 
-        _sender.ack_received(header.ackno, header.win);
+        // SYN 中的窗口永远不缩放
+        const uint32_t win = header.syn ? header.win : static_cast<uint32_t>(header.win) << _send_window_shift;
+        // 先把 SACK 块交给 TCPSender 的计分板，再处理累计确认
+        for (size_t i = 0; i < header.options.sack_count; i++) {
+            _sender.sack_received(header.options.sack_blocks[i].left, header.options.sack_blocks[i].right);
+        }
+        _sender.ack_received(header.ackno, win, seg.length_in_sequence_space() == 0);
         // 发送了新的数据包，可以顺带 ack，那么可以不必再发空 ack 包了
-        if (need_empty_ack && !_segments_out.empty())
+        if (need_empty_ack && !_sender.segments_out().empty())
             need_empty_ack = false;
     }
 
@@ -81,6 +125,12 @@ void TCPConnection::segment_received(const TCPSegment &seg) {
 
     // 将待发送的包添加上 ackno 和 window_size 发送出去
     _add_ackno_and_window_to_send();
+
+    // Active CLOSE，从最后一次收到报文开始等待，之后进入 CLOSED 状态（自己计时时由 tick() 判断）
+    if (_timer_wheel && _lingering()) {
+        if (_linger_timer.has_value()) _timer_wheel->stop(_linger_timer.value());
+        _linger_timer = _timer_wheel->start(10 * _cfg.rt_timeout, _timer_tag, LINGER_TIMER);
+    }
 }
 
 bool TCPConnection::active() const { return _is_active; }
@@ -92,13 +142,70 @@ size_t TCPConnection::write(const string &data) {
     return ret;
 }
 
+optional<uint64_t> TCPConnection::time_until_deadline() const {
+    if (!active()) return {};
+
+    // 重传定时器
+    optional<uint64_t> deadline = _sender.time_until_timeout();
+
+    // Active CLOSE 的等待时间，从最后一次收到报文开始计算
+    optional<uint64_t> linger{};
+    if (_timer_wheel) {
+        if (_linger_timer.has_value()) linger = _timer_wheel->time_remaining(_linger_timer.value());
+    } else if (_lingering()) {
+        const uint64_t timeout = 10 * _cfg.rt_timeout;
+        linger = _time_since_last_segment_received >= timeout ? 0 : timeout - _time_since_last_segment_received;
+    }
+    if (linger.has_value()) {
+        deadline = min(deadline.value_or(linger.value()), linger.value());
+    }
+    return deadline;
+}
+
+void TCPConnection::set_timer_wheel(shared_ptr<TimerWheel> wheel, const uint64_t tag) {
+    if (_sender.next_seqno_absolute() > 0 || _receiver.ackno().has_value()) {
+        throw runtime_error("TCPConnection::set_timer_wheel() after connecting");
+    }
+    _timer_wheel = move(wheel);
+    _timer_tag = tag;
+    _last_segment_received_ms = _timer_wheel->now();
+    _sender.set_timer_wheel(_timer_wheel, _timer_tag);
+}
+
 //! \param[in] ms_since_last_tick number of milliseconds since the last call to this method
 void TCPConnection::tick(const size_t ms_since_last_tick) {
+    if (_timer_wheel) {
+        throw runtime_error("TCPConnection::tick() on a shared TimerWheel");
+    }
+
     _time_since_last_segment_received += ms_since_last_tick;
 
     // 调用 _sender 的 tick
     _sender.tick(ms_since_last_tick);
+    _after_retransmission_timer();
 
+    // Active CLOSE，判断是否等待时间完成进入 CLOSED 状态
+    if (_lingering() && _time_since_last_segment_received >= 10 * _cfg.rt_timeout) {
+        _is_active = false;
+        _linger_after_streams_finish = false;
+    }
+}
+
+void TCPConnection::timer_expired(const uint64_t cookie) {
+    if (cookie == TCPSender::RETRANSMISSION_TIMER) {
+        _sender.timer_expired();
+        _after_retransmission_timer();
+    } else if (cookie == LINGER_TIMER) {
+        // Active CLOSE，等待时间完成，进入 CLOSED 状态
+        _linger_timer.reset();
+        if (_lingering()) {
+            _is_active = false;
+            _linger_after_streams_finish = false;
+        }
+    }
+}
+
+void TCPConnection::_after_retransmission_timer() {
     // 连续重传次数超过阈值，发送 RST 包
     if (_sender.consecutive_retransmissions() > TCPConfig::MAX_RETX_ATTEMPTS) {
         // 清除本应该重发的包
@@ -108,17 +215,14 @@ void TCPConnection::tick(const size_t ms_since_last_tick) {
         return;
     }
 
-    // 调用 _sender.tick 可能导致有新数据包需要发送
+    // 超时重传的数据包需要发送
     _add_ackno_and_window_to_send();
+}
 
-    // Active CLOSE，判断是否等待时间完成进入 CLOSED 状态
-    if (_linger_after_streams_finish && 
-        TCPState::state_summary(_receiver) == TCPReceiverStateSummary::FIN_RECV &&
-        TCPState::state_summary(_sender) == TCPSenderStateSummary::FIN_ACKED &&
-        _time_since_last_segment_received >= 10 * _cfg.rt_timeout) {
-        _is_active = false;
-        _linger_after_streams_finish = false;
-    }
+bool TCPConnection::_lingering() const {
+    return _linger_after_streams_finish &&
+           TCPState::state_summary(_receiver) == TCPReceiverStateSummary::FIN_RECV &&
+           TCPState::state_summary(_sender) == TCPSenderStateSummary::FIN_ACKED;
 }
 
 void TCPConnection::end_input_stream() { 
@@ -169,7 +273,22 @@ void TCPConnection::_add_ackno_and_window_to_send() {
             seg.header().ack = true;
             seg.header().ackno = _receiver.ackno().value();
         }
-        seg.header().win = min(static_cast<size_t>(numeric_limits<uint16_t>::max()), _receiver.window_size());
+        // SYN 中的窗口不缩放，此后的窗口按协商好的位移缩放
+        const size_t shift = seg.header().syn ? 0 : _recv_window_shift;
+        seg.header().win = min(static_cast<size_t>(numeric_limits<uint16_t>::max()), _receiver.window_size() >> shift);
+        // SYN 中通告我们能接收的 MSS，主动打开或对方也提供了窗口缩放时提供窗口缩放
+        if (seg.header().syn) {
+            seg.header().options.mss = _cfg.mss;
+            if (_cfg.window_scaling && (!_receiver.ackno().has_value() || _peer_offered_window_scale)) {
+                seg.header().options.wscale = window_shift_for(_cfg.recv_capacity);
+            }
+            seg.header().options.sack_permitted = _cfg.sack && (!_receiver.ackno().has_value() || _peer_offered_sack);
+            seg.header().doff = seg.header().doff_with_options();
+        } else if (_sender.sack_enabled()) {
+            // 告诉对方我们收到了哪些乱序的数据
+            _receiver.sack_blocks(seg.header().options);
+            seg.header().doff = seg.header().doff_with_options();
+        }
         _segments_out.emplace(std::move(seg));
     }
 }
\ No newline at end of file
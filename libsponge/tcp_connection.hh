@@ -5,13 +5,24 @@
 #include "tcp_receiver.hh"
 #include "tcp_sender.hh"
 #include "tcp_state.hh"
+#include "timer_wheel.hh"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
 
 //! \brief A complete endpoint of a TCP connection
 class TCPConnection {
   private:
     TCPConfig _cfg;
     TCPReceiver _receiver{_cfg.recv_capacity};
-    TCPSender _sender{_cfg.send_capacity, _cfg.rt_timeout, _cfg.fixed_isn};
+    TCPSender _sender{_cfg.send_capacity,
+                      _cfg.rt_timeout,
+                      _cfg.fixed_isn,
+                      _cfg.congestion_control,
+                      _cfg.adaptive_rto,
+                      _cfg.rto_min,
+                      _cfg.rto_max};
 
     //! outbound queue of segments that the TCPConnection wants sent
     std::queue<TCPSegment> _segments_out{};
@@ -21,18 +32,46 @@ class TCPConnection {
     //! in case the remote TCPConnection doesn't know we've received its whole stream?
     bool _linger_after_streams_finish{true};
 
-    //! Number of milliseconds since the last segment was received
+    //! 与其他连接共享的 TimerWheel（与 _sender 共用），由它的所有者推进，超时时调用 timer_expired()
+    //! 默认为空，此时连接和 _sender 都自己计时，由 tick() 推进
+    std::shared_ptr<TimerWheel> _timer_wheel{};
+    uint64_t _timer_tag = 0;
+
+    //! Number of milliseconds since the last segment was received (without a shared TimerWheel)
     size_t _time_since_last_segment_received = 0;
 
+    //! When the last segment was received, by the clock of the shared _timer_wheel
+    uint64_t _last_segment_received_ms = 0;
+
+    //! 共享 TimerWheel 上，双方的流都结束后（Active CLOSE）等待的定时器，每收到一个报文都重新计时
+    std::optional<TimerWheel::TimerId> _linger_timer{};
+
     //! Is the connection still alive in any way?
     bool _is_active = true;
 
+    //! 窗口缩放（RFC 7323），只有双方的 SYN 都带有该选项时才生效
+    //! 收到的窗口需左移 _send_window_shift 位，通告的窗口需右移 _recv_window_shift 位
+    uint8_t _send_window_shift = 0;
+    uint8_t _recv_window_shift = 0;
+
+    //! 对方的 SYN 是否带有窗口缩放选项，被动打开时据此决定 SYN/ACK 是否回复该选项
+    bool _peer_offered_window_scale = false;
+
+    //! 对方的 SYN 是否带有 SACK-permitted 选项
+    bool _peer_offered_sack = false;
+
     //! 置为 RST 状态，如果 send_rst 为 true，则发送 RST 包
     void _set_rst_state(const bool send_rst);
 
     //! 将待发送的包添加上 ackno 和 window_size 发送出去
     void _add_ackno_and_window_to_send();
 
+    //! 重传定时器可能超时后，检查是否重传次数过多，并发送重传的报文
+    void _after_retransmission_timer();
+
+    //! 是否处于 Active CLOSE 的等待阶段
+    bool _lingering() const;
+
   public:
     //! \name "Input" interface for the writer
     //!@{
@@ -67,6 +106,8 @@ class TCPConnection {
     size_t unassembled_bytes() const;
     //! \brief Number of milliseconds since the last segment was received
     size_t time_since_last_segment_received() const;
+    //! \brief The sender's smoothed round-trip time estimate in milliseconds, if any RTT has been measured
+    std::optional<uint64_t> smoothed_rtt() const { return _sender.smoothed_rtt(); }
     //!< \brief summarize the state of the sender, receiver, and the connection
     TCPState state() const { return {_sender, _receiver, active(), _linger_after_streams_finish}; };
     //!@}
@@ -78,8 +119,27 @@ class TCPConnection {
     void segment_received(const TCPSegment &seg);
 
     //! Called periodically when time elapses
+    //! \note Not for a TCPConnection on a shared TimerWheel; the wheel's owner calls timer_expired() instead.
     void tick(const size_t ms_since_last_tick);
 
+    //! \brief The cookie of the timer for lingering after both streams have finished
+    //! \details The retransmission timer has cookie TCPSender::RETRANSMISSION_TIMER.
+    static constexpr uint64_t LINGER_TIMER = 1;
+
+    //! \brief Run the connection's timers on `wheel`, which others share and its owner advances
+    //! \details When a timer with this `tag` expires, the owner calls timer_expired() with its cookie.
+    //! Call before connecting, and don't call tick(). Timers outlive the connection on the wheel, so
+    //! the owner ignores the tag of a connection it has destroyed.
+    void set_timer_wheel(std::shared_ptr<TimerWheel> wheel, const uint64_t tag);
+
+    //! \brief A timer of the connection, identified by `cookie`, expired on a shared TimerWheel
+    void timer_expired(const uint64_t cookie);
+
+    //! \brief Milliseconds (of tick() time) until tick() next has something to do, i.e. a retransmission
+    //! or the end of lingering after both streams have finished
+    //! \returns empty if nothing is waiting on time, so tick() need not be called until something else happens
+    std::optional<uint64_t> time_until_deadline() const;
+
     //! \brief TCPSegments that the TCPConnection has enqueued for transmission.
     //! \note The owner or operating system will dequeue these and
     //! put each one into the payload of a lower-layer datagram (usually Internet datagrams (IP),
@@ -93,7 +153,9 @@ class TCPConnection {
     //!@}
 
     //! Construct a new connection from a configuration
-    explicit TCPConnection(const TCPConfig &cfg) : _cfg{cfg} {}
+    explicit TCPConnection(const TCPConfig &cfg) : _cfg{cfg} {
+        _sender.set_mss(_cfg.mss);
+    }
 
     //! \name construction and destruction
     //! moving is allowed; copying is disallowed; default construction not possible
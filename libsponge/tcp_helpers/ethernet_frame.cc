@@ -18,7 +18,7 @@ ParseResult EthernetFrame::parse(const Buffer buffer) {
 
 BufferList EthernetFrame::serialize() const {
     BufferList ret;
-    ret.append(_header.serialize());
+    ret.append(Buffer(_header.serialize()));
     ret.append(_payload);
     return ret;
 }
@@ -2,7 +2,9 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include <utility>
+#include <vector>
 
 using namespace std;
 
@@ -19,23 +21,29 @@ using namespace std;
 //! the result that future outgoing segments go to the sender of the SYN segment.
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
 optional<TCPSegment> TCPOverUDPSocketAdapter::read() {
-    auto datagram = _sock.recv();
+    const auto datagram = _sock.recv();
+    return read(datagram.source_address, datagram.payload);
+}
 
+//! \param[in] source is the Address that the UDP datagram came from
+//! \param[in] payload is the UDP datagram's payload
+//! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
+optional<TCPSegment> TCPOverUDPSocketAdapter::read(const Address &source, const string_view payload) {
     // is it for us?
-    if (not listening() and (datagram.source_address != config().destination)) {
+    if (not listening() and (source != config().destination)) {
         return {};
     }
 
     // is the payload a valid TCP segment?
     TCPSegment seg;
-    if (ParseResult::NoError != seg.parse(move(datagram.payload), 0)) {
+    if (ParseResult::NoError != seg.parse(string(payload), 0)) {
         return {};
     }
 
     // should we target this source in all future replies?
     if (listening()) {
         if (seg.header().syn and not seg.header().rst) {
-            config_mutable().destination = datagram.source_address;
+            config_mutable().destination = source;
             set_listening(false);
         } else {
             return {};
@@ -53,5 +61,20 @@ void TCPOverUDPSocketAdapter::write(TCPSegment &seg) {
     _sock.sendto(config().destination, seg.serialize(0));
 }
 
+//! \param[in] segments are the TCP segments to write
+//! \param[in] loop is the EventLoop that sends them, many per system call
+void TCPOverUDPSocketAdapter::write(queue<TCPSegment> &segments, EventLoop &loop) {
+    vector<BufferList> serialized;  // the payloads refer to these
+    serialized.reserve(segments.size());
+    for (; not segments.empty(); segments.pop()) {
+        TCPSegment &seg = segments.front();
+        seg.header().sport = config().source.port();
+        seg.header().dport = config().destination.port();
+        serialized.push_back(seg.serialize(0));
+    }
+    const vector<BufferViewList> payloads(serialized.begin(), serialized.end());
+    loop.send_datagrams(_sock, config().destination, payloads);
+}
+
 //! Specialize LossyFdAdapter to TCPOverUDPSocketAdapter
 template class LossyFdAdapter<TCPOverUDPSocketAdapter>;
@@ -1,6 +1,8 @@
 #ifndef SPONGE_LIBSPONGE_FD_ADAPTER_HH
 #define SPONGE_LIBSPONGE_FD_ADAPTER_HH
 
+#include "address.hh"
+#include "eventloop.hh"
 #include "file_descriptor.hh"
 #include "lossy_fd_adapter.hh"
 #include "socket.hh"
@@ -9,6 +11,8 @@
 #include "tcp_segment.hh"
 
 #include <optional>
+#include <queue>
+#include <string_view>
 #include <utility>
 
 //! \brief Basic functionality for file descriptor adaptors
@@ -22,6 +26,10 @@ class FdAdapterBase {
     FdAdapterConfig &config_mutable() { return _cfg; }
 
   public:
+    //! \brief Can the adapter take its datagrams from an EventLoop's datagram rules (and send through the EventLoop)?
+    //! \details If so, it has `socket()`, `read(source, payload)` and `write(segments, loop)` (see TCPOverUDPSocketAdapter).
+    static constexpr bool DATAGRAM_RULES = false;
+
     //! \brief Set the listening flag
     //! \param[in] l is the new value for the flag
     void set_listening(const bool l) { _listen = l; }
@@ -48,15 +56,27 @@ class TCPOverUDPSocketAdapter : public FdAdapterBase {
     UDPSocket _sock;
 
   public:
+    static constexpr bool DATAGRAM_RULES = true;
+
     //! Construct from a UDPSocket sliced into a FileDescriptor
     explicit TCPOverUDPSocketAdapter(UDPSocket &&sock) : _sock(std::move(sock)) {}
 
     //! Attempts to read and return a TCP segment related to the current connection from a UDP payload
     std::optional<TCPSegment> read();
 
+    //! \brief Attempts to return a TCP segment related to the current connection from a UDP payload that
+    //! was already received (e.g. by an EventLoop datagram rule on socket())
+    std::optional<TCPSegment> read(const Address &source, const std::string_view payload);
+
     //! Writes a TCP segment into a UDP payload
     void write(TCPSegment &seg);
 
+    //! Writes (and pops) each TCP segment in `segments` into a UDP payload, all sent with EventLoop::send_datagrams
+    void write(std::queue<TCPSegment> &segments, EventLoop &loop);
+
+    //! The underlying UDP socket
+    UDPSocket &socket() { return _sock; }
+
     //! Access the underlying UDP socket
     operator UDPSocket &() { return _sock; }
 
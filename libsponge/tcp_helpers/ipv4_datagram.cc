@@ -10,32 +10,70 @@ using namespace std;
 
 ParseResult IPv4Datagram::parse(const Buffer buffer) {
     NetParser p{buffer};
-    _header.parse(p);
+    const ParseResult header_result = _header.parse(p);
     _payload = p.buffer();
+    _wire_header = {};
 
     if (_payload.size() != _header.payload_length()) {
         return ParseResult::PacketTooShort;
     }
 
+    if (header_result == ParseResult::NoError and not p.error()) {
+        // keep the header bytes (sharing the received buffer) for serialize()
+        _wire_header = buffer;
+        _wire_header.remove_suffix(_payload.size());
+        _wire_fields = _header;
+    }
+
     return p.get_error();
 }
 
+void IPv4Datagram::decrement_ttl() {
+    const bool wire_header_current = _wire_header.size() > 0 and _header == _wire_fields;
+    _header.decrement_ttl();
+    if (not wire_header_current) {
+        return;
+    }
+
+    // the received buffer may be shared with other packets, so patch a copy of just the header
+    constexpr size_t TTL_OFFSET = 8;
+    constexpr size_t CKSUM_OFFSET = 10;
+    string header_str = _wire_header.copy();
+    header_str[TTL_OFFSET] = static_cast<char>(_header.ttl);
+    header_str[CKSUM_OFFSET] = static_cast<char>(_header.cksum >> 8);
+    header_str[CKSUM_OFFSET + 1] = static_cast<char>(_header.cksum & 0xff);
+    _wire_header = Buffer(move(header_str));
+    _wire_fields = _header;
+}
+
 BufferList IPv4Datagram::serialize() const {
     if (_payload.size() != _header.payload_length()) {
         throw runtime_error("IPv4Datagram::serialize: payload is wrong size");
     }
 
+    if (_wire_header.size() > 0 and _header == _wire_fields) {
+        BufferList ret;
+        ret.append(_wire_header);
+        ret.append(_payload);
+        return ret;
+    }
+
     IPv4Header header_out = _header;
     header_out.cksum = 0;
-    const string header_zero_checksum = header_out.serialize();
+    string header_str = header_out.serialize();
 
     // calculate checksum -- taken over header only
     InternetChecksum check;
-    check.add(header_zero_checksum);
-    header_out.cksum = check.value();
+    check.add(header_str);
+
+    // patch the checksum into the serialized header rather than serializing it again
+    constexpr size_t CKSUM_OFFSET = 10;
+    const uint16_t cksum = check.value();
+    header_str[CKSUM_OFFSET] = static_cast<char>(cksum >> 8);
+    header_str[CKSUM_OFFSET + 1] = static_cast<char>(cksum & 0xff);
 
     BufferList ret;
-    ret.append(header_out.serialize());
+    ret.append(Buffer(move(header_str)));
     ret.append(_payload);
     return ret;
 }
@@ -10,6 +10,11 @@ class IPv4Datagram {
     IPv4Header _header{};
     BufferList _payload{};
 
+    //! The header as it was received (kept up to date by decrement_ttl()), and the fields it encodes.
+    //! serialize() reuses these bytes as long as nobody has changed the header since.
+    Buffer _wire_header{};
+    IPv4Header _wire_fields{};
+
   public:
     //! \brief Parse the segment from a string
     ParseResult parse(const Buffer buffer);
@@ -17,6 +22,11 @@ class IPv4Datagram {
     //! \brief Serialize the segment to a string
     BufferList serialize() const;
 
+    //! \brief Decrement the TTL when forwarding, patching the checksum in O(1)
+    //! \details If the header is otherwise unchanged since parse(), the received header bytes
+    //! are patched too, so serialize() does not need to rebuild or re-checksum the header.
+    void decrement_ttl();
+
     //! \name Accessors
     //!@{
     const IPv4Header &header() const { return _header; }
@@ -5,6 +5,7 @@
 #include <arpa/inet.h>
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
 
 using namespace std;
 
@@ -130,6 +131,31 @@ uint32_t IPv4Header::pseudo_cksum() const {
     return pcksum;
 }
 
+//! \details The checksum is patched with [RFC 1624](\ref rfc::rfc1624)'s equation 3,
+//! HC' = ~(~HC + ~m + m'), where m is the 16-bit word holding the TTL and protocol.
+//! This is O(1) and gives the same result as recomputing the checksum over the header,
+//! provided `cksum` was correct to begin with (e.g. the header was just parsed).
+void IPv4Header::decrement_ttl() {
+    if (ttl == 0) {
+        throw runtime_error("IPv4Header::decrement_ttl: TTL is already zero");
+    }
+    const uint16_t old_word = (ttl << 8) | proto;
+    ttl--;
+    const uint16_t new_word = (ttl << 8) | proto;
+
+    uint32_t sum = static_cast<uint16_t>(~cksum) + static_cast<uint16_t>(~old_word) + new_word;
+    while (sum > 0xffff) {
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+    cksum = ~sum;
+}
+
+bool IPv4Header::operator==(const IPv4Header &other) const {
+    return ver == other.ver and hlen == other.hlen and tos == other.tos and len == other.len and id == other.id and
+           df == other.df and mf == other.mf and offset == other.offset and ttl == other.ttl and
+           proto == other.proto and cksum == other.cksum and src == other.src and dst == other.dst;
+}
+
 //! \returns A string with the header's contents
 std::string IPv4Header::to_string() const {
     stringstream ss{};
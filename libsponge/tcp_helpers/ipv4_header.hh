@@ -9,6 +9,7 @@ struct IPv4Header {
     static constexpr size_t LENGTH = 20;         //!< [IPv4](\ref rfc::rfc791) header length, not including options
     static constexpr uint8_t DEFAULT_TTL = 128;  //!< A reasonable default TTL value
     static constexpr uint8_t PROTO_TCP = 6;      //!< Protocol number for [tcp](\ref rfc::rfc793)
+    static constexpr uint8_t PROTO_UDP = 17;     //!< Protocol number for [udp](\ref rfc::rfc768)
 
     //! \struct IPv4Header
     //! ~~~{.txt}
@@ -58,6 +59,13 @@ struct IPv4Header {
     //! [pseudo-header's](\ref rfc::rfc793) contribution to the TCP checksum
     uint32_t pseudo_cksum() const;
 
+    //! Decrement the TTL, updating `cksum` incrementally ([RFC 1624](\ref rfc::rfc1624)) rather than recomputing it
+    void decrement_ttl();
+
+    //! Do all the fields (including the checksum) match?
+    bool operator==(const IPv4Header &other) const;
+    bool operator!=(const IPv4Header &other) const { return not(*this == other); }
+
     //! Return a string containing a header in human-readable format
     std::string to_string() const;
 
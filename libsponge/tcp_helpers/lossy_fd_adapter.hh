@@ -7,9 +7,14 @@
 #include "util.hh"
 
 #include <optional>
+#include <queue>
 #include <random>
+#include <string_view>
 #include <utility>
 
+class Address;
+class EventLoop;
+
 //! An adapter class that adds random dropping behavior to an FD adapter
 template <typename AdapterT>
 class LossyFdAdapter {
@@ -30,6 +35,9 @@ class LossyFdAdapter {
     }
 
   public:
+    //! Whether the underlying AdapterT can use EventLoop datagram rules (see FdAdapterBase::DATAGRAM_RULES)
+    static constexpr bool DATAGRAM_RULES = AdapterT::DATAGRAM_RULES;
+
     //! Conversion to a FileDescriptor by returning the underlying AdapterT
     operator const FileDescriptor &() const { return _adapter; }
 
@@ -56,6 +64,36 @@ class LossyFdAdapter {
         return _adapter.write(seg);
     }
 
+    //! \name
+    //! The same, for an AdapterT with DATAGRAM_RULES (templates, so that other adapters need not have them)
+
+    //!@{
+    template <typename A = AdapterT>
+    std::optional<TCPSegment> read(const Address &source, const std::string_view payload) {
+        auto ret = static_cast<A &>(_adapter).read(source, payload);
+        if (_should_drop(false)) {
+            return {};
+        }
+        return ret;
+    }
+
+    template <typename A = AdapterT>
+    void write(std::queue<TCPSegment> &segments, EventLoop &loop) {
+        std::queue<TCPSegment> kept;
+        for (; not segments.empty(); segments.pop()) {
+            if (not _should_drop(true)) {
+                kept.push(std::move(segments.front()));
+            }
+        }
+        static_cast<A &>(_adapter).write(kept, loop);
+    }
+
+    template <typename A = AdapterT>
+    auto &socket() {
+        return static_cast<A &>(_adapter).socket();
+    }
+    //!@}
+
     //! \name
     //! Passthrough functions to the underlying AdapterT instance
 
@@ -15,11 +15,31 @@ class TCPConfig {
     static constexpr size_t MAX_PAYLOAD_SIZE = 1000;   //!< Conservative max payload size for real Internet
     static constexpr uint16_t TIMEOUT_DFLT = 1000;     //!< Default re-transmit timeout is 1 second
     static constexpr unsigned MAX_RETX_ATTEMPTS = 8;   //!< Maximum re-transmit attempts before giving up
+    static constexpr size_t INITIAL_CWND_SEGMENTS = 10;  //!< Initial congestion window, in segments
+    static constexpr uint16_t MIN_PEER_MSS = 48;         //!< Sanity floor for the MSS in a peer's SYN (as in Linux)
+    static constexpr uint32_t RTO_MIN_DFLT = 200;        //!< Default lower bound of the adaptive RTO, in milliseconds
+    static constexpr uint32_t RTO_MAX_DFLT = 60000;      //!< Default upper bound of the adaptive RTO, in milliseconds
+    static constexpr uint8_t MAX_WINDOW_SCALE = 14;      //!< Largest window scale shift allowed by RFC 7323
+    static constexpr size_t LARGE_CAPACITY = 32 * 1024 * 1024;  //!< Capacity for long fat paths (needs window_scaling)
+
+    //! Congestion-control algorithms the TCPSender can use
+    enum class CongestionControlAlgorithm {
+        None,  //!< Limited only by the receiver's window
+        Reno,  //!< Reno slow start and congestion avoidance
+        Cubic  //!< CUBIC window growth
+    };
 
     uint16_t rt_timeout = TIMEOUT_DFLT;       //!< Initial value of the retransmission timeout, in milliseconds
+    bool adaptive_rto = false;                //!< Compute the RTO from measured RTTs (RFC 6298)
+    uint32_t rto_min = RTO_MIN_DFLT;          //!< Lower bound of the adaptive RTO, in milliseconds
+    uint32_t rto_max = RTO_MAX_DFLT;          //!< Upper bound of the adaptive RTO, in milliseconds
     size_t recv_capacity = DEFAULT_CAPACITY;  //!< Receive capacity, in bytes
     size_t send_capacity = DEFAULT_CAPACITY;  //!< Sender capacity, in bytes
+    uint16_t mss = MAX_PAYLOAD_SIZE;          //!< Largest payload to send or to be sent (advertised in the SYN)
+    bool window_scaling = false;              //!< Offer RFC 7323 window scaling, so windows can exceed 64 KiB
+    bool sack = false;                        //!< Offer selective acknowledgments (RFC 2018)
     std::optional<WrappingInt32> fixed_isn{};
+    CongestionControlAlgorithm congestion_control = CongestionControlAlgorithm::None;  //!< Sender congestion control
 };
 
 //! Config for classes derived from FdAdapter
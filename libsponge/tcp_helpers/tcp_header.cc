@@ -1,5 +1,6 @@
 #include "tcp_header.hh"
 
+#include <algorithm>
 #include <sstream>
 
 using namespace std;
@@ -37,13 +38,18 @@ ParseResult TCPHeader::parse(NetParser &p) {
         return ParseResult::HeaderTooShort;
     }
 
-    // skip any options or anything extra in the header
-    p.remove_prefix(doff * 4 - TCPHeader::LENGTH);
+    // parse the options (and skip anything else extra in the header)
+    const size_t options_length = doff * 4 - TCPHeader::LENGTH;
+    const Buffer options_buffer = p.buffer();
+    p.remove_prefix(options_length);
 
     if (p.error()) {
         return p.get_error();
     }
 
+    options = {};
+    options.parse(options_buffer.str().substr(0, options_length));
+
     return ParseResult::NoError;
 }
 
@@ -72,7 +78,9 @@ string TCPHeader::serialize() const {
 
     NetUnparser::u16(ret, uptr);  // urgent pointer
 
-    ret.resize(4 * doff);  // expand header to advertised size
+    options.serialize(ret, 4 * doff - LENGTH);  // options
+
+    ret.resize(4 * doff);  // expand header to advertised size (padding with EOL)
 
     return ret;
 }
@@ -90,6 +98,21 @@ string TCPHeader::to_string() const {
        << "TCP winsize: " << +win << '\n'
        << "TCP cksum: " << +cksum << '\n'
        << "TCP uptr: " << +uptr << '\n';
+    if (options.mss.has_value()) {
+        ss << "TCP MSS: " << +options.mss.value() << '\n';
+    }
+    if (options.wscale.has_value()) {
+        ss << "TCP wscale: " << +options.wscale.value() << '\n';
+    }
+    if (options.sack_permitted) {
+        ss << "TCP SACK permitted\n";
+    }
+    if (options.timestamps) {
+        ss << "TCP timestamps: " << +options.tsval << ' ' << +options.tsecr << '\n';
+    }
+    for (size_t i = 0; i < options.sack_count; i++) {
+        ss << "TCP SACK: " << options.sack_blocks[i].left << '-' << options.sack_blocks[i].right << '\n';
+    }
     return ss.str();
 }
 
@@ -100,6 +123,137 @@ string TCPHeader::summary() const {
     return ss.str();
 }
 
+//! \param[in] data is the option bytes of a TCP header (between the fixed header and the payload)
+void TCPOptions::parse(string_view data) {
+    while (not data.empty()) {
+        const uint8_t kind = data[0];
+        if (kind == KIND_EOL) {
+            return;
+        }
+        if (kind == KIND_NOP) {
+            data.remove_prefix(1);
+            continue;
+        }
+        if (data.size() < 2) {
+            return;
+        }
+        const uint8_t len = data[1];
+        if (len < 2 or len > data.size()) {
+            return;
+        }
+
+        // big-endian integer of `n` bytes at offset `off` within the option
+        auto be = [&](const size_t off, const size_t n) {
+            uint32_t val = 0;
+            for (size_t i = 0; i < n; i++) {
+                val = (val << 8) | uint8_t(data[off + i]);
+            }
+            return val;
+        };
+        switch (kind) {
+            case KIND_MSS:
+                if (len == 4) {
+                    mss = be(2, 2);
+                }
+                break;
+            case KIND_WSCALE:
+                if (len == 3) {
+                    wscale = be(2, 1);
+                }
+                break;
+            case KIND_SACK_PERMITTED:
+                sack_permitted = (len == 2);
+                break;
+            case KIND_SACK:
+                sack_count = 0;
+                for (size_t off = 2; off + 8 <= len and sack_count < MAX_SACK_BLOCKS; off += 8) {
+                    sack_blocks[sack_count++] = {WrappingInt32{be(off, 4)}, WrappingInt32{be(off + 4, 4)}};
+                }
+                break;
+            case KIND_TIMESTAMPS:
+                if (len == 10) {
+                    timestamps = true;
+                    tsval = be(2, 4);
+                    tsecr = be(6, 4);
+                }
+                break;
+            default:
+                break;
+        }
+        data.remove_prefix(len);
+    }
+}
+
+//! \param[in,out] s is the string to append the options to
+//! \param[in] max_length is the space available for options, in bytes
+void TCPOptions::serialize(string &s, const size_t max_length) const {
+    size_t room = max_length;
+    auto fits = [&](const size_t len) {
+        if (len > room) {
+            return false;
+        }
+        room -= len;
+        return true;
+    };
+
+    if (mss.has_value() and fits(4)) {
+        NetUnparser::u8(s, KIND_MSS);
+        NetUnparser::u8(s, 4);
+        NetUnparser::u16(s, mss.value());
+    }
+    if (wscale.has_value() and fits(4)) {
+        NetUnparser::u8(s, KIND_NOP);
+        NetUnparser::u8(s, KIND_WSCALE);
+        NetUnparser::u8(s, 3);
+        NetUnparser::u8(s, wscale.value());
+    }
+    if (sack_permitted and fits(4)) {
+        NetUnparser::u8(s, KIND_NOP);
+        NetUnparser::u8(s, KIND_NOP);
+        NetUnparser::u8(s, KIND_SACK_PERMITTED);
+        NetUnparser::u8(s, 2);
+    }
+    if (timestamps and fits(12)) {
+        NetUnparser::u8(s, KIND_NOP);
+        NetUnparser::u8(s, KIND_NOP);
+        NetUnparser::u8(s, KIND_TIMESTAMPS);
+        NetUnparser::u8(s, 10);
+        NetUnparser::u32(s, tsval);
+        NetUnparser::u32(s, tsecr);
+    }
+    // send as many SACK blocks as there is room for (the first is the most important)
+    const size_t blocks = room < 4 ? 0 : min(sack_count, (room - 4) / 8);
+    if (blocks > 0) {
+        NetUnparser::u8(s, KIND_NOP);
+        NetUnparser::u8(s, KIND_NOP);
+        NetUnparser::u8(s, KIND_SACK);
+        NetUnparser::u8(s, 2 + 8 * blocks);
+        for (size_t i = 0; i < blocks; i++) {
+            NetUnparser::u32(s, sack_blocks[i].left.raw_value());
+            NetUnparser::u32(s, sack_blocks[i].right.raw_value());
+        }
+    }
+}
+
+size_t TCPOptions::length() const {
+    // every option is padded with NOPs to a multiple of 4 bytes
+    const size_t fixed =
+        (mss.has_value() ? 4 : 0) + (wscale.has_value() ? 4 : 0) + (sack_permitted ? 4 : 0) + (timestamps ? 12 : 0);
+    // SACK blocks are sent only as far as the 40 bytes of option space allow
+    const size_t room = MAX_LENGTH > fixed ? MAX_LENGTH - fixed : 0;
+    const size_t blocks = room < 4 ? 0 : min(sack_count, (room - 4) / 8);
+    return fixed + (blocks > 0 ? 4 + 8 * blocks : 0);
+}
+
+bool TCPOptions::operator==(const TCPOptions &other) const {
+    return mss == other.mss && wscale == other.wscale && sack_permitted == other.sack_permitted &&
+           timestamps == other.timestamps && tsval == other.tsval && tsecr == other.tsecr &&
+           sack_count == other.sack_count &&
+           equal(sack_blocks.begin(), sack_blocks.begin() + sack_count, other.sack_blocks.begin(), [](auto &a, auto &b) {
+               return a.left == b.left and a.right == b.right;
+           });
+}
+
 bool TCPHeader::operator==(const TCPHeader &other) const {
     // TODO(aozdemir) more complete check (right now we omit cksum, src, dst
     return seqno == other.seqno && ackno == other.ackno && doff == other.doff && urg == other.urg && ack == other.ack &&
@@ -4,8 +4,57 @@
 #include "parser.hh"
 #include "wrapping_integers.hh"
 
+#include <array>
+#include <optional>
+#include <string_view>
+
+//! \brief The [TCP](\ref rfc::rfc793) options understood by Sponge
+//! \note Fixed-size representation; options of unknown kinds are skipped when parsing.
+struct TCPOptions {
+    //! \name Option kinds
+    //!@{
+    static constexpr uint8_t KIND_EOL = 0;             //!< End of option list
+    static constexpr uint8_t KIND_NOP = 1;             //!< No-operation (padding)
+    static constexpr uint8_t KIND_MSS = 2;             //!< Maximum segment size ([RFC 793](\ref rfc::rfc793))
+    static constexpr uint8_t KIND_WSCALE = 3;          //!< Window scale ([RFC 7323](\ref rfc::rfc7323))
+    static constexpr uint8_t KIND_SACK_PERMITTED = 4;  //!< SACK permitted ([RFC 2018](\ref rfc::rfc2018))
+    static constexpr uint8_t KIND_SACK = 5;            //!< SACK blocks ([RFC 2018](\ref rfc::rfc2018))
+    static constexpr uint8_t KIND_TIMESTAMPS = 8;      //!< Timestamps ([RFC 7323](\ref rfc::rfc7323))
+    //!@}
+
+    static constexpr size_t MAX_LENGTH = 40;      //!< Most option bytes a TCP header can carry
+    static constexpr size_t MAX_SACK_BLOCKS = 4;  //!< Most SACK blocks that fit in the option space
+
+    //! A block of data received out of order, [left, right) in sequence space
+    struct SACKBlock {
+        WrappingInt32 left{0};   //!< first sequence number of the block
+        WrappingInt32 right{0};  //!< sequence number just past the block
+    };
+
+    std::optional<uint16_t> mss{};     //!< maximum segment size the sender of the option can receive
+    std::optional<uint8_t> wscale{};   //!< window scale shift count
+    bool sack_permitted = false;       //!< the sender of the option can receive SACK blocks
+    bool timestamps = false;           //!< whether the timestamps option is present
+    uint32_t tsval = 0;                //!< timestamp value
+    uint32_t tsecr = 0;                //!< timestamp echo reply
+    std::array<SACKBlock, MAX_SACK_BLOCKS> sack_blocks{};  //!< SACK blocks, most recent first
+    size_t sack_count = 0;                                 //!< number of valid entries in `sack_blocks`
+
+    //! Parse the options from the option bytes of a TCP header
+    //! \note Parsing stops silently at a malformed option
+    void parse(std::string_view data);
+
+    //! Serialize as many of the options as fit in `max_length` bytes (not padded)
+    void serialize(std::string &s, const size_t max_length) const;
+
+    //! Length of the serialized options, in bytes, padded to a multiple of 4
+    size_t length() const;
+
+    bool operator==(const TCPOptions &other) const;
+};
+
 //! \brief [TCP](\ref rfc::rfc793) segment header
-//! \note TCP options are not supported
+//! \note Options that do not fit in `4 * doff` bytes are not serialized; use doff_with_options() to size the header.
 struct TCPHeader {
     static constexpr size_t LENGTH = 20;  //!< [TCP](\ref rfc::rfc793) header length, not including options
 
@@ -48,8 +97,12 @@ struct TCPHeader {
     uint16_t win = 0;           //!< window size
     uint16_t cksum = 0;         //!< checksum
     uint16_t uptr = 0;          //!< urgent pointer
+    TCPOptions options{};       //!< options
     //!@}
 
+    //! The smallest data offset that holds all of the header's options
+    uint8_t doff_with_options() const { return (LENGTH + options.length()) / 4; }
+
     //! Parse the TCP fields from the provided NetParser
     ParseResult parse(NetParser &p);
 
@@ -30,16 +30,47 @@ size_t TCPSegment::length_in_sequence_space() const {
 BufferList TCPSegment::serialize(const uint32_t datagram_layer_checksum) const {
     TCPHeader header_out = _header;
     header_out.cksum = 0;
+    string header_str = header_out.serialize();
 
-    // calculate checksum -- taken over entire segment
+    // calculate checksum -- taken over entire segment (the payload's share may be known already)
+    const bool payload_summed =
+        _summed_payload.size() == _payload.size() and _summed_payload.str().data() == _payload.str().data();
     InternetChecksum check(datagram_layer_checksum);
-    check.add(header_out.serialize());
-    check.add(_payload);
-    header_out.cksum = check.value();
+    check.add(header_str);
+    if (payload_summed) {
+        check = InternetChecksum(check.sum() + _payload_sum);
+    } else {
+        check.add(_payload);
+    }
+
+    // patch the checksum into the serialized header rather than serializing it again
+    constexpr size_t CKSUM_OFFSET = 16;
+    const uint16_t cksum = check.value();
+    header_str[CKSUM_OFFSET] = static_cast<char>(cksum >> 8);
+    header_str[CKSUM_OFFSET + 1] = static_cast<char>(cksum & 0xff);
 
     BufferList ret;
-    ret.append(header_out.serialize());
+    ret.append(Buffer(move(header_str)));
     ret.append(_payload);
 
     return ret;
 }
+
+//! \param[in] payload the buffers making up the new payload
+void TCPSegment::set_payload(const BufferList &payload) {
+    InternetChecksum check;
+    if (payload.buffers().size() > 1) {
+        string joined(payload.size(), 0);
+        size_t offset = 0;
+        for (const auto &buf : payload.buffers()) {
+            check.add_and_copy(buf, joined.data() + offset);
+            offset += buf.size();
+        }
+        _payload = Buffer(move(joined));
+    } else {
+        _payload = Buffer(payload);
+        check.add(_payload);
+    }
+    _summed_payload = _payload;
+    _payload_sum = check.sum();
+}
@@ -12,6 +12,11 @@ class TCPSegment {
     TCPHeader _header{};
     Buffer _payload{};
 
+    //! The payload that `_payload_sum` was computed over; holding it keeps its storage alive,
+    //! so a different payload can never be mistaken for it
+    Buffer _summed_payload{};
+    uint32_t _payload_sum = 0;  //!< Partial Internet checksum of `_summed_payload`
+
   public:
     //! \brief Parse the segment from a string
     ParseResult parse(const Buffer buffer, const uint32_t datagram_layer_checksum = 0);
@@ -19,6 +24,11 @@ class TCPSegment {
     //! \brief Serialize the segment to a string
     BufferList serialize(const uint32_t datagram_layer_checksum = 0) const;
 
+    //! \brief Set the payload from a list of buffers, computing its checksum on the way
+    //! (while copying the buffers together, if there is more than one) so that serialize()
+    //! does not need to read the payload again
+    void set_payload(const BufferList &payload);
+
     //! \name Accessors
     //!@{
     const TCPHeader &header() const { return _header; }
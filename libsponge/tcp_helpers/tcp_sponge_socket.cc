@@ -10,6 +10,7 @@
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
@@ -18,25 +19,66 @@
 
 using namespace std;
 
-static constexpr size_t TCP_TICK_MS = 10;
-
 //! \param[in] condition is a function returning true if loop should continue
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::_tcp_loop(const function<bool()> &condition) {
-    auto base_time = timestamp_ms();
     while (condition()) {
-        auto ret = _eventloop.wait_next_event(TCP_TICK_MS);
+        // sleep until something happens, or until the TCPConnection has something to do on a timer
+        _schedule_tick();
+        auto ret = _eventloop.wait_next_event(-1);
         if (ret == EventLoop::Result::Exit or _abort) {
             break;
         }
+    }
+    // the last segments may be waiting for the next wait (with io_uring)
+    _eventloop.flush_datagrams();
+}
 
-        if (_tcp.value().active()) {
-            const auto next_time = timestamp_ms();
-            _tcp.value().tick(next_time - base_time);
-            _datagram_adapter.tick(next_time - base_time);
-            base_time = next_time;
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_tick() {
+    const auto now = timestamp_ms();
+    if (_tcp.value().active()) {
+        _tcp.value().tick(now - _last_tick_ms);
+        _datagram_adapter.tick(now - _last_tick_ms);
+    }
+    _last_tick_ms = now;
+}
+
+template <typename AdaptT>
+void TCPSpongeSocket<AdaptT>::_schedule_tick() {
+    optional<uint64_t> deadline;
+    if (_tcp.value().active()) {
+        const auto time_until_deadline = _tcp.value().time_until_deadline();
+        if (time_until_deadline.has_value()) {
+            deadline = _last_tick_ms + time_until_deadline.value();
         }
     }
+    if (deadline == _tick_deadline) {
+        return;
+    }
+
+    if (_tick_timer.has_value()) {
+        _eventloop.cancel_timer(_tick_timer.value());
+        _tick_timer.reset();
+    }
+    _tick_deadline = deadline;
+    if (deadline.has_value()) {
+        const auto now = timestamp_ms();
+        _tick_timer = _eventloop.add_timer(deadline.value() > now ? deadline.value() - now : 0, [&] {
+            _tick_timer.reset();
+            _tick_deadline.reset();
+            _tick();
+        });
+    }
+}
+
+//! \brief Call [socketpair](\ref man2::socketpair) and return connected Unix-domain sockets of specified type
+//! \param[in] type is the type of AF_UNIX sockets to create (e.g., SOCK_SEQPACKET)
+//! \returns a std::pair of connected sockets
+static inline pair<FileDescriptor, FileDescriptor> socket_pair_helper(const int type) {
+    int fds[2];
+    SystemCall("socketpair", ::socketpair(AF_UNIX, type, 0, static_cast<int *>(fds)));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
 }
 
 //! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
@@ -46,13 +88,15 @@ TCPSpongeSocket<AdaptT>::TCPSpongeSocket(pair<FileDescriptor, FileDescriptor> da
                                          AdaptT &&datagram_interface)
     : LocalStreamSocket(move(data_socket_pair.first))
     , _thread_data(move(data_socket_pair.second))
-    , _datagram_adapter(move(datagram_interface)) {
+    , _datagram_adapter(move(datagram_interface))
+    , _abort_wakeup(socket_pair_helper(SOCK_DGRAM)) {
     _thread_data.set_blocking(false);
 }
 
 template <typename AdaptT>
 void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
     _tcp.emplace(config);
+    _last_tick_ms = timestamp_ms();
 
     // Set up the event loop
 
@@ -71,31 +115,47 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
     //
     // 4) Outbound segment generated by TCP (needs to be
     //    given to underlying datagram socket)
+    //
+    // The TCPConnection is also ticked when its next deadline
+    // comes (see _schedule_tick), and before 1) and 2), so that
+    // it knows what time it is when it handles them.
 
     // rule 1: read from filtered packet stream and dump into TCPConnection
-    _eventloop.add_rule(
-        _datagram_adapter,
-        Direction::In,
-        [&] {
-            auto seg = _datagram_adapter.read();
-            if (seg) {
-                _tcp->segment_received(move(seg.value()));
-            }
+    const auto segment_received = [&](optional<TCPSegment> seg) {
+        _tick();
+        if (seg) {
+            _tcp->segment_received(move(seg.value()));
+        }
 
-            // debugging output:
-            if (_thread_data.eof() and _tcp.value().bytes_in_flight() == 0 and not _fully_acked) {
-                cerr << "DEBUG: Outbound stream to " << _datagram_adapter.config().destination.to_string()
-                     << " has been fully acknowledged.\n";
-                _fully_acked = true;
-            }
-        },
-        [&] { return _tcp->active(); });
+        // debugging output:
+        if (_thread_data.eof() and _tcp.value().bytes_in_flight() == 0 and not _fully_acked) {
+            cerr << "DEBUG: Outbound stream to " << _datagram_adapter.config().destination.to_string()
+                 << " has been fully acknowledged.\n";
+            _fully_acked = true;
+        }
+    };
+    if constexpr (AdaptT::DATAGRAM_RULES) {
+        // (the EventLoop receives the datagrams, many per system call with io_uring)
+        _eventloop.add_datagram_rule(
+            _datagram_adapter.socket(),
+            [this, segment_received](const Address &source, const string_view payload) {
+                segment_received(_datagram_adapter.read(source, payload));
+            },
+            [&] { return _tcp->active(); });
+    } else {
+        _eventloop.add_rule(
+            _datagram_adapter,
+            Direction::In,
+            [this, segment_received] { segment_received(_datagram_adapter.read()); },
+            [&] { return _tcp->active(); });
+    }
 
     // rule 2: read from pipe into outbound buffer
     _eventloop.add_rule(
         _thread_data,
         Direction::In,
         [&] {
+            _tick();
             const auto data = _thread_data.read(_tcp->remaining_outbound_capacity());
             const auto len = data.size();
             const auto amount_written = _tcp->write(move(data));
@@ -129,8 +189,7 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
             // the pipe, handling the possibility of a partial
             // write (i.e., only pop what was actually written).
             const size_t amount_to_write = min(size_t(65536), inbound.buffer_size());
-            const std::string buffer = inbound.peek_output(amount_to_write);
-            const auto bytes_written = _thread_data.write(move(buffer), false);
+            const auto bytes_written = _thread_data.write(inbound.peek_views(amount_to_write), false);
             inbound.pop_output(bytes_written);
 
             if (inbound.eof() or inbound.error()) {
@@ -155,21 +214,21 @@ void TCPSpongeSocket<AdaptT>::_initialize_TCP(const TCPConfig &config) {
         _datagram_adapter,
         Direction::Out,
         [&] {
-            while (not _tcp->segments_out().empty()) {
-                _datagram_adapter.write(_tcp->segments_out().front());
-                _tcp->segments_out().pop();
+            if constexpr (AdaptT::DATAGRAM_RULES) {
+                // (all of them with one system call, or a few)
+                _datagram_adapter.write(_tcp->segments_out(), _eventloop);
+            } else {
+                while (not _tcp->segments_out().empty()) {
+                    _datagram_adapter.write(_tcp->segments_out().front());
+                    _tcp->segments_out().pop();
+                }
             }
         },
         [&] { return not _tcp->segments_out().empty(); });
-}
 
-//! \brief Call [socketpair](\ref man2::socketpair) and return connected Unix-domain sockets of specified type
-//! \param[in] type is the type of AF_UNIX sockets to create (e.g., SOCK_SEQPACKET)
-//! \returns a std::pair of connected sockets
-static inline pair<FileDescriptor, FileDescriptor> socket_pair_helper(const int type) {
-    int fds[2];
-    SystemCall("socketpair", ::socketpair(AF_UNIX, type, 0, static_cast<int *>(fds)));
-    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+    // wake up to see _abort (the loop sleeps until the next event or deadline)
+    _eventloop.add_rule(
+        _abort_wakeup.first, Direction::In, [&] { _abort_wakeup.first.read(); }, [&] { return _tcp->active(); });
 }
 
 //! \param[in] datagram_interface is the underlying interface (e.g. to UDP, IP, or Ethernet)
@@ -184,6 +243,7 @@ TCPSpongeSocket<AdaptT>::~TCPSpongeSocket() {
             cerr << "Warning: unclean shutdown of TCPSpongeSocket\n";
             // force the other side to exit
             _abort.store(true);
+            _abort_wakeup.second.write("!");
             _tcp_thread.join();
         }
     } catch (const exception &e) {
@@ -34,12 +34,29 @@ class TCPSpongeSocket : public LocalStreamSocket {
     //! TCP state machine
     std::optional<TCPConnection> _tcp{};
 
-    //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes)
-    EventLoop _eventloop{};
+    //! eventloop that handles all the events (new inbound datagram, new outbound bytes, new inbound bytes),
+    //! with io_uring if the adapter can use datagram rules and the kernel supports it
+    EventLoop _eventloop{AdaptT::DATAGRAM_RULES and EventLoop::io_uring_supported() ? EventLoop::Backend::IoUring
+                                                                                     : EventLoop::Backend::Poll};
 
     //! Process events while specified condition is true
     void _tcp_loop(const std::function<bool()> &condition);
 
+    //! When the TCPConnection (and the adapter) were last told that time passed, as a timestamp_ms()
+    uint64_t _last_tick_ms{0};
+
+    //! Wakes the event loop when the TCPConnection next has something to do on a timer
+    std::optional<EventLoop::TimerId> _tick_timer{};
+
+    //! When _tick_timer is due, as a timestamp_ms(); empty if it is not armed
+    std::optional<uint64_t> _tick_deadline{};
+
+    //! Tell the TCPConnection (and the adapter) how much time has passed since the last tick
+    void _tick();
+
+    //! Arm _tick_timer for the TCPConnection's next deadline, if that changed
+    void _schedule_tick();
+
     //! Main loop of TCPConnection thread
     void _tcp_main();
 
@@ -51,6 +68,9 @@ class TCPSpongeSocket : public LocalStreamSocket {
 
     std::atomic_bool _abort{false};  //!< Flag used by the owner to force the TCPConnection thread to shut down
 
+    //! The owner writes to the second socket to wake the TCPConnection thread after setting _abort
+    std::pair<FileDescriptor, FileDescriptor> _abort_wakeup;
+
     bool _inbound_shutdown{false};  //!< Has TCPSpongeSocket shut down the incoming data to the owner?
 
     bool _outbound_shutdown{false};  //!< Has the owner shut down the outbound data to the TCP connection?
@@ -1,5 +1,7 @@
 #include "tcp_receiver.hh"
 
+#include <algorithm>
+
 // Dummy implementation of a TCP receiver
 
 // For Lab 2, please replace with a real implementation that passes the
@@ -19,7 +21,8 @@ void TCPReceiver::segment_received(const TCPSegment &seg) {
     uint64_t checkpoint = _reassembler.stream_out().bytes_written();
     uint64_t abs_seq = unwrap(header.seqno, _isn.value(), checkpoint);
     uint64_t stream_index = abs_seq - 1 + (header.syn ? 1 : 0);
-    _reassembler.push_substring(seg.payload().copy(), stream_index, header.fin);
+    if (seg.payload().size() > 0) _last_segment_index = stream_index;
+    _reassembler.push_substring(seg.payload(), stream_index, header.fin);
 }
 
 optional<WrappingInt32> TCPReceiver::ackno() const {
@@ -29,6 +32,26 @@ optional<WrappingInt32> TCPReceiver::ackno() const {
     return wrap(abs_seq, _isn.value());
 }
 
+void TCPReceiver::sack_blocks(TCPOptions &options) const {
+    options.sack_count = 0;
+    if (!_isn.has_value() || _reassembler.empty()) return;
+
+    const auto ranges = _reassembler.pending_ranges();
+    // stream index 转成 seqno 时要跳过 SYN
+    auto add = [&](const pair<uint64_t, uint64_t> &range) {
+        if (options.sack_count == TCPOptions::MAX_SACK_BLOCKS) return;
+        options.sack_blocks[options.sack_count++] = {wrap(range.first + 1, _isn.value()),
+                                                     wrap(range.second + 1, _isn.value())};
+    };
+    auto recent = find_if(ranges.begin(), ranges.end(), [&](const auto &range) {
+        return range.first <= _last_segment_index && _last_segment_index < range.second;
+    });
+    if (recent != ranges.end()) add(*recent);
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        if (it != recent) add(*it);
+    }
+}
+
 size_t TCPReceiver::window_size() const {
     return _capacity - _reassembler.stream_out().buffer_size();
 }
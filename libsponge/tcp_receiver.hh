@@ -24,6 +24,9 @@ class TCPReceiver {
     std::optional<WrappingInt32> _isn;
     // bool _set_syn_flag;
 
+    //! Stream index of the most recent segment that carried data, so the SACK block covering it goes first.
+    uint64_t _last_segment_index = 0;
+
   public:
     //! \brief Construct a TCP receiver
     //!
@@ -52,6 +55,12 @@ class TCPReceiver {
     //! accepted by the receiver) and (b) the sequence number of the
     //! beginning of the window (the ackno).
     size_t window_size() const;
+
+    //! \brief Describe the out-of-order data held by the receiver as SACK blocks
+    //! ([RFC 2018](\ref rfc::rfc2018)): the block holding the most recently received
+    //! segment comes first, followed by the others in increasing order.
+    //! \param[out] options gets up to TCPOptions::MAX_SACK_BLOCKS blocks (none if nothing is held)
+    void sack_blocks(TCPOptions &options) const;
     //!@}
 
     //! \brief number of bytes stored but not yet reassembled
@@ -2,7 +2,11 @@
 
 #include "tcp_config.hh"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <random>
+#include <stdexcept>
 
 // Dummy implementation of a TCP sender
 
@@ -17,17 +21,60 @@ using namespace std;
 //! \param[in] capacity the capacity of the outgoing byte stream
 //! \param[in] retx_timeout the initial amount of time to wait before retransmitting the oldest outstanding segment
 //! \param[in] fixed_isn the Initial Sequence Number to use, if set (otherwise uses a random ISN)
-TCPSender::TCPSender(const size_t capacity, const uint16_t retx_timeout, const std::optional<WrappingInt32> fixed_isn)
+//! \param[in] congestion_control the congestion-control algorithm that limits the bytes in flight
+//! (any algorithm other than None also enables fast retransmit and fast recovery)
+//! \param[in] adaptive_rto whether to compute the retransmission timeout from measured RTTs
+//! \param[in] rto_min the lower bound of the adaptive retransmission timeout
+//! \param[in] rto_max the upper bound of the adaptive retransmission timeout (also bounds the backoff)
+TCPSender::TCPSender(const size_t capacity,
+                     const uint16_t retx_timeout,
+                     const std::optional<WrappingInt32> fixed_isn,
+                     const TCPConfig::CongestionControlAlgorithm congestion_control,
+                     const bool adaptive_rto,
+                     const uint32_t rto_min,
+                     const uint32_t rto_max)
     : _isn(fixed_isn.value_or(WrappingInt32{random_device()()}))
     , _initial_retransmission_timeout{retx_timeout}
     , _stream(capacity)
-    , _timer(retx_timeout) {}
+    , _timer(retx_timeout)
+    , _congestion_control_algorithm(congestion_control)
+    , _congestion_control(make_congestion_control(congestion_control, _mss))
+    , _adaptive_rto(adaptive_rto)
+    , _rto_min(rto_min)
+    , _rto_max(rto_max)
+    , _fast_retransmit(congestion_control != TCPConfig::CongestionControlAlgorithm::None) {}
+
+uint32_t TCPSender::_current_rto() const {
+    if (!_adaptive_rto || !_rtt_estimator.has_sample()) return _initial_retransmission_timeout;
+    return clamp(static_cast<uint32_t>(ceil(_rtt_estimator.rto())), _rto_min, _rto_max);
+}
+
+void TCPSender::set_mss(const size_t mss) {
+    // a segment must carry at least one byte, or fill_window() could never send the stream
+    _mss = max(mss, size_t(1));
+    _congestion_control = make_congestion_control(_congestion_control_algorithm, _mss);
+}
+
+size_t TCPSender::_congestion_window() const {
+    const size_t cwnd = _congestion_control->cwnd();
+    return cwnd > numeric_limits<size_t>::max() - _recovery_inflation ? numeric_limits<size_t>::max()
+                                                                      : cwnd + _recovery_inflation;
+}
+
+optional<uint64_t> TCPSender::smoothed_rtt() const {
+    if (!_rtt_estimator.has_sample()) return nullopt;
+    return static_cast<uint64_t>(llround(_rtt_estimator.srtt()));
+}
 
 size_t TCPSender::bytes_in_flight() const { return _bytes_in_flight; }
 
 void TCPSender::fill_window() {
-    uint16_t window_size = max(_window_size, static_cast<uint16_t>(1));
-    while (_bytes_in_flight < window_size) {
+    // 接收方窗口限制未确认的序列空间，拥塞窗口限制仍在网络中的字节数（没有 SACK 时两者相同）
+    const size_t receiver_window = max(_window_size, static_cast<uint32_t>(1));
+    const size_t congestion_window = _congestion_window();
+    while (_bytes_in_flight < receiver_window && _pipe() < congestion_window) {
+        // 本次还能发送的序列空间
+        const size_t window_size = min(receiver_window - _bytes_in_flight, congestion_window - _pipe());
         TCPSegment seg;
         // 首先发 SYN 包，不含 payload（因为初始时 window_size 为 1）
         if (!_set_syn_flag) {
@@ -35,14 +82,15 @@ void TCPSender::fill_window() {
             _set_syn_flag = true;
         }
 
-        // MAX_PAYLOAD_SIZE 只限制字符串长度并不包括 SYN 和 FIN，但是 window_size 包括 SYN 和 FIN
-        auto payload_size = min(TCPConfig::MAX_PAYLOAD_SIZE, \
-                            min(window_size - _bytes_in_flight - seg.header().syn, _stream.buffer_size()));
-        auto payload = _stream.read(payload_size);
-        seg.payload() = Buffer(std::move(payload));
+        // MSS 只限制字符串长度并不包括 SYN 和 FIN，但是 window_size 包括 SYN 和 FIN
+        auto payload_size = min(_mss, \
+                            min(window_size - seg.header().syn, _stream.buffer_size()));
+        // payload 直接引用 _stream 中已有的 Buffer（共享存储，不拷贝），只有跨越多个 Buffer 时才需要拼接
+        // 拼接的同时计算 payload 的校验和，发送（包括重传）时不必再读一遍 payload
+        seg.set_payload(_stream.read_buffers(payload_size));
 
         // 如果读到 EOF 了且 window_size 还有空位
-        if (!_set_fin_flag && _stream.eof() && _bytes_in_flight + seg.length_in_sequence_space() < window_size) {
+        if (!_set_fin_flag && _stream.eof() && seg.length_in_sequence_space() < window_size) {
             seg.header().fin = true;
             _set_fin_flag = true;
         }
@@ -56,10 +104,17 @@ void TCPSender::fill_window() {
         _segments_out.push(seg);
 
         // 如果定时器关闭，则启动定时器
-        if (!_timer.is_running()) _timer.restart();
+        if (!_timer.is_running()) _timer.restart(_timer_wheel.get(), _timer_tag, RETRANSMISSION_TIMER);
 
-        // 保存备份，重发时可能会用
-        _outstanding_seg.emplace(_next_seqno, std::move(seg));
+        // 每次只测量一个报文的 RTT
+        if (!_rtt_timing) {
+            _rtt_timing = true;
+            _rtt_seqno_end = _next_seqno + length;
+            _rtt_start_ms = _now();
+        }
+
+        // 保存备份，重发时可能会用（与 _segments_out 中的报文共享同一份 payload）
+        _outstanding_seg.push_back({_next_seqno, std::move(seg)});
         
         // 更新序列号和发出但未 ACK 的字节数
         _next_seqno += length; // _next_seqno 是 absolute seqno
@@ -68,34 +123,81 @@ void TCPSender::fill_window() {
 }
 
 //! \param ackno The remote receiver's ackno (acknowledgment number)
-//! \param window_size The remote receiver's advertised window size
-void TCPSender::ack_received(const WrappingInt32 ackno, const uint16_t window_size) {
+//! \param window_size The remote receiver's advertised window size (already scaled, if window scaling is in use)
+//! \param pure_ack whether the segment carrying the ACK occupies no sequence space
+void TCPSender::ack_received(const WrappingInt32 ackno, const uint32_t window_size, const bool pure_ack) {
     auto abs_ackno = unwrap(ackno, _isn, next_seqno_absolute());
     if (abs_ackno > next_seqno_absolute()) return; // 传入的 ACK 是不可靠的，直接丢弃
     int is_successful = 0;
+    size_t acked_bytes = 0;
+
+    // 重复 ACK：没有确认新数据、仍有未确认的数据、不携带数据且窗口不变（RFC 5681）
+    if (_fast_retransmit && pure_ack && _bytes_in_flight > 0 && abs_ackno == _next_seqno - _bytes_in_flight &&
+        window_size == _window_size) {
+        _duplicate_ack_received();
+    }
 
     // 处理已经收到的包（序列号空间要小于 ACK）
     while (!_outstanding_seg.empty()) {
-        auto &[abs_seq, seg] = _outstanding_seg.front();
-        if (abs_seq + seg.length_in_sequence_space() - 1 < abs_ackno) {
+        auto &outstanding = _outstanding_seg.front();
+        const size_t length = outstanding.seg.length_in_sequence_space();
+        if (outstanding.abs_seqno + length - 1 < abs_ackno) {
             is_successful = 1;
-            _bytes_in_flight -= seg.length_in_sequence_space();
-            _outstanding_seg.pop();
+            acked_bytes += length;
+            _bytes_in_flight -= length;
+            if (outstanding.sacked) {
+                _sacked_bytes -= length;
+            } else if (outstanding.lost && !outstanding.retransmitted) {
+                _lost_bytes -= length;
+            }
+            _outstanding_seg.pop_front();
         } else {
             break;
         } 
     }
 
+    // 被测量的报文得到确认，得到一个 RTT 样本
+    if (_rtt_timing && abs_ackno >= _rtt_seqno_end) {
+        _rtt_timing = false;
+        _rtt_estimator.add_sample(_now() - _rtt_start_ms);
+    }
+
     // 有成功 ACK 的包，则重置定时器，清零连续重传次数
     if (is_successful) {
+        _dup_ack_count = 0;
+        if (!_in_fast_recovery) {
+            _congestion_control->on_ack(acked_bytes, _now());
+        } else if (abs_ackno >= _recover) {
+            // 完全确认，退出快速恢复，拥塞窗口回到 on_loss 时设定的大小
+            _in_fast_recovery = false;
+            _recovery_inflation = 0;
+        } else if (_sack_enabled) {
+            // 部分确认（SACK）：下一个空洞也认为丢了，交给计分板重传
+            if (!_outstanding_seg.empty()) _mark_lost(_outstanding_seg.front());
+        } else {
+            // 部分确认：下一个空洞也丢了，立即重传它，并按已确认的字节收缩临时扩大的窗口
+            _retransmit_first_outstanding();
+            _recovery_inflation -= min(_recovery_inflation, acked_bytes);
+            _recovery_inflation += _mss;
+        }
         _consecutive_retransmissions_count = 0;
-        _timer.set_time_out(_initial_retransmission_timeout);
-        _timer.restart();
+        _timer.set_time_out(_current_rto());
+        _timer.restart(_timer_wheel.get(), _timer_tag, RETRANSMISSION_TIMER);
     }
 
     // 没有等待 ACK 的包了，则关闭定时器
     if (_bytes_in_flight == 0) {
-        _timer.stop();
+        _timer.stop(_timer_wheel.get());
+    }
+
+    // SACK：更新计分板，最早的报文被判定丢失也会触发快速重传；快速恢复期间优先重传丢失的报文
+    if (_sack_enabled && _fast_retransmit) {
+        _update_scoreboard();
+        if (!_in_fast_recovery && !_outstanding_seg.empty() && _outstanding_seg.front().lost &&
+            abs_ackno > _recover) {
+            _enter_fast_recovery();
+        }
+        if (_in_fast_recovery) _retransmit_lost_segments();
     }
 
     // 更新 window_size，并尝试填满窗口
@@ -103,27 +205,165 @@ void TCPSender::ack_received(const WrappingInt32 ackno, const uint16_t window_si
     fill_window();
 }
 
+optional<uint64_t> TCPSender::time_until_timeout() const {
+    if (!_timer.is_running() || _outstanding_seg.empty()) return {};
+    return _timer.time_remaining(_timer_wheel.get());
+}
+
+void TCPSender::set_timer_wheel(shared_ptr<TimerWheel> wheel, const uint64_t tag) {
+    if (_next_seqno > 0) {
+        throw runtime_error("TCPSender::set_timer_wheel() after sending");
+    }
+    _timer_wheel = move(wheel);
+    _timer_tag = tag;
+}
+
 //! \param[in] ms_since_last_tick the number of milliseconds since the last call to this method
 void TCPSender::tick(const size_t ms_since_last_tick) {
+    if (_timer_wheel) {
+        throw runtime_error("TCPSender::tick() on a shared TimerWheel");
+    }
+
+    _time_ms += ms_since_last_tick;
     _timer.tick(ms_since_last_tick);
+    timer_expired();
+}
 
+void TCPSender::timer_expired() {
     // 定时器超时（已经确保定时器已经打开），如果定时器关闭不会超时检查不会返回 true
     // 理论上不用检测 _outstanding_seg 非空，但为了鲁棒性就检测下吧
-    if (_timer.check_time_out() && !_outstanding_seg.empty()) {
-        // 重传最早的报文
-        _segments_out.push(_outstanding_seg.front().second);
+    if (_timer.check_time_out(_timer_wheel.get()) && !_outstanding_seg.empty()) {
+        // 重传最早的报文，之前的 SACK 信息不再可信
+        _clear_scoreboard();
+        _retransmit_first_outstanding();
+
+        // 超时后放弃快速恢复，之前发出的数据都不再触发快速重传
+        _dup_ack_count = 0;
+        _in_fast_recovery = false;
+        _recovery_inflation = 0;
+        _recover = _next_seqno;
 
         // window_size 非 0 对应的操作
         if (_window_size > 0) {
+            _congestion_control->on_rto(_bytes_in_flight, _now());
             ++_consecutive_retransmissions_count;
-            _timer.set_time_out(_timer.get_time_out() * 2);
+            auto time_out = _timer.get_time_out() * 2;
+            if (_adaptive_rto) time_out = min(time_out, max(_rto_max, _timer.get_time_out()));
+            _timer.set_time_out(time_out);
         }
         
         // 重启定时器
-        _timer.restart();
+        _timer.restart(_timer_wheel.get(), _timer_tag, RETRANSMISSION_TIMER);
+    }
+}
+
+void TCPSender::_retransmit_first_outstanding() {
+    if (_outstanding_seg.empty()) return;
+    _retransmit(_outstanding_seg.front());
+}
+
+void TCPSender::_retransmit(OutstandingSegment &outstanding) {
+    _segments_out.push(outstanding.seg);
+    if (outstanding.lost && !outstanding.retransmitted && !outstanding.sacked) {
+        _lost_bytes -= outstanding.seg.length_in_sequence_space();
+    }
+    outstanding.retransmitted = true;
+
+    // Karn 算法：重传过的报文不能提供 RTT 样本
+    _rtt_timing = false;
+}
+
+void TCPSender::_mark_lost(OutstandingSegment &outstanding) {
+    if (outstanding.sacked || outstanding.lost) return;
+    outstanding.lost = true;
+    if (!outstanding.retransmitted) _lost_bytes += outstanding.seg.length_in_sequence_space();
+}
+
+void TCPSender::_update_scoreboard() {
+    if (_sacked_bytes == 0) return;
+    // 从后往前累计每个报文之后被 SACK 的字节数（RFC 6675 的 IsLost）
+    size_t sacked_above = 0;
+    for (auto it = _outstanding_seg.rbegin(); it != _outstanding_seg.rend(); ++it) {
+        if (it->sacked) {
+            sacked_above += it->seg.length_in_sequence_space();
+        } else if (sacked_above > 2 * _mss) {
+            _mark_lost(*it);
+        }
+    }
+}
+
+void TCPSender::_retransmit_lost_segments() {
+    const size_t congestion_window = _congestion_window();
+    for (auto &outstanding : _outstanding_seg) {
+        if (_pipe() >= congestion_window) break;
+        if (outstanding.lost && !outstanding.sacked && !outstanding.retransmitted) _retransmit(outstanding);
+    }
+}
+
+void TCPSender::_clear_scoreboard() {
+    for (auto &outstanding : _outstanding_seg) {
+        outstanding.sacked = outstanding.lost = outstanding.retransmitted = false;
+    }
+    _sacked_bytes = _lost_bytes = 0;
+}
+
+void TCPSender::sack_received(const WrappingInt32 left, const WrappingInt32 right) {
+    if (!_sack_enabled) return;
+    const uint64_t abs_left = unwrap(left, _isn, _next_seqno);
+    const uint64_t abs_right = unwrap(right, _isn, _next_seqno);
+    if (abs_left >= abs_right || abs_right > _next_seqno) return;
+
+    // 只标记完全落在 SACK 块内的报文，队列按序列号递增，可以二分查找第一个
+    auto it = lower_bound(_outstanding_seg.begin(), _outstanding_seg.end(), abs_left,
+                          [](const OutstandingSegment &outstanding, const uint64_t seqno) {
+                              return outstanding.abs_seqno < seqno;
+                          });
+    for (; it != _outstanding_seg.end(); ++it) {
+        const size_t length = it->seg.length_in_sequence_space();
+        if (it->abs_seqno + length > abs_right) break;
+        if (it->sacked) continue;
+        if (it->lost && !it->retransmitted) _lost_bytes -= length;
+        it->sacked = true;
+        _sacked_bytes += length;
     }
 }
 
+void TCPSender::_duplicate_ack_received() {
+    ++_dup_ack_count;
+
+    // 快速恢复期间，每个重复 ACK 说明又有一个报文离开了网络，可以多发一个报文（使用 SACK 时由 pipe 体现）
+    if (_in_fast_recovery) {
+        if (!_sack_enabled) _recovery_inflation += _mss;
+        return;
+    }
+
+    // 第三个重复 ACK：快速重传，并进入快速恢复；已经在恢复过的数据上不再重复进入
+    const uint64_t abs_ackno = _next_seqno - _bytes_in_flight;
+    if (_dup_ack_count == 3 && abs_ackno > _recover) {
+        _enter_fast_recovery();
+    }
+}
+
+void TCPSender::_enter_fast_recovery() {
+    _in_fast_recovery = true;
+    _recover = _next_seqno;
+    _congestion_control->on_loss(_bytes_in_flight, _now());
+    if (!_sack_enabled) {
+        _recovery_inflation = 3 * _mss;
+        _retransmit_first_outstanding();
+        return;
+    }
+
+    // SACK：不管拥塞窗口，立即重传最早的未确认报文，其余丢失的报文由计分板在窗口允许时重传
+    auto first = find_if(_outstanding_seg.begin(), _outstanding_seg.end(), [](const OutstandingSegment &o) {
+        return !o.sacked;
+    });
+    if (first == _outstanding_seg.end()) return;
+    _mark_lost(*first);
+    _retransmit(*first);
+    _retransmit_lost_segments();
+}
+
 unsigned int TCPSender::consecutive_retransmissions() const { return _consecutive_retransmissions_count; }
 
 void TCPSender::send_empty_segment() {
@@ -2,38 +2,87 @@
 #define SPONGE_LIBSPONGE_TCP_SENDER_HH
 
 #include "byte_stream.hh"
+#include "congestion_control.hh"
 #include "tcp_config.hh"
 #include "tcp_segment.hh"
+#include "timer_wheel.hh"
 #include "wrapping_integers.hh"
 
+#include <algorithm>
 #include <cstdint>
 #include <deque>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <queue>
 #include <utility>
 
 //! \brief TCPSender 的计时器，最长定时时间（ms）不能超过 uint32
+//! \details wheel 为 nullptr 时自己计时，由 tick() 推进；否则挂在共享的 TimerWheel 上
 class Timer {
 private:
-    uint32_t _time_count = 0;
     uint32_t _time_out = 0;
+    uint32_t _time_count = 0;
     bool _is_running = false;
+    std::optional<TimerWheel::TimerId> _id{};
 public:
     Timer() = default;
     Timer(const uint32_t time_out) : _time_out(time_out) {}
-    // void start() { _is_running = true; }
-    void stop() { _is_running = false; }
+    void stop(TimerWheel *wheel) {
+        if (wheel && _id.has_value()) wheel->stop(_id.value());
+        _id.reset();
+        _is_running = false;
+    }
     void set_time_out(const uint32_t time_out) { _time_out = time_out; }
     uint32_t get_time_out() const { return _time_out; }
-    void restart() { _is_running = true, _time_count = 0; }
-    void tick(const size_t ms_since_last_tick) {
-        if (_is_running)
-            _time_count += ms_since_last_tick; 
+    //! 重新计时，共享 wheel 上超时时 wheel 会报告 tag 和 cookie
+    void restart(TimerWheel *wheel, const uint64_t tag, const uint64_t cookie) {
+        stop(wheel);
+        _is_running = true;
+        _time_count = 0;
+        if (wheel) _id = wheel->start(_time_out, tag, cookie);
+    }
+    //! 自己计时时推进时间，只在计时器运行时计时
+    void tick(const size_t ms) {
+        if (_is_running) _time_count += ms;
+    }
+    //! 超时后计时器仍算作在运行，直到 stop 或 restart
+    bool check_time_out(const TimerWheel *wheel) const {
+        if (!_is_running) return false;
+        return wheel ? !wheel->running(_id.value()) : _time_count >= _time_out;
+    }
+    //! 距离超时还有多少 ms（只在计时器运行时有意义）
+    uint64_t time_remaining(const TimerWheel *wheel) const {
+        if (wheel) return wheel->time_remaining(_id.value()).value_or(0);
+        return _time_count >= _time_out ? 0 : _time_out - _time_count;
     }
-    bool check_time_out() const { return _is_running && _time_count >= _time_out; }
     bool is_running() const { return _is_running; }
 };
 
+//! \brief 根据 RTT 样本估计 RTO，见 [RFC 6298](\ref rfc::rfc6298)
+class RTTEstimator {
+private:
+    double _srtt = 0;
+    double _rttvar = 0;
+    bool _has_sample = false;
+public:
+    //! 加入一个 RTT 样本（ms）
+    void add_sample(const uint64_t rtt) {
+        const auto r = static_cast<double>(rtt);
+        if (!_has_sample) {
+            _srtt = r, _rttvar = r / 2, _has_sample = true;
+        } else {
+            _rttvar = 0.75 * _rttvar + 0.25 * (_srtt > r ? _srtt - r : r - _srtt);
+            _srtt = 0.875 * _srtt + 0.125 * r;
+        }
+    }
+    bool has_sample() const { return _has_sample; }
+    double srtt() const { return _srtt; }
+    double rttvar() const { return _rttvar; }
+    //! RTO = SRTT + max(G, 4 * RTTVAR)，时钟粒度 G 为 1 ms
+    double rto() const { return _srtt + std::max(1.0, 4 * _rttvar); }
+};
+
 //! \brief The "sender" part of a TCP implementation.
 
 //! Accepts a ByteStream, divides it up into segments and sends the
@@ -60,8 +109,17 @@ class TCPSender {
     //! 重传定时器
     Timer _timer;
 
-    //! 已经发出但还未收到 ACK 确认的 TCPSegment 队列
-    std::queue<std::pair<uint64_t, TCPSegment> > _outstanding_seg{};
+    //! 已经发出但还未收到 ACK 确认的报文，以及它在 SACK 计分板中的状态
+    struct OutstandingSegment {
+        uint64_t abs_seqno;          //!< 报文的 absolute seqno
+        TCPSegment seg;              //!< 报文本身（与发出的报文共享 payload）
+        bool sacked = false;         //!< 已被对方 SACK
+        bool lost = false;           //!< 被判定为丢失
+        bool retransmitted = false;  //!< 被判定为丢失（或超时）后已经重传过
+    };
+
+    //! 已经发出但还未收到 ACK 确认的 TCPSegment 队列，按序列号递增
+    std::deque<OutstandingSegment> _outstanding_seg{};
 
     //! 连续重传次数
     uint32_t _consecutive_retransmissions_count = 0;
@@ -70,17 +128,107 @@ class TCPSender {
     size_t _bytes_in_flight = 0;
 
     //! 窗口大小，根据文档初始值应为 1
-    uint16_t _window_size = 1;
+    uint32_t _window_size = 1;
 
     //! 是否发送带 SYN/FIN 的包
     bool _set_syn_flag = false, _set_fin_flag = false;
 
+    //! 每个报文最大的 payload 长度，握手时与对方通告的 MSS 协商
+    size_t _mss = TCPConfig::MAX_PAYLOAD_SIZE;
+
+    //! 拥塞控制算法，限制发出但未 ACK 的字节数不超过 cwnd
+    TCPConfig::CongestionControlAlgorithm _congestion_control_algorithm;
+    std::unique_ptr<CongestionControl> _congestion_control;
+
+    //! 共享的 TimerWheel，由它的所有者推进，超时时调用 timer_expired()
+    //! 默认为空，此时重传定时器自己计时，由 tick() 推进
+    std::shared_ptr<TimerWheel> _timer_wheel{};
+    uint64_t _timer_tag = 0;
+
+    //! tick() 累计的时间（ms），没有共享 TimerWheel 时供 RTT 测量和拥塞控制算法使用
+    uint64_t _time_ms = 0;
+
+    //! 当前时间（ms）
+    uint64_t _now() const { return _timer_wheel ? _timer_wheel->now() : _time_ms; }
+
+    //! 是否根据 RTT 样本自适应地计算 RTO，以及 RTO 的上下界（ms）
+    bool _adaptive_rto;
+    uint32_t _rto_min, _rto_max;
+
+    //! RTT 估计器
+    RTTEstimator _rtt_estimator{};
+
+    //! 正在测量 RTT 的报文：是否在测量、其序列空间的结束位置（absolute seqno）以及发送时间
+    bool _rtt_timing = false;
+    uint64_t _rtt_seqno_end = 0;
+    uint64_t _rtt_start_ms = 0;
+
+    //! 当前（未退避的）重传超时时间
+    uint32_t _current_rto() const;
+
+    //! 是否启用快速重传/快速恢复（RFC 5681 中它们属于拥塞控制，因此只在启用拥塞控制时使用）
+    bool _fast_retransmit;
+
+    //! 连续收到的重复 ACK 数
+    unsigned _dup_ack_count = 0;
+
+    //! 是否处于快速恢复（NewReno，见 [RFC 6582](\ref rfc::rfc6582)）
+    bool _in_fast_recovery = false;
+
+    //! 进入快速恢复时已发送的最大序列号（absolute seqno），ACK 到这里才算恢复完成
+    uint64_t _recover = 0;
+
+    //! 快速恢复期间每个重复 ACK 代表一个离开网络的报文，据此临时扩大的拥塞窗口（字节）
+    size_t _recovery_inflation = 0;
+
+    //! 快速恢复期间实际使用的拥塞窗口
+    size_t _congestion_window() const;
+
+    //! 重传最早的未确认报文
+    void _retransmit_first_outstanding();
+
+    //! 处理一个重复 ACK
+    void _duplicate_ack_received();
+
+    //! 进入快速恢复并快速重传
+    void _enter_fast_recovery();
+
+    //! 是否使用 SACK 计分板恢复丢失的报文（双方握手时都同意才启用，见 [RFC 2018](\ref rfc::rfc2018)）
+    bool _sack_enabled = false;
+
+    //! 未确认报文中被 SACK 的字节数，以及被判定丢失但尚未重传的字节数，它们都已经离开了网络
+    size_t _sacked_bytes = 0;
+    size_t _lost_bytes = 0;
+
+    //! 估计仍在网络中的字节数（[RFC 6675](\ref rfc::rfc6675) 中的 pipe），拥塞窗口限制的是它
+    size_t _pipe() const { return _bytes_in_flight - _sacked_bytes - _lost_bytes; }
+
+    //! 重传一个未确认的报文
+    void _retransmit(OutstandingSegment &outstanding);
+
+    //! 把一个未确认的报文标记为丢失
+    void _mark_lost(OutstandingSegment &outstanding);
+
+    //! 根据 SACK 信息判定丢失的报文：其后被 SACK 的数据超过 (DupThresh - 1) * MSS 即认为丢失
+    void _update_scoreboard();
+
+    //! 在拥塞窗口允许的范围内，按序列号顺序重传判定为丢失的报文
+    void _retransmit_lost_segments();
+
+    //! 清空计分板（超时之后对方可能已经丢弃了之前 SACK 过的数据）
+    void _clear_scoreboard();
+
 
   public:
     //! Initialize a TCPSender
     TCPSender(const size_t capacity = TCPConfig::DEFAULT_CAPACITY,
               const uint16_t retx_timeout = TCPConfig::TIMEOUT_DFLT,
-              const std::optional<WrappingInt32> fixed_isn = {});
+              const std::optional<WrappingInt32> fixed_isn = {},
+              const TCPConfig::CongestionControlAlgorithm congestion_control =
+                  TCPConfig::CongestionControlAlgorithm::None,
+              const bool adaptive_rto = false,
+              const uint32_t rto_min = TCPConfig::RTO_MIN_DFLT,
+              const uint32_t rto_max = TCPConfig::RTO_MAX_DFLT);
 
     //! \name "Input" interface for the writer
     //!@{
@@ -92,7 +240,13 @@ class TCPSender {
     //!@{
 
     //! \brief A new acknowledgment was received
-    void ack_received(const WrappingInt32 ackno, const uint16_t window_size);
+    //! \param pure_ack whether the segment carrying the ACK occupies no sequence space
+    //! (only such ACKs are counted as duplicate ACKs)
+    void ack_received(const WrappingInt32 ackno, const uint32_t window_size, const bool pure_ack = true);
+
+    //! \brief The peer reported [left, right) as received out of order (a SACK block)
+    //! \note Call before ack_received() for the segment that carried the block.
+    void sack_received(const WrappingInt32 left, const WrappingInt32 right);
 
     //! \brief Generate an empty-payload segment (useful for creating empty ACK segments)
     void send_empty_segment();
@@ -101,9 +255,21 @@ class TCPSender {
     void fill_window();
 
     //! \brief Notifies the TCPSender of the passage of time
+    //! \note Not for a TCPSender on a shared TimerWheel; the wheel's owner calls timer_expired() instead.
     void tick(const size_t ms_since_last_tick);
+
+    //! \brief The retransmission timer expired on a shared TimerWheel
+    void timer_expired();
     //!@}
 
+    //! \brief The cookie of the retransmission timer on the TimerWheel
+    static constexpr uint64_t RETRANSMISSION_TIMER = 0;
+
+    //! \brief Run the retransmission timer on `wheel`, which others share and its owner advances
+    //! \details When a timer with this `tag` and cookie RETRANSMISSION_TIMER expires, the owner
+    //! calls timer_expired(). Call before sending anything.
+    void set_timer_wheel(std::shared_ptr<TimerWheel> wheel, const uint64_t tag);
+
     //! \name Accessors
     //!@{
 
@@ -115,6 +281,34 @@ class TCPSender {
     //! \brief Number of consecutive retransmissions that have occurred in a row
     unsigned int consecutive_retransmissions() const;
 
+    //! \brief The largest payload the sender puts in one segment
+    size_t mss() const { return _mss; }
+
+    //! \brief Set the largest payload per segment (e.g. after MSS negotiation); at least one byte
+    //! \note Resets congestion control, so it must be called during the handshake, before any payload is sent.
+    void set_mss(const size_t mss);
+
+    //! \brief Is SACK-based loss recovery in use?
+    bool sack_enabled() const { return _sack_enabled; }
+
+    //! \brief Use the peer's SACK blocks to retransmit only the holes during fast recovery
+    //! \note Call once both sides agreed on SACK during the handshake.
+    void set_sack_enabled(const bool enabled) { _sack_enabled = enabled; }
+
+    //! \brief The smoothed round-trip time, in milliseconds
+    //! \returns empty if no RTT has been measured yet
+    std::optional<uint64_t> smoothed_rtt() const;
+
+    //! \brief Milliseconds (of tick() time) until the retransmission timer expires
+    //! \returns empty if the timer is not running, i.e. tick() will not retransmit however much time passes
+    std::optional<uint64_t> time_until_timeout() const;
+
+    //! \brief The current retransmission timeout (before exponential backoff), in milliseconds
+    uint32_t retransmission_timeout() const { return _current_rto(); }
+
+    //! \brief The congestion window, in bytes
+    size_t congestion_window() const { return _congestion_control->cwnd(); }
+
     //! \brief TCPSegments that the TCPSender has enqueued for transmission.
     //! \note These must be dequeued and sent by the TCPConnection,
     //! which will need to fill in the fields that are set by the TCPReceiver
@@ -0,0 +1,196 @@
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+TimerWheel::TimerWheel() { _heads.fill(NONE); }
+
+const TimerWheel::Entry *TimerWheel::_find(const TimerId id) const {
+    const uint64_t index = id & UINT32_MAX;
+    if (index >= _entries.size()) {
+        return nullptr;
+    }
+    const Entry &entry = _entries[index];
+    if (entry.generation != id >> 32 or entry.list == NONE) {
+        return nullptr;
+    }
+    return &entry;
+}
+
+//! Puts an entry in the list of the slot that its deadline falls in: the finest level whose
+//! slots (counting up from the present) reach the deadline
+void TimerWheel::_link(const uint32_t index) {
+    Entry &entry = _entries[index];
+    if (entry.list != DUE) {
+        const uint64_t differing = entry.deadline ^ _now;
+        unsigned level = 0;
+        while (level + 1 < LEVELS and (differing >> (SLOT_BITS * (level + 1))) != 0) {
+            level++;
+        }
+        const uint32_t slot = (entry.deadline >> (SLOT_BITS * level)) & (SLOTS - 1);
+        entry.list = level * SLOTS + slot;
+        if (level == 0) {
+            _level0[slot / 64] |= uint64_t(1) << (slot % 64);
+        }
+    }
+
+    entry.prev = NONE;
+    entry.next = _heads[entry.list];
+    if (entry.next != NONE) {
+        _entries[entry.next].prev = index;
+    }
+    _heads[entry.list] = index;
+}
+
+void TimerWheel::_unlink(const uint32_t index) {
+    Entry &entry = _entries[index];
+    if (entry.prev != NONE) {
+        _entries[entry.prev].next = entry.next;
+    } else {
+        _heads[entry.list] = entry.next;
+        if (entry.list < SLOTS and entry.next == NONE) {
+            _level0[entry.list / 64] &= ~(uint64_t(1) << (entry.list % 64));
+        }
+    }
+    if (entry.next != NONE) {
+        _entries[entry.next].prev = entry.prev;
+    }
+}
+
+void TimerWheel::_free_entry(const uint32_t index) {
+    Entry &entry = _entries[index];
+    entry.generation++;
+    entry.list = NONE;
+    _free.push_back(index);
+    _size--;
+}
+
+//! \param[in] delay_ms is how long until the timer expires
+//! \param[in] tag identifies the owner of the timer, for whoever advances the wheel
+//! \param[in] cookie identifies the timer, for its owner
+TimerWheel::TimerId TimerWheel::start(const uint64_t delay_ms, const uint64_t tag, const uint64_t cookie) {
+    if (delay_ms > UINT32_MAX) {
+        throw invalid_argument("TimerWheel: delay too long");
+    }
+
+    uint32_t index;
+    if (_free.empty()) {
+        index = _entries.size();
+        _entries.emplace_back();
+    } else {
+        index = _free.back();
+        _free.pop_back();
+    }
+    Entry &entry = _entries[index];
+    entry.deadline = _now + delay_ms;
+    entry.tag = tag;
+    entry.cookie = cookie;
+    entry.list = delay_ms == 0 ? DUE : 0;  // _link leaves a timer in the DUE list there
+    _link(index);
+    _size++;
+    // advance() must stop at the timer's deadline, and at the next cascade, which may move it to level 0
+    _horizon = min({_horizon, entry.deadline, (_now | (SLOTS - 1)) + 1});
+    return (uint64_t(entry.generation) << 32) | index;
+}
+
+void TimerWheel::stop(const TimerId id) {
+    if (_find(id) == nullptr) {
+        return;
+    }
+    const uint32_t index = id & UINT32_MAX;
+    _unlink(index);
+    _free_entry(index);
+}
+
+optional<uint64_t> TimerWheel::time_remaining(const TimerId id) const {
+    const Entry *entry = _find(id);
+    if (entry == nullptr) {
+        return {};
+    }
+    return entry->deadline > _now ? entry->deadline - _now : 0;
+}
+
+void TimerWheel::_cascade(const unsigned level) {
+    const uint32_t slot = (_now >> (SLOT_BITS * level)) & (SLOTS - 1);
+    if (slot == 0 and level + 1 < LEVELS) {
+        _cascade(level + 1);
+    }
+
+    const uint32_t list = level * SLOTS + slot;
+    uint32_t index = _heads[list];
+    _heads[list] = NONE;
+    while (index != NONE) {
+        const uint32_t next = _entries[index].next;
+        _link(index);
+        index = next;
+    }
+}
+
+void TimerWheel::_expire(const uint32_t list, const ExpiredT &expired) {
+    // the callbacks may stop timers in this list, or (in the DUE list) start new ones
+    vector<pair<uint32_t, uint32_t>> expiring;  // index and generation
+    for (uint32_t index = _heads[list]; index != NONE; index = _entries[index].next) {
+        expiring.emplace_back(index, _entries[index].generation);
+    }
+
+    for (const auto &[index, generation] : expiring) {
+        const Entry &entry = _entries[index];
+        if (entry.generation != generation or entry.list != list) {
+            continue;
+        }
+        const uint64_t tag = entry.tag;
+        const uint64_t cookie = entry.cookie;
+        _unlink(index);
+        _free_entry(index);
+        expired(tag, cookie);
+    }
+}
+
+//! \param[in] ms is how much time has passed
+//! \param[in] expired is called with the tag and cookie of each timer that expires
+void TimerWheel::advance(const uint64_t ms, const ExpiredT &expired) {
+    const uint64_t target = _now + ms;
+    if (target < _horizon) {
+        // the common case of a tick in which nothing happens (a timer in the DUE list lowers _horizon to now)
+        _now = target;
+        return;
+    }
+
+    if (_heads[DUE] != NONE) {
+        _expire(DUE, expired);
+    }
+
+    while (_now < target) {
+        if (_size == 0) {
+            _now = target;
+            _horizon = UINT64_MAX;
+            break;
+        }
+
+        // skip ahead to the next non-empty level 0 slot, or to the next cascade, whichever is first
+        uint64_t next = (_now | (SLOTS - 1)) + 1;
+        for (uint32_t slot = (_now & (SLOTS - 1)) + 1; slot < SLOTS; slot = (slot | 63) + 1) {
+            const uint64_t occupied = _level0[slot / 64] >> (slot % 64);
+            if (occupied != 0) {
+                next = (_now & ~uint64_t(SLOTS - 1)) | (slot + __builtin_ctzll(occupied));
+                break;
+            }
+        }
+        if (next > target) {
+            _now = target;
+            _horizon = next;
+            break;
+        }
+
+        _now = next;
+        if ((_now & (SLOTS - 1)) == 0) {
+            _cascade(1);
+        }
+        const uint32_t slot = _now & (SLOTS - 1);
+        if (_heads[slot] != NONE) {
+            _expire(slot, expired);
+        }
+    }
+}
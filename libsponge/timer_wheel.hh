@@ -0,0 +1,96 @@
+#ifndef SPONGE_LIBSPONGE_TIMER_WHEEL_HH
+#define SPONGE_LIBSPONGE_TIMER_WHEEL_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+//! \brief A hierarchical timing wheel: many timers with millisecond resolution, driven by the passage of time
+//!
+//! Starting and stopping a timer takes O(1) time, and advancing the clock only touches the timers that
+//! expire (plus, every 256 ms, those due within the next 64 seconds or so, as they move to a finer level).
+//! This lets many connections share one wheel, which is advanced once per tick, instead of each
+//! connection counting down its own timers on every tick.
+//!
+//! A timer carries two numbers instead of a callback, so that its owner can be moved (e.g. in a
+//! std::vector) while the timer runs: the `tag` says which owner the timer belongs to, and the `cookie`
+//! says what the owner is timing. Whoever advances the wheel passes each expired timer's tag and cookie
+//! to the owner, typically by calling its `timer_expired(cookie)`.
+class TimerWheel {
+  public:
+    //! Identifies a timer; stays unique after the timer expires or is stopped
+    using TimerId = uint64_t;
+
+    //! Called with the tag and cookie of each timer that expires
+    using ExpiredT = std::function<void(uint64_t tag, uint64_t cookie)>;
+
+  private:
+    static constexpr unsigned LEVELS = 4;
+    static constexpr unsigned SLOT_BITS = 8;
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr uint32_t DUE = LEVELS * SLOTS;  //!< the list of timers that expire on the next advance
+
+    //! A timer, in the list of one slot (or free)
+    struct Entry {
+        uint64_t deadline = 0;
+        uint64_t tag = 0;
+        uint64_t cookie = 0;
+        uint32_t generation = 0;  //!< incremented whenever the entry is freed, so old TimerIds are recognized
+        uint32_t list = NONE;     //!< the slot (or DUE) whose list the entry is in, NONE if free
+        uint32_t prev = NONE;
+        uint32_t next = NONE;
+    };
+
+    uint64_t _now = 0;
+    uint64_t _horizon = UINT64_MAX;  //!< no timer expires (or moves between levels) before this time
+    size_t _size = 0;
+    std::vector<Entry> _entries{};
+    std::vector<uint32_t> _free{};                //!< indices of free entries
+    std::array<uint32_t, DUE + 1> _heads{};       //!< first entry of each slot's list (level * SLOTS + slot), and DUE
+    std::array<uint64_t, SLOTS / 64> _level0{};  //!< which level 0 slots are non-empty
+
+    //! The entry that `id` refers to, if the timer is still running
+    const Entry *_find(const TimerId id) const;
+
+    void _link(const uint32_t index);
+    void _unlink(const uint32_t index);
+    void _free_entry(const uint32_t index);
+
+    //! Move the timers in level `level`'s current slot down to finer levels (after the levels above it)
+    void _cascade(const unsigned level);
+
+    //! Expire every timer in the list `list`
+    void _expire(const uint32_t list, const ExpiredT &expired);
+
+  public:
+    TimerWheel();
+
+    //! \brief Milliseconds that the wheel has been advanced by
+    uint64_t now() const { return _now; }
+
+    //! \brief Number of running timers
+    size_t size() const { return _size; }
+
+    //! \brief Start a timer that expires `delay_ms` milliseconds from now (which must be less than 2^32)
+    //! \details A timer with no delay expires on the next call to advance(), even advance(0).
+    TimerId start(const uint64_t delay_ms, const uint64_t tag, const uint64_t cookie);
+
+    //! \brief Stop a timer; has no effect if it already expired or was stopped
+    void stop(const TimerId id);
+
+    //! \brief Is the timer still running (i.e. it has neither expired nor been stopped)?
+    bool running(const TimerId id) const { return _find(id) != nullptr; }
+
+    //! \brief Milliseconds until the timer expires, or empty if it is no longer running
+    std::optional<uint64_t> time_remaining(const TimerId id) const;
+
+    //! \brief Advance the clock by `ms` milliseconds, calling `expired` for each timer that expires, in order
+    //! \details `expired` may start and stop timers; one that it starts with no delay expires on the next call.
+    void advance(const uint64_t ms, const ExpiredT &expired);
+};
+
+#endif  // SPONGE_LIBSPONGE_TIMER_WHEEL_HH
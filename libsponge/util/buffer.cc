@@ -7,8 +7,20 @@ void Buffer::remove_prefix(const size_t n) {
         throw out_of_range("Buffer::remove_prefix");
     }
     _starting_offset += n;
-    if (_storage and _starting_offset == _storage->size()) {
+    if (_storage and str().empty()) {
         _storage.reset();
+        _starting_offset = _ending_offset = 0;
+    }
+}
+
+void Buffer::remove_suffix(const size_t n) {
+    if (n > str().size()) {
+        throw out_of_range("Buffer::remove_suffix");
+    }
+    _ending_offset += n;
+    if (_storage and str().empty()) {
+        _storage.reset();
+        _starting_offset = _ending_offset = 0;
     }
 }
 
@@ -18,6 +30,8 @@ void BufferList::append(const BufferList &other) {
     }
 }
 
+void BufferList::append(Buffer buffer) { _buffers.push_back(std::move(buffer)); }
+
 BufferList::operator Buffer() const {
     switch (_buffers.size()) {
         case 0:
@@ -1,19 +1,263 @@
 #include "eventloop.hh"
 
+#include "io_uring.hh"
 #include "util.hh"
 
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <limits>
 #include <stdexcept>
+#include <sys/socket.h>
 #include <system_error>
 #include <utility>
 #include <vector>
 
 using namespace std;
 
+#ifdef HAVE_IO_URING
+
+//! The io_uring instance, and what the io_uring backend has asked it to do
+class EventLoop::IoUringState {
+  public:
+    static constexpr unsigned QUEUE_ENTRIES = 256;
+    static constexpr uint16_t BUFFER_GROUP = 0;
+    static constexpr unsigned BUFFER_COUNT = 256;
+    static constexpr size_t BUFFER_SIZE = 4096;  //!< longer datagrams (with their source address) are dropped
+
+    //! Registration::poll_id of an fd that is not polled until its events change (see EventLoop::_wait_io_uring)
+    static constexpr uint64_t PARKED = UINT64_MAX;
+
+    //! The kind of an operation, in the low bits of its user_data; the rest is an id
+    enum Kind : uint64_t { POLL = 1, RECEIVE = 2, SEND = 3, CANCEL = 4 };
+    static constexpr unsigned KIND_BITS = 3;
+
+    //! A rule added with EventLoop::add_datagram_rule
+    struct DatagramRule {
+        FileDescriptor fd;
+        DatagramCallbackT callback;
+        InterestT interest;
+        CallbackT cancel;
+        msghdr header{};          //!< tells the multishot receive to leave room for the source address
+        uint64_t receive_id = 0;  //!< the multishot receive posted on fd, 0 if none
+        bool requested = false;   //!< Did interest return `true` in this call to EventLoop::wait_next_event?
+        std::deque<std::pair<uint16_t, uint32_t>> received{};  //!< buffers (id, length) not yet delivered
+    };
+
+    //! A datagram being sent, which the kernel reads until its send completes
+    struct Send {
+        std::optional<FileDescriptor> fd{};  //!< keeps the socket open (and its number unused) until then
+        sockaddr_storage destination{};
+        std::string payload{};
+        iovec iov{};
+        msghdr header{};
+    };
+
+    IoUring ring{QUEUE_ENTRIES};
+    bool buffers_provided = false;
+    std::list<DatagramRule> datagram_rules{};
+    std::unordered_map<uint64_t, std::list<DatagramRule>::iterator> receives{};  //!< by id, until the last completion
+    std::unordered_map<uint64_t, int> polls{};  //!< the fd number of each poll, by id
+    std::vector<std::unique_ptr<Send>> sends{};  //!< indexed by id
+    std::vector<uint64_t> free_sends{};
+    uint64_t next_id = 1;
+    size_t in_flight = 0;  //!< operations whose last completion has not been seen
+
+    static uint64_t user_data(const Kind kind, const uint64_t id) { return (id << KIND_BITS) | kind; }
+
+    void post_poll(const int fd_num, const uint32_t events, const uint64_t id) {
+        polls.emplace(id, fd_num);
+        io_uring_sqe &sqe = ring.sqe();
+        sqe.opcode = IORING_OP_POLL_ADD;
+        sqe.fd = fd_num;
+        sqe.poll32_events = events;
+        sqe.user_data = user_data(POLL, id);
+        in_flight++;
+    }
+
+    void post_receive(const std::list<DatagramRule>::iterator rule) {
+        if (not buffers_provided) {
+            ring.provide_buffers(BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE);
+            buffers_provided = true;
+        }
+        rule->receive_id = next_id++;
+        receives.emplace(rule->receive_id, rule);
+        io_uring_sqe &sqe = ring.sqe();
+        sqe.opcode = IORING_OP_RECVMSG;
+        sqe.fd = rule->fd.fd_num();
+        sqe.addr = reinterpret_cast<uint64_t>(&rule->header);
+        sqe.len = 1;
+        sqe.ioprio = IORING_RECV_MULTISHOT;
+        sqe.flags = IOSQE_BUFFER_SELECT;
+        sqe.buf_group = BUFFER_GROUP;
+        sqe.user_data = user_data(RECEIVE, rule->receive_id);
+        in_flight++;
+    }
+
+    void post_send(const FileDescriptor &fd, const Address &destination, const BufferViewList &payload) {
+        uint64_t id;
+        if (free_sends.empty()) {
+            id = sends.size();
+            sends.push_back(std::make_unique<Send>());
+        } else {
+            id = free_sends.back();
+            free_sends.pop_back();
+        }
+        Send &send = *sends[id];
+        send.fd.emplace(fd.duplicate());
+        memcpy(&send.destination, static_cast<const sockaddr *>(destination), destination.size());
+        send.payload.clear();
+        for (const auto &buffer : payload.as_iovecs()) {
+            send.payload.append(static_cast<const char *>(buffer.iov_base), buffer.iov_len);
+        }
+        send.iov = {send.payload.data(), send.payload.size()};
+        send.header = {};
+        send.header.msg_name = &send.destination;
+        send.header.msg_namelen = destination.size();
+        send.header.msg_iov = &send.iov;
+        send.header.msg_iovlen = 1;
+
+        io_uring_sqe &sqe = ring.sqe();
+        sqe.opcode = IORING_OP_SENDMSG;
+        sqe.fd = fd.fd_num();
+        sqe.addr = reinterpret_cast<uint64_t>(&send.header);
+        sqe.len = 1;
+        sqe.user_data = user_data(SEND, id);
+        in_flight++;
+    }
+
+    //! Ask the kernel to cancel the operation with `target` as its user_data (its completion still comes)
+    void post_cancel(const uint64_t target) {
+        io_uring_sqe &sqe = ring.sqe();
+        sqe.opcode = IORING_OP_ASYNC_CANCEL;
+        sqe.addr = target;
+        sqe.user_data = user_data(CANCEL, 0);
+        in_flight++;
+    }
+
+    //! Calls DatagramRule::cancel and deletes the rule, returning the next one.
+    std::list<DatagramRule>::iterator cancel_rule(const std::list<DatagramRule>::iterator rule) {
+        rule->cancel();
+        if (rule->receive_id != 0) {
+            post_cancel(user_data(RECEIVE, rule->receive_id));
+        }
+        // the receive's remaining completions find no rule, and give their buffers back
+        for (auto it = receives.begin(); it != receives.end();) {
+            it = it->second == rule ? receives.erase(it) : next(it);
+        }
+        for (const auto &[buffer_id, length] : rule->received) {
+            ring.recycle_buffer(buffer_id);
+        }
+        return datagram_rules.erase(rule);
+    }
+
+    //! Does the kernel support everything the backend uses (in particular, multishot receives)?
+    static bool probe() {
+        IoUring probe_ring{4};
+        probe_ring.provide_buffers(BUFFER_GROUP, 1, BUFFER_SIZE);
+        UDPSocket socket;
+        msghdr header{};
+        io_uring_sqe &receive = probe_ring.sqe();
+        receive.opcode = IORING_OP_RECVMSG;
+        receive.fd = socket.fd_num();
+        receive.addr = reinterpret_cast<uint64_t>(&header);
+        receive.len = 1;
+        receive.ioprio = IORING_RECV_MULTISHOT;
+        receive.flags = IOSQE_BUFFER_SELECT;
+        receive.buf_group = BUFFER_GROUP;
+        receive.user_data = 1;
+        io_uring_sqe &cancel = probe_ring.sqe();
+        cancel.opcode = IORING_OP_ASYNC_CANCEL;
+        cancel.addr = 1;
+
+        // a kernel without multishot receives fails the receive with EINVAL
+        int result = 0;
+        for (size_t completions = 0; completions < 2;) {
+            if (not probe_ring.submit_and_wait(1000)) {
+                continue;
+            }
+            const size_t count = probe_ring.for_each_completion([&](const io_uring_cqe &cqe) {
+                if (cqe.user_data == 1) {
+                    result = cqe.res;
+                }
+            });
+            if (count == 0) {
+                return false;
+            }
+            completions += count;
+        }
+        return result == -ECANCELED;
+    }
+};
+
+#else
+
+//! Without HAVE_IO_URING, an EventLoop never has one
+class EventLoop::IoUringState {};
+
+#endif  // HAVE_IO_URING
+
 unsigned int EventLoop::Rule::service_count() const {
     return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+EventLoop::EventLoop(const Backend backend) : _backend(backend) {
+    if (_backend == Backend::Epoll) {
+        _epoll_fd.emplace(SystemCall("epoll_create1", ::epoll_create1(EPOLL_CLOEXEC)));
+    } else if (_backend == Backend::IoUring) {
+#ifdef HAVE_IO_URING
+        _io_uring = make_unique<IoUringState>();
+#else
+        throw runtime_error("EventLoop: built without io_uring support");
+#endif
+    }
+}
+
+EventLoop::~EventLoop() {
+#ifdef HAVE_IO_URING
+    if (not _io_uring) {
+        return;
+    }
+    try {
+        // the sends go out; the receives and polls stop (and their buffers must outlive them)
+        auto &state = *_io_uring;
+        for (const auto &[id, rule] : state.receives) {
+            state.post_cancel(IoUringState::user_data(IoUringState::RECEIVE, id));
+        }
+        for (const auto &[id, fd_num] : state.polls) {
+            state.post_cancel(IoUringState::user_data(IoUringState::POLL, id));
+        }
+        while (state.in_flight > 0) {
+            state.ring.submit_and_wait(-1);
+            state.ring.for_each_completion([&](const io_uring_cqe &cqe) {
+                if (not(cqe.flags & IORING_CQE_F_MORE)) {
+                    state.in_flight--;
+                }
+            });
+        }
+    } catch (const exception &e) {
+        cerr << "EventLoop: " << e.what() << "\n";
+    }
+#endif
+}
+
+bool EventLoop::io_uring_supported() {
+#ifdef HAVE_IO_URING
+    static const bool supported = [] {
+        try {
+            return IoUringState::probe();
+        } catch (const exception &) {
+            return false;
+        }
+    }();
+    return supported;
+#else
+    return false;
+#endif
+}
+
 //! \param[in] fd is the FileDescriptor to be polled
 //! \param[in] direction indicates whether to poll for reading (Direction::In) or writing (Direction::Out)
 //! \param[in] callback is called when `fd` is ready.
@@ -28,6 +272,210 @@ void EventLoop::add_rule(const FileDescriptor &fd,
     _rules.push_back({fd.duplicate(), direction, callback, interest, cancel});
 }
 
+//! \param[in] socket is the UDPSocket to receive datagrams from
+//! \param[in] callback is called with each datagram that `socket` receives
+//! \param[in] interest is called by EventLoop::wait_next_event. If it returns `true`, datagrams are received
+//!                     (and delivered), otherwise they wait in the socket.
+//! \param[in] cancel is called when the rule is cancelled (e.g. on closure).
+void EventLoop::add_datagram_rule(UDPSocket &socket,
+                                  const DatagramCallbackT &callback,
+                                  const InterestT &interest,
+                                  const CallbackT &cancel) {
+#ifdef HAVE_IO_URING
+    if (_io_uring) {
+        auto &rules = _io_uring->datagram_rules;
+        rules.push_back({socket.duplicate(), callback, interest, cancel});
+        rules.back().header.msg_namelen = sizeof(sockaddr_storage);
+        return;
+    }
+#endif
+
+    auto datagrams = make_shared<vector<UDPSocket::received_datagram>>();
+    add_rule(
+        socket,
+        Direction::In,
+        [&socket, datagrams, callback, interest] {
+            const size_t count = socket.recv_batch(*datagrams, DATAGRAM_BATCH);
+            for (size_t i = 0; i < count and (i == 0 or interest()); i++) {
+                callback((*datagrams)[i].source_address, (*datagrams)[i].payload);
+            }
+        },
+        interest,
+        cancel);
+}
+
+//! \param[in] socket is the UDPSocket to send from
+//! \param[in] destination is the Address to send to
+//! \param[in] payload is the datagram's payload (copied, with Backend::IoUring)
+void EventLoop::send_datagram(UDPSocket &socket, const Address &destination, const BufferViewList &payload) {
+#ifdef HAVE_IO_URING
+    if (_io_uring) {
+        _io_uring->post_send(socket, destination, payload);
+        return;
+    }
+#endif
+
+    socket.sendto(destination, payload);
+}
+
+//! \param[in] socket is the UDPSocket to send from
+//! \param[in] destination is the Address to send to
+//! \param[in] payloads are the datagrams' payloads (copied, with Backend::IoUring)
+void EventLoop::send_datagrams(UDPSocket &socket, const Address &destination, const vector<BufferViewList> &payloads) {
+#ifdef HAVE_IO_URING
+    if (_io_uring) {
+        for (const auto &payload : payloads) {
+            _io_uring->post_send(socket, destination, payload);
+        }
+        return;
+    }
+#endif
+
+    socket.sendto_batch(destination, payloads);
+}
+
+void EventLoop::flush_datagrams() {
+#ifdef HAVE_IO_URING
+    if (_io_uring) {
+        _io_uring->ring.submit_and_wait(0);
+    }
+#endif
+}
+
+//! \param[in] delay_ms is how long to wait before calling `callback`
+//! \param[in] callback is called once, from EventLoop::wait_next_event
+EventLoop::TimerId EventLoop::add_timer(const uint64_t delay_ms, const CallbackT &callback) {
+    const TimerId id = _next_timer_id++;
+    const uint64_t deadline = timestamp_ms() + delay_ms;
+    _timers.emplace(id, PendingTimer{deadline, 0, callback});
+    _timer_heap.emplace(deadline, id);
+    return id;
+}
+
+//! \param[in] period_ms is the time between calls to `callback`
+//! \param[in] callback is called from EventLoop::wait_next_event until the timer is canceled
+EventLoop::TimerId EventLoop::add_periodic_timer(const uint64_t period_ms, const CallbackT &callback) {
+    if (period_ms == 0) {
+        throw invalid_argument("EventLoop: a periodic timer needs a positive period");
+    }
+    const TimerId id = add_timer(period_ms, callback);
+    _timers.at(id).period_ms = period_ms;
+    return id;
+}
+
+void EventLoop::cancel_timer(const TimerId id) {
+    _timers.erase(id);
+
+    // a timer that is rescheduled over and over (e.g. a retransmission timer) leaves many stale entries
+    if (_timer_heap.size() > 2 * _timers.size() + 64) {
+        vector<pair<uint64_t, TimerId>> entries;
+        entries.reserve(_timers.size());
+        for (const auto &[timer_id, timer] : _timers) {
+            entries.emplace_back(timer.deadline_ms, timer_id);
+        }
+        _timer_heap = decltype(_timer_heap)(greater<pair<uint64_t, TimerId>>(), move(entries));
+    }
+}
+
+int EventLoop::_timeout_for_timers(const int timeout_ms) {
+    // drop the entries of canceled timers, so that they don't cut the wait short
+    while (not _timer_heap.empty()) {
+        const auto timer = _timers.find(_timer_heap.top().second);
+        if (timer != _timers.end() and timer->second.deadline_ms == _timer_heap.top().first) {
+            break;
+        }
+        _timer_heap.pop();
+    }
+    if (_timer_heap.empty()) {
+        return timeout_ms;
+    }
+
+    const uint64_t now = timestamp_ms();
+    const uint64_t deadline = _timer_heap.top().first;
+    const uint64_t until_deadline = deadline > now ? deadline - now : 0;
+    if (timeout_ms >= 0 and static_cast<uint64_t>(timeout_ms) <= until_deadline) {
+        return timeout_ms;
+    }
+    return static_cast<int>(min(until_deadline, static_cast<uint64_t>(numeric_limits<int>::max())));
+}
+
+bool EventLoop::_run_due_timers() {
+    if (_timers.empty()) {
+        return false;
+    }
+
+    // take the due timers off the heap first, so that a timer added by a callback waits for the next call
+    const uint64_t now = timestamp_ms();
+    _due_timers.clear();
+    while (not _timer_heap.empty() and _timer_heap.top().first <= now) {
+        _due_timers.push_back(_timer_heap.top());
+        _timer_heap.pop();
+    }
+
+    bool fired = false;
+    for (const auto &[deadline, id] : _due_timers) {
+        const auto timer = _timers.find(id);
+        if (timer == _timers.end() or timer->second.deadline_ms != deadline) {
+            continue;  // canceled, possibly by an earlier callback
+        }
+        fired = true;
+
+        // the callback may cancel its own timer, so it runs from a copy
+        CallbackT callback;
+        if (timer->second.period_ms == 0) {
+            callback = move(timer->second.callback);
+            _timers.erase(timer);
+        } else {
+            callback = timer->second.callback;
+            auto &next_deadline = timer->second.deadline_ms;
+            next_deadline += timer->second.period_ms;
+            if (next_deadline <= now) {
+                next_deadline = now + timer->second.period_ms;  // skip the periods that were missed
+            }
+            _timer_heap.emplace(next_deadline, id);
+        }
+        callback();
+    }
+    return fired;
+}
+
+list<EventLoop::Rule>::iterator EventLoop::_cancel(const list<Rule>::iterator it) {
+    it->cancel();
+    if (it->registered) {
+        const auto registration = _registrations.find(it->fd.fd_num());
+        auto &rules = registration->second.rules;
+        rules.erase(find(rules.begin(), rules.end(), it));
+        if (not rules.empty()) {
+            _changed.push_back(it->fd.fd_num());
+        } else {
+            // closing an fd takes it out of the epoll instance (and its number may already be reused)
+            if (registration->second.always_ready) {
+                _always_ready_count--;
+            } else if (_io_uring) {
+#ifdef HAVE_IO_URING
+                if (registration->second.poll_id != 0 and registration->second.poll_id != IoUringState::PARKED) {
+                    _io_uring->post_cancel(IoUringState::user_data(IoUringState::POLL, registration->second.poll_id));
+                }
+#endif
+            } else if (not it->fd.closed()) {
+                SystemCall("epoll_ctl", ::epoll_ctl(_epoll_fd->fd_num(), EPOLL_CTL_DEL, it->fd.fd_num(), nullptr));
+            }
+            _registrations.erase(registration);
+        }
+    }
+    return _rules.erase(it);
+}
+
+void EventLoop::_serve(const Rule &rule) {
+    const auto count_before = rule.service_count();
+    rule.callback();
+
+    // only check for busy wait if we're not canceling or exiting
+    if (count_before == rule.service_count() and rule.interest()) {
+        throw runtime_error("EventLoop: busy wait detected: callback did not read/write fd and is still interested");
+    }
+}
+
 //! \param[in] timeout_ms is the timeout value passed to [poll(2)](\ref man2::poll); `wait_next_event`
 //!                       returns Result::Timeout if no fd is ready after the timeout expires.
 //! \returns Eventloop::Result indicating success, timeout, or no more Rule objects to poll.
@@ -37,18 +485,20 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //! writability (if Rule::direction == Direction::Out) unless Rule::fd has reached EOF, in which case
 //! the Rule is canceled (i.e., deleted from EventLoop::_rules).
 //!
-//! Next, this function calls [poll(2)](\ref man2::poll) with timeout value `timeout_ms`.
+//! Next, this function calls [poll(2)](\ref man2::poll) with timeout value `timeout_ms`, or less if a
+//! timer is due sooner.
 //!
 //! Then, for each ready file descriptor, this function calls Rule::callback. If fd reaches EOF or
 //! if the Rule was registered using EventLoop::add_cancelable_rule and Rule::callback returns true,
-//! this Rule is canceled.
+//! this Rule is canceled. After that, it calls the callback of each timer that is due.
 //!
 //! If an error occurs during polling, this function throws a std::runtime_error.
 //!
-//! If a [signal(7)](\ref man7::signal) was caught during polling or if EventLoop::_rules becomes empty,
-//! this function returns Result::Exit.
+//! If a [signal(7)](\ref man7::signal) was caught during polling, or if EventLoop::_rules becomes empty
+//! (or no Rule is interested) and no timer is pending, this function returns Result::Exit.
 //!
-//! If a timeout occurred while polling (i.e., no fd became ready), this function returns Result::Timeout.
+//! If a timeout occurred while polling (i.e., no fd became ready) and no timer was due, this function
+//! returns Result::Timeout.
 //!
 //! Otherwise, this function returns Result::Success.
 //!
@@ -59,6 +509,25 @@ void EventLoop::add_rule(const FileDescriptor &fd,
 //! will result in a busy loop (poll returns on a ready file descriptor; file descriptor is not read or
 //! written, so it is still ready; the next call to poll will immediately return).
 EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
+    const int timeout = _timeout_for_timers(timeout_ms);
+    Result result;
+    switch (_backend) {
+        case Backend::Epoll:
+            result = _wait_epoll(timeout);
+            break;
+        case Backend::IoUring:
+            result = _wait_io_uring(timeout);
+            break;
+        default:
+            result = _wait_poll(timeout);
+    }
+    if (result == Result::Exit) {
+        return result;
+    }
+    return _run_due_timers() ? Result::Success : result;
+}
+
+EventLoop::Result EventLoop::_wait_poll(const int timeout_ms) {
     vector<pollfd> pollfds{};
     pollfds.reserve(_rules.size());
     bool something_to_poll = false;
@@ -88,8 +557,8 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
         ++it;
     }
 
-    // quit if there is nothing left to poll
-    if (not something_to_poll) {
+    // quit if there is nothing left to poll (or to wait for)
+    if (not something_to_poll and _timers.empty()) {
         return Result::Exit;
     }
 
@@ -117,10 +586,11 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
         const auto &this_rule = *it;
         const auto poll_ready = static_cast<bool>(this_pollfd.revents & this_pollfd.events);
         const auto poll_hup = static_cast<bool>(this_pollfd.revents & POLLHUP);
-        if (poll_hup && this_pollfd.events && !poll_ready) {
+        if (poll_hup && !poll_ready && (this_pollfd.events || this_rule.direction == Direction::Out)) {
             // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
             //   - if it was POLLIN and nothing is readable, no more will ever be readable
             //   - if it was POLLOUT, it will not be writable again
+            // the latter holds even if we didn't ask, and poll would otherwise keep reporting the hangup
             this_rule.cancel();
             it = _rules.erase(it);
             continue;
@@ -128,18 +598,327 @@ EventLoop::Result EventLoop::wait_next_event(const int timeout_ms) {
 
         if (poll_ready) {
             // we only want to call callback if revents includes the event we asked for
-            const auto count_before = this_rule.service_count();
-            this_rule.callback();
+            _serve(this_rule);
+        }
+
+        ++it;  // if we got here, it means we didn't call _rules.erase()
+    }
+
+    return Result::Success;
+}
+
+uint32_t EventLoop::Registration::requested_events() const {
+    uint32_t requested = 0;
+    for (const auto &rule : rules) {
+        if (rule->requested) {
+            requested |= rule->direction == Direction::In ? EPOLLIN : EPOLLOUT;
+        }
+    }
+    return requested;
+}
 
-            // only check for busy wait if we're not canceling or exiting
-            if (count_before == this_rule.service_count() and this_rule.interest()) {
-                throw runtime_error(
-                    "EventLoop: busy wait detected: callback did not read/write fd and is still interested");
+void EventLoop::_cancel_finished_rules() {
+    // cancel the finished rules first, so a closed fd's registration is gone before another fd
+    // with the same number is registered
+    for (auto it = _rules.begin(); it != _rules.end();) {
+        if ((it->direction == Direction::In and it->fd.eof()) or it->fd.closed()) {
+            it = _cancel(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool EventLoop::_update_registrations() {
+    bool something_to_poll = false;
+    for (auto it = _rules.begin(); it != _rules.end(); ++it) {
+        if (not it->registered) {
+            const int fd_num = it->fd.fd_num();
+            auto registration = _registrations.find(fd_num);
+            if (registration == _registrations.end()) {
+                bool refused = false;
+                if (_epoll_fd.has_value()) {
+                    epoll_event event{};
+                    event.data.fd = fd_num;
+                    const int added = ::epoll_ctl(_epoll_fd->fd_num(), EPOLL_CTL_ADD, fd_num, &event);
+                    refused = SystemCall("epoll_ctl", added, EPERM) < 0;
+                }
+                registration = _registrations.emplace(fd_num, Registration{}).first;
+                registration->second.always_ready = refused;
+                _always_ready_count += refused;
             }
+            registration->second.rules.push_back(it);
+            it->registered = true;
+            it->requested = false;
+        }
+        const bool requested = it->interest();
+        if (requested != it->requested) {
+            it->requested = requested;
+            _changed.push_back(it->fd.fd_num());
         }
+        something_to_poll |= requested;
+    }
+    return something_to_poll;
+}
 
-        ++it;  // if we got here, it means we didn't call _rules.erase()
+void EventLoop::_serve_ready() {
+    for (const auto &[rule, events] : _ready) {
+        if (events & EPOLLERR) {
+            throw runtime_error("EventLoop: error on polled file descriptor");
+        }
+
+        const uint32_t wanted = rule->direction == Direction::In ? EPOLLIN : EPOLLOUT;
+        const bool ready = rule->requested and (events & wanted);
+        if ((events & EPOLLHUP) and (rule->requested or rule->direction == Direction::Out) and not ready) {
+            // as with poll: the only condition was a hangup, so this fd is defunct
+            _cancel(rule);
+            continue;
+        }
+
+        if (ready) {
+            _serve(*rule);
+        }
+    }
+}
+
+EventLoop::Result EventLoop::_wait_epoll(const int timeout_ms) {
+    _cancel_finished_rules();
+    const bool something_to_poll = _update_registrations();
+
+    // quit if there is nothing left to poll (or to wait for)
+    if (not something_to_poll and _timers.empty()) {
+        return Result::Exit;
+    }
+
+    // tell epoll about the fds whose interest changed (errors and hangups are always reported)
+    for (const int fd_num : _changed) {
+        const auto registration = _registrations.find(fd_num);
+        if (registration == _registrations.end()) {
+            continue;
+        }
+        const uint32_t events = registration->second.requested_events();
+        if (events != registration->second.events and not registration->second.always_ready) {
+            epoll_event event{};
+            event.events = events;
+            event.data.fd = fd_num;
+            SystemCall("epoll_ctl", ::epoll_ctl(_epoll_fd->fd_num(), EPOLL_CTL_MOD, fd_num, &event));
+        }
+        registration->second.events = events;
+    }
+    _changed.clear();
+
+    bool always_ready = false;
+    if (_always_ready_count > 0) {
+        for (const auto &[fd_num, registration] : _registrations) {
+            always_ready |= registration.always_ready and registration.events != 0;
+        }
+    }
+
+    // wait (but not if an fd that epoll cannot watch is wanted: it is ready now)
+    _epoll_events.resize(max<size_t>(_registrations.size(), 1));
+    int ready_count = 0;
+    try {
+        ready_count = SystemCall("epoll_wait",
+                                 ::epoll_wait(_epoll_fd->fd_num(),
+                                              _epoll_events.data(),
+                                              static_cast<int>(_epoll_events.size()),
+                                              always_ready ? 0 : timeout_ms));
+    } catch (unix_error const &e) {
+        if (e.code().value() == EINTR) {
+            return Result::Exit;
+        }
+        throw;
+    }
+
+    // only the rules on ready fds need to be looked at
+    _ready.clear();
+    for (int i = 0; i < ready_count; i++) {
+        const uint32_t events = _epoll_events[i].events;  // (a copy: the struct is packed)
+        const auto registration = _registrations.find(_epoll_events[i].data.fd);
+        if (registration != _registrations.end()) {
+            for (const auto &rule : registration->second.rules) {
+                _ready.emplace_back(rule, events);
+            }
+        }
+    }
+    if (always_ready) {
+        for (const auto &[fd_num, registration] : _registrations) {
+            for (const auto &rule : registration.rules) {
+                if (registration.always_ready and rule->requested) {
+                    _ready.emplace_back(rule, registration.events);
+                }
+            }
+        }
+    }
+    if (_ready.empty()) {
+        return Result::Timeout;
+    }
+
+    _serve_ready();
+    return Result::Success;
+}
+
+#ifdef HAVE_IO_URING
+
+EventLoop::Result EventLoop::_wait_io_uring(const int timeout_ms) {
+    auto &state = *_io_uring;
+    _cancel_finished_rules();
+    bool something_to_poll = _update_registrations();
+
+    // post a receive for each interested datagram rule, and cancel the others' (datagrams wait in the socket)
+    bool undelivered = false;
+    for (auto it = state.datagram_rules.begin(); it != state.datagram_rules.end();) {
+        if (it->fd.closed()) {
+            it = state.cancel_rule(it);
+            continue;
+        }
+        it->requested = it->interest();
+        if (it->requested) {
+            something_to_poll = true;
+            undelivered |= not it->received.empty();
+            if (it->receive_id == 0) {
+                state.post_receive(it);
+            }
+        } else if (it->receive_id != 0) {
+            state.post_cancel(IoUringState::user_data(IoUringState::RECEIVE, it->receive_id));
+            it->receive_id = 0;
+        }
+        ++it;
+    }
+
+    // quit if there is nothing left to poll (or to wait for), once the queued sends are out
+    if (not something_to_poll and _timers.empty()) {
+        state.ring.submit_and_wait(0);
+        return Result::Exit;
+    }
+
+    // a poll whose events changed is replaced; every fd is polled, even for no events, to see errors and hangups
+    for (const int fd_num : _changed) {
+        const auto registration = _registrations.find(fd_num);
+        if (registration == _registrations.end()) {
+            continue;
+        }
+        const uint32_t events = registration->second.requested_events();
+        auto &poll_id = registration->second.poll_id;
+        if (events != registration->second.events and poll_id != 0) {
+            if (poll_id != IoUringState::PARKED) {
+                state.post_cancel(IoUringState::user_data(IoUringState::POLL, poll_id));
+            }
+            poll_id = 0;
+        }
+        registration->second.events = events;
+    }
+    _changed.clear();
+    for (auto &[fd_num, registration] : _registrations) {
+        if (registration.poll_id == 0) {
+            registration.poll_id = state.next_id++;
+            state.post_poll(fd_num, registration.events, registration.poll_id);
+        }
+    }
+
+    // submit, and wait (but not if there are datagrams to deliver already)
+    if (not state.ring.submit_and_wait(undelivered ? 0 : timeout_ms)) {
+        return Result::Exit;
+    }
+
+    _ready.clear();
+    state.ring.for_each_completion([&](const io_uring_cqe &cqe) {
+        const uint64_t id = cqe.user_data >> IoUringState::KIND_BITS;
+        const bool more = cqe.flags & IORING_CQE_F_MORE;
+        if (not more) {
+            state.in_flight--;
+        }
+
+        switch (cqe.user_data & ((1 << IoUringState::KIND_BITS) - 1)) {
+            case IoUringState::POLL: {
+                const auto poll = state.polls.find(id);
+                const auto registration = _registrations.find(poll->second);
+                state.polls.erase(poll);
+                if (registration == _registrations.end() or registration->second.poll_id != id) {
+                    return;  // canceled
+                }
+                registration->second.poll_id = 0;
+                if (cqe.res < 0) {
+                    throw unix_error("io_uring poll", -cqe.res);
+                }
+                if ((cqe.res & (registration->second.events | POLLERR | POLLHUP)) == 0) {
+                    // only POLLRDHUP, which io_uring always reports (and would report again at once)
+                    registration->second.poll_id = IoUringState::PARKED;
+                    return;
+                }
+                for (const auto &rule : registration->second.rules) {
+                    _ready.emplace_back(rule, static_cast<uint32_t>(cqe.res));
+                }
+                return;
+            }
+            case IoUringState::RECEIVE: {
+                const auto receive = state.receives.find(id);
+                if (cqe.flags & IORING_CQE_F_BUFFER) {
+                    const auto buffer_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    if (receive != state.receives.end() and cqe.res >= 0) {
+                        receive->second->received.emplace_back(buffer_id, cqe.res);
+                    } else {
+                        state.ring.recycle_buffer(buffer_id);
+                    }
+                }
+                if (not more and receive != state.receives.end()) {
+                    // the receive stopped (when canceled, or out of buffers): post another if still interested
+                    if (receive->second->receive_id == id) {
+                        receive->second->receive_id = 0;
+                    }
+                    state.receives.erase(receive);
+                }
+                if (cqe.res < 0 and cqe.res != -ENOBUFS and cqe.res != -ECANCELED) {
+                    throw unix_error("io_uring recvmsg", -cqe.res);
+                }
+                return;
+            }
+            case IoUringState::SEND: {
+                auto &send = *state.sends.at(id);
+                const size_t size = send.payload.size();
+                send.fd.reset();
+                state.free_sends.push_back(id);
+                if (cqe.res < 0) {
+                    throw unix_error("io_uring sendmsg", -cqe.res);
+                }
+                if (static_cast<size_t>(cqe.res) != size) {
+                    throw runtime_error("datagram payload too big for sendmsg()");
+                }
+                return;
+            }
+            default:
+                return;  // a cancelation, which may have found nothing to cancel
+        }
+    });
+
+    // deliver the datagrams (each buffer holds an io_uring_recvmsg_out, the source address, and the payload)
+    bool delivered = false;
+    for (auto &rule : state.datagram_rules) {
+        while (rule.requested and not rule.received.empty() and rule.interest()) {
+            const auto [buffer_id, length] = rule.received.front();
+            rule.received.pop_front();
+            const char *const buffer = state.ring.buffer(buffer_id);
+            const auto *const out = reinterpret_cast<const io_uring_recvmsg_out *>(buffer);
+            const size_t payload_offset = sizeof(*out) + rule.header.msg_namelen + rule.header.msg_controllen;
+            if (not(out->flags & MSG_TRUNC) and out->namelen <= rule.header.msg_namelen and length >= payload_offset) {
+                const Address source(reinterpret_cast<const sockaddr *>(buffer + sizeof(*out)), out->namelen);
+                delivered = true;
+                rule.callback(source, string_view(buffer + payload_offset, length - payload_offset));
+            }
+            state.ring.recycle_buffer(buffer_id);
+        }
+    }
+
+    if (_ready.empty() and not delivered) {
+        return Result::Timeout;
     }
 
+    _serve_ready();
     return Result::Success;
 }
+
+#else
+
+EventLoop::Result EventLoop::_wait_io_uring(const int) { throw runtime_error("EventLoop: built without io_uring support"); }
+
+#endif  // HAVE_IO_URING
@@ -1,12 +1,24 @@
 #ifndef SPONGE_LIBSPONGE_EVENTLOOP_HH
 #define SPONGE_LIBSPONGE_EVENTLOOP_HH
 
+#include "address.hh"
+#include "buffer.hh"
 #include "file_descriptor.hh"
+#include "socket.hh"
 
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <list>
+#include <memory>
+#include <optional>
 #include <poll.h>
+#include <queue>
+#include <string_view>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop {
@@ -17,6 +29,18 @@ class EventLoop {
         Out = POLLOUT  //!< Callback will be triggered when Rule::fd is writable.
     };
 
+    //! The system call that an EventLoop waits with.
+    enum class Backend {
+        Poll,  //!< [poll(2)](\ref man2::poll), given every Rule's fd on every call: simple, fine for a few fds.
+        Epoll,  //!< [epoll(7)](\ref man7::epoll), with fds registered once: the cost of a wakeup does not grow
+                //!< with the number of idle fds.
+        IoUring  //!< [io_uring(7)](\ref man7::io_uring): like Epoll, and datagram rules receive and send without a
+                 //!< system call per datagram. Needs a kernel that supports it (see EventLoop::io_uring_supported).
+    };
+
+    //! Called with each datagram that a datagram rule receives; `payload` is only valid during the call.
+    using DatagramCallbackT = std::function<void(const Address &source, std::string_view payload)>;
+
   private:
     using CallbackT = std::function<void(void)>;  //!< Callback for ready Rule::fd
     using InterestT = std::function<bool(void)>;  //!< `true` return indicates Rule::fd should be polled.
@@ -31,6 +55,12 @@ class EventLoop {
         InterestT interest;   //!< A callback that returns `true` whenever fd should be polled.
         CallbackT cancel;     //!< A callback that is called when the rule is cancelled (e.g. on hangup)
 
+        //! \name Used internally by the epoll backend
+        //!@{
+        bool registered = false;  //!< Has fd been registered with the epoll instance for this rule?
+        bool requested = false;   //!< Did interest return `true` in this call to EventLoop::wait_next_event?
+        //!@}
+
         //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
         //! \details This function is used internally by EventLoop; you will not need to call it
         unsigned int service_count() const;
@@ -38,12 +68,89 @@ class EventLoop {
 
     std::list<Rule> _rules{};  //!< All rules that have been added and not canceled.
 
+    Backend _backend;
+
+    //! \brief An fd registered with the epoll instance (or polled by the io_uring instance), and the rules that watch it
+    //! \details Several rules (e.g. one per Direction) can watch the same fd, but epoll registers each fd once.
+    struct Registration {
+        uint32_t events = 0;       //!< The events that epoll is currently asked to report
+        bool always_ready = false;  //!< epoll refused the fd (e.g. a regular file), which poll(2) reports always ready
+        uint64_t poll_id = 0;      //!< The io_uring poll for `events` that has not completed, 0 if none (or parked)
+        std::vector<std::list<Rule>::iterator> rules{};
+
+        //! The events that the rules on the fd are interested in
+        uint32_t requested_events() const;
+    };
+
+    //! \name Epoll backend state
+    //!@{
+    std::optional<FileDescriptor> _epoll_fd{};
+    std::unordered_map<int, Registration> _registrations{};  //!< by fd number
+    std::vector<int> _changed{};  //!< fds whose rules' interest may have changed since epoll was last told
+    size_t _always_ready_count = 0;  //!< registrations that epoll refused
+    std::vector<epoll_event> _epoll_events{};
+    std::vector<std::pair<std::list<Rule>::iterator, uint32_t>> _ready{};  //!< rules and the events on their fds
+    //!@}
+
+    //! The state of the io_uring backend (see eventloop.cc)
+    class IoUringState;
+    std::unique_ptr<IoUringState> _io_uring{};
+
+    //! Calls Rule::cancel and deletes the rule, returning the next one.
+    std::list<Rule>::iterator _cancel(const std::list<Rule>::iterator it);
+
+    //! \name Used by the epoll and io_uring backends
+    //!@{
+
+    //! Cancels the rules whose fds reached EOF or were closed.
+    void _cancel_finished_rules();
+
+    //! Registers the fds of new rules and asks every rule whether it is interested, returning whether any is.
+    bool _update_registrations();
+
+    //! Serves (or cancels, after a hangup) the rules in EventLoop::_ready.
+    void _serve_ready();
+    //!@}
+
+    //! Runs the callback of a ready rule and checks that it did not leave the loop busy-waiting.
+    static void _serve(const Rule &rule);
+
+  public:
+    //! Identifies a timer added with EventLoop::add_timer or EventLoop::add_periodic_timer.
+    using TimerId = uint64_t;
+
+  private:
+    //! A timer that has been added and not canceled (or, if one-shot, fired).
+    struct PendingTimer {
+        uint64_t deadline_ms;  //!< When the timer is next due, as a timestamp_ms()
+        uint64_t period_ms;    //!< 0 for a one-shot timer
+        CallbackT callback;
+    };
+
+    std::unordered_map<TimerId, PendingTimer> _timers{};
+    TimerId _next_timer_id = 0;
+    std::vector<std::pair<uint64_t, TimerId>> _due_timers{};  //!< (deadline, id) of the timers being run
+
+    //! \brief (deadline, id) of each timer, earliest first
+    //! \details Canceling a timer leaves its entry here; stale entries are dropped when they reach the top,
+    //! or all at once when they outnumber the timers.
+    std::priority_queue<std::pair<uint64_t, TimerId>,
+                        std::vector<std::pair<uint64_t, TimerId>>,
+                        std::greater<std::pair<uint64_t, TimerId>>>
+        _timer_heap{};
+
+    //! The timeout to wait with: `timeout_ms`, or less if a timer is due sooner.
+    int _timeout_for_timers(const int timeout_ms);
+
+    //! Runs the callbacks of the timers that are due, returning whether there were any.
+    bool _run_due_timers();
+
   public:
     //! Returned by each call to EventLoop::wait_next_event.
     enum class Result {
-        Success,  //!< At least one Rule was triggered.
-        Timeout,  //!< No rules were triggered before timeout.
-        Exit  //!< All rules have been canceled or were uninterested; make no further calls to EventLoop::wait_next_event.
+        Success,  //!< At least one Rule or timer was triggered.
+        Timeout,  //!< No rules or timers were triggered before timeout.
+        Exit  //!< All rules have been canceled or were uninterested and no timers are pending; make no further calls to EventLoop::wait_next_event.
     };
 
     //! Add a rule whose callback will be called when `fd` is ready in the specified Direction.
@@ -53,8 +160,63 @@ class EventLoop {
                   const InterestT &interest = [] { return true; },
                   const CallbackT &cancel = [] {});
 
-    //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+    //! \brief Add a rule whose callback will be called with each datagram that `socket` receives.
+    //! \details With the poll and epoll backends, each wakeup receives up to DATAGRAM_BATCH datagrams with one
+    //! [recvmmsg(2)](\ref man2::recvmmsg); if `interest` stops returning `true` partway, the rest are dropped.
+    void add_datagram_rule(UDPSocket &socket,
+                           const DatagramCallbackT &callback,
+                           const InterestT &interest = [] { return true; },
+                           const CallbackT &cancel = [] {});
+
+    //! \brief Send a datagram from `socket` to `destination`
+    //! \details With Backend::IoUring, the datagram is sent by the next call to EventLoop::wait_next_event,
+    //! together with any others.
+    void send_datagram(UDPSocket &socket, const Address &destination, const BufferViewList &payload);
+
+    //! \brief Send datagrams from `socket` to `destination`
+    //! \details With the poll and epoll backends, many go with each [sendmmsg(2)](\ref man2::sendmmsg) call.
+    void send_datagrams(UDPSocket &socket, const Address &destination, const std::vector<BufferViewList> &payloads);
+
+    //! The most datagrams that a datagram rule receives per system call, with the poll and epoll backends
+    static constexpr size_t DATAGRAM_BATCH = 32;
+
+    //! Send the datagrams that EventLoop::send_datagram queued now, rather than with the next wait.
+    void flush_datagrams();
+
+    //! \brief Call `callback` once, from EventLoop::wait_next_event, `delay_ms` milliseconds from now
+    //! \returns an id for EventLoop::cancel_timer
+    TimerId add_timer(const uint64_t delay_ms, const CallbackT &callback);
+
+    //! \brief Call `callback` every `period_ms` milliseconds (which must be positive), starting `period_ms` from now
+    //! \returns an id for EventLoop::cancel_timer
+    TimerId add_periodic_timer(const uint64_t period_ms, const CallbackT &callback);
+
+    //! \brief Stop a timer from firing (again)
+    //! \details Canceling a timer that already fired or was canceled has no effect.
+    void cancel_timer(const TimerId id);
+
+    //! Waits for an event (see Backend) or for the next timer, and then executes callback for each ready fd
+    //! and each timer that is due.
     Result wait_next_event(const int timeout_ms);
+
+    //! \param[in] backend is the system call to wait with
+    explicit EventLoop(const Backend backend = Backend::Poll);
+
+    //! Waits for the io_uring backend's operations to finish, so that the kernel is done with their buffers.
+    ~EventLoop();
+
+    //! \brief Can an EventLoop use Backend::IoUring?
+    //! \details Only if sponge was built with HAVE_IO_URING (detected by cmake), and the running kernel supports
+    //! (and permits) the features that the backend uses.
+    static bool io_uring_supported();
+
+  private:
+    //! The implementations of wait_next_event for each Backend.
+    //!@{
+    Result _wait_poll(const int timeout_ms);
+    Result _wait_epoll(const int timeout_ms);
+    Result _wait_io_uring(const int timeout_ms);
+    //!@}
 };
 
 using Direction = EventLoop::Direction;
@@ -72,5 +234,26 @@ using Direction = EventLoop::Direction;
 //! A Rule installed using EventLoop::add_cancelable_rule will be polled and canceled under the
 //! same conditions, with the additional condition that if Rule::callback returns `true`, the
 //! Rule will be canceled.
+//!
+//! With Backend::Epoll, each fd is registered with an [epoll(7)](\ref man7::epoll) instance the first time
+//! it is waited on, and stays registered until its last Rule is canceled. Every call still asks each Rule
+//! whether it is interested, but only tells the kernel when the answer changes, and only looks at the rules
+//! whose fds are ready. The rules behave exactly as with Backend::Poll.
+//!
+//! With Backend::IoUring, the EventLoop asks an [io_uring(7)](\ref man7::io_uring) instance to poll each
+//! interested fd (once until it is ready) and waits for the completions, so the rules again behave exactly
+//! as with Backend::Poll. A rule added with EventLoop::add_datagram_rule keeps a multishot receive posted
+//! on its socket while it is interested, into buffers that the kernel picks from a ring it shares with the
+//! EventLoop, and EventLoop::send_datagram only queues its datagram: one system call per wait submits the
+//! sends and the polls and collects every datagram received since the last. With the other backends, a
+//! datagram rule is an ordinary rule that receives up to DATAGRAM_BATCH datagrams with one
+//! [recvmmsg(2)](\ref man2::recvmmsg) whenever its socket is readable, EventLoop::send_datagram sends
+//! immediately, and EventLoop::send_datagrams sends its datagrams with as few
+//! [sendmmsg(2)](\ref man2::sendmmsg) calls as it can.
+//!
+//! Timers (EventLoop::add_timer and EventLoop::add_periodic_timer) fire from EventLoop::wait_next_event,
+//! after the ready rules have been served: the wait ends when the earliest timer is due, even if no fd is
+//! ready and no Rule is interested. Timers have millisecond resolution, and a timer that is due in a call
+//! fires once even if its period has elapsed several times.
 
 #endif  // SPONGE_LIBSPONGE_EVENTLOOP_HH
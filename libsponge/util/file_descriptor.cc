@@ -3,8 +3,10 @@
 #include "util.hh"
 
 #include <algorithm>
+#include <climits>
 #include <fcntl.h>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <sys/uio.h>
 #include <unistd.h>
@@ -49,16 +51,21 @@ FileDescriptor FileDescriptor::duplicate() const { return FileDescriptor(_intern
 void FileDescriptor::read(std::string &str, const size_t limit) {
     constexpr size_t BUFFER_SIZE = 1024 * 1024;  // maximum size of a read
     const size_t size_to_read = min(BUFFER_SIZE, limit);
-    str.resize(size_to_read);
 
-    ssize_t bytes_read = SystemCall("read", ::read(fd_num(), str.data(), size_to_read));
+    // read into a buffer that is reused, rather than growing (and zero-filling) `str` to the maximum every time
+    thread_local unique_ptr<char[]> buffer;
+    if (not buffer) {
+        buffer = make_unique<char[]>(BUFFER_SIZE);
+    }
+
+    ssize_t bytes_read = SystemCall("read", ::read(fd_num(), buffer.get(), size_to_read));
     if (limit > 0 && bytes_read == 0) {
         _internal_fd->_eof = true;
     }
     if (bytes_read > static_cast<ssize_t>(size_to_read)) {
         throw runtime_error("read() read more than requested");
     }
-    str.resize(bytes_read);
+    str.assign(buffer.get(), bytes_read);
 
     register_read();
 }
@@ -79,7 +86,8 @@ size_t FileDescriptor::write(BufferViewList buffer, const bool write_all) {
     do {
         auto iovecs = buffer.as_iovecs();
 
-        const ssize_t bytes_written = SystemCall("writev", ::writev(fd_num(), iovecs.data(), iovecs.size()));
+        const int iovcnt = min(iovecs.size(), size_t(IOV_MAX));
+        const ssize_t bytes_written = SystemCall("writev", ::writev(fd_num(), iovecs.data(), iovcnt));
         if (bytes_written == 0 and buffer.size() != 0) {
             throw runtime_error("write returned 0 given non-empty input buffer");
         }
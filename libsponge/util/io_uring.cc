@@ -0,0 +1,151 @@
+#include "io_uring.hh"
+
+#ifdef HAVE_IO_URING
+
+#include "util.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+IoUring::Mapping::Mapping(const int fd, const size_t size, const uint64_t offset)
+    : _address(::mmap(nullptr,
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE,
+                      fd,
+                      static_cast<off_t>(offset)))
+    , _size(size) {
+    if (_address == reinterpret_cast<void *>(intptr_t(-1))) {
+        throw unix_error("mmap");
+    }
+}
+
+IoUring::Mapping::~Mapping() { ::munmap(_address, _size); }
+
+//! \param[in] entries is the size of the submission queue (the completion queue is twice as big)
+IoUring::IoUring(const unsigned entries) : IoUring(entries, io_uring_params{}) {}
+
+//! \param[in] entries is the size of the submission queue
+//! \param[in] params receives the offsets of the rings from [io_uring_setup(2)](\ref man2::io_uring_setup)
+IoUring::IoUring(const unsigned entries, io_uring_params &&params)
+    : _fd(SystemCall("io_uring_setup", static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params)))) {
+    // waiting with a timeout needs IORING_FEAT_EXT_ARG; without IORING_FEAT_NODROP, completions could be lost
+    constexpr unsigned needed = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if ((params.features & needed) != needed) {
+        throw unix_error("io_uring_setup", ENOSYS);
+    }
+
+    const size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _sq_ring = make_unique<Mapping>(_fd.fd_num(), max(sq_size, cq_size), IORING_OFF_SQ_RING);
+    } else {
+        _sq_ring = make_unique<Mapping>(_fd.fd_num(), sq_size, IORING_OFF_SQ_RING);
+        _cq_ring = make_unique<Mapping>(_fd.fd_num(), cq_size, IORING_OFF_CQ_RING);
+    }
+    _sqes = make_unique<Mapping>(_fd.fd_num(), params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES);
+
+    const Mapping &cq_ring = _cq_ring ? *_cq_ring : *_sq_ring;
+    _sq_tail = _sq_ring->at<unsigned>(params.sq_off.tail);
+    _sq_mask = *_sq_ring->at<unsigned>(params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    _sq_array = _sq_ring->at<unsigned>(params.sq_off.array);
+    _sqe_array = _sqes->at<io_uring_sqe>(0);
+    _cq_head = cq_ring.at<unsigned>(params.cq_off.head);
+    _cq_tail = cq_ring.at<unsigned>(params.cq_off.tail);
+    _cq_mask = *cq_ring.at<unsigned>(params.cq_off.ring_mask);
+    _cqe_array = cq_ring.at<io_uring_cqe>(params.cq_off.cqes);
+}
+
+io_uring_sqe &IoUring::sqe() {
+    if (_queued == _sq_entries) {
+        SystemCall("io_uring_enter", _enter(0, 0));
+    }
+
+    const unsigned tail = *_sq_tail + _queued;
+    const unsigned index = tail & _sq_mask;
+    _queued++;
+    _sq_array[index] = index;
+    io_uring_sqe &sqe = _sqe_array[index];
+    memset(&sqe, 0, sizeof(sqe));
+    return sqe;
+}
+
+int IoUring::_enter(const unsigned min_complete, const int timeout_ms) {
+    // publish the queued SQEs
+    const unsigned to_submit = _queued;
+    __atomic_store_n(_sq_tail, *_sq_tail + _queued, __ATOMIC_RELEASE);
+    _queued = 0;
+
+    __kernel_timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+    io_uring_getevents_arg arg{};
+    arg.ts = timeout_ms < 0 ? 0 : reinterpret_cast<uint64_t>(&timeout);
+    unsigned flags = IORING_ENTER_EXT_ARG;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    return static_cast<int>(
+        ::syscall(__NR_io_uring_enter, _fd.fd_num(), to_submit, min_complete, flags, &arg, sizeof(arg)));
+}
+
+bool IoUring::submit_and_wait(const int timeout_ms) {
+    if (timeout_ms == 0 and _queued == 0) {
+        return true;
+    }
+    const int result = _enter(timeout_ms == 0 ? 0 : 1, timeout_ms);
+    if (result < 0 and errno == EINTR) {
+        return false;
+    }
+    SystemCall("io_uring_enter", result, ETIME);
+    return true;
+}
+
+//! \param[in] group is the buffer group id, for io_uring_sqe::buf_group
+//! \param[in] count is the number of buffers, a power of two
+//! \param[in] size is the size of each buffer
+void IoUring::provide_buffers(const uint16_t group, const unsigned count, const size_t size) {
+    if (_buffer_ring) {
+        throw runtime_error("IoUring: buffers already provided");
+    }
+    if (count == 0 or (count & (count - 1)) != 0 or count > 32768) {
+        throw invalid_argument("IoUring: the number of buffers must be a power of two");
+    }
+
+    _buffer_ring = make_unique<Mapping>(-1, count * sizeof(io_uring_buf), 0);
+    _buffers = make_unique<Mapping>(-1, count * size, 0);
+    _buffer_count = count;
+    _buffer_size = size;
+
+    io_uring_buf_reg registration{};
+    registration.ring_addr = reinterpret_cast<uint64_t>(_buffer_ring->at<io_uring_buf>(0));
+    registration.ring_entries = count;
+    registration.bgid = group;
+    SystemCall("io_uring_register",
+               static_cast<int>(::syscall(__NR_io_uring_register, _fd.fd_num(), IORING_REGISTER_PBUF_RING, &registration, 1)));
+
+    for (unsigned id = 0; id < count; id++) {
+        recycle_buffer(id);
+    }
+}
+
+void IoUring::recycle_buffer(const uint16_t id) {
+    // the ring's tail overlays the `resv` field of its first entry
+    io_uring_buf *const ring = _buffer_ring->at<io_uring_buf>(0);
+    io_uring_buf &entry = ring[_buffer_tail & (_buffer_count - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(buffer(id));
+    entry.len = _buffer_size;
+    entry.bid = id;
+    _buffer_tail++;
+    __atomic_store_n(&ring[0].resv, _buffer_tail, __ATOMIC_RELEASE);
+}
+
+#endif  // HAVE_IO_URING
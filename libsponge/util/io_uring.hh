@@ -0,0 +1,128 @@
+#ifndef SPONGE_LIBSPONGE_IO_URING_HH
+#define SPONGE_LIBSPONGE_IO_URING_HH
+
+#ifdef HAVE_IO_URING
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <memory>
+
+//! \brief An [io_uring(7)](\ref man7::io_uring) instance, set up with raw system calls
+//! \details Submissions are queued with IoUring::sqe and go to the kernel with the next
+//! IoUring::submit_and_wait, so that many of them cost one system call.
+class IoUring {
+  private:
+    //! A region of memory shared with the kernel, unmapped on destruction
+    class Mapping {
+      private:
+        void *_address;
+        size_t _size;
+
+      public:
+        //! \brief Map `size` bytes of `fd` at `offset`, or anonymous memory if `fd` is negative
+        Mapping(const int fd, const size_t size, const uint64_t offset);
+        ~Mapping();
+
+        //! A pointer `offset` bytes into the region
+        template <typename T>
+        T *at(const size_t offset) const {
+            return reinterpret_cast<T *>(static_cast<char *>(_address) + offset);
+        }
+
+        //! \name A Mapping cannot be copied or moved
+        //!@{
+        Mapping(const Mapping &other) = delete;
+        Mapping &operator=(const Mapping &other) = delete;
+        //!@}
+    };
+
+    FileDescriptor _fd;
+    std::unique_ptr<Mapping> _sq_ring{};
+    std::unique_ptr<Mapping> _cq_ring{};  //!< empty if the kernel maps both rings together
+    std::unique_ptr<Mapping> _sqes{};
+
+    //! \name Submission queue
+    //!@{
+    unsigned *_sq_tail = nullptr;
+    unsigned _sq_mask = 0;
+    unsigned _sq_entries = 0;
+    unsigned *_sq_array = nullptr;
+    io_uring_sqe *_sqe_array = nullptr;
+    unsigned _queued = 0;  //!< SQEs handed out since the last submission
+    //!@}
+
+    //! \name Completion queue
+    //!@{
+    unsigned *_cq_head = nullptr;
+    unsigned *_cq_tail = nullptr;
+    unsigned _cq_mask = 0;
+    io_uring_cqe *_cqe_array = nullptr;
+    //!@}
+
+    //! \name Provided buffer ring (one buffer group)
+    //!@{
+    std::unique_ptr<Mapping> _buffer_ring{};
+    std::unique_ptr<Mapping> _buffers{};
+    unsigned _buffer_count = 0;
+    size_t _buffer_size = 0;
+    uint16_t _buffer_tail = 0;
+    //!@}
+
+    //! \brief Submits the queued SQEs with [io_uring_enter(2)](\ref man2::io_uring_enter), waiting for
+    //! `min_complete` completions or `timeout_ms`, and returns its result (or -1, with errno set)
+    int _enter(const unsigned min_complete, const int timeout_ms);
+
+    IoUring(const unsigned entries, io_uring_params &&params);
+
+  public:
+    //! \brief Set up an instance whose submission queue holds `entries` SQEs
+    //! \details Throws unix_error if the kernel lacks io_uring, or a feature that IoUring needs.
+    explicit IoUring(const unsigned entries);
+
+    //! \brief The next SQE to fill in (zeroed), submitting the queued ones first if the queue is full
+    io_uring_sqe &sqe();
+
+    //! \brief Submit the queued SQEs, and wait until there is a completion or `timeout_ms` passes
+    //! \details `timeout_ms` is as for [poll(2)](\ref man2::poll): negative waits indefinitely, and zero only submits.
+    //! \returns `false` if interrupted by a signal
+    bool submit_and_wait(const int timeout_ms);
+
+    //! \brief Call `f` with each completion that is ready, removing it from the completion queue
+    //! \returns the number of completions
+    template <typename F>
+    size_t for_each_completion(F &&f) {
+        unsigned head = *_cq_head;
+        const unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        const size_t count = tail - head;
+        for (; head != tail; head++) {
+            const io_uring_cqe cqe = _cqe_array[head & _cq_mask];
+            __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);  // f may submit and wait
+            f(cqe);
+        }
+        return count;
+    }
+
+    //! \brief Provide `count` buffers (a power of two) of `size` bytes each to the kernel as buffer group `group`
+    //! \details Operations with IOSQE_BUFFER_SELECT in this group pick a buffer, and report its id in their
+    //! completion; give it back with IoUring::recycle_buffer.
+    void provide_buffers(const uint16_t group, const unsigned count, const size_t size);
+
+    //! The buffer with id `id`
+    char *buffer(const uint16_t id) const { return _buffers->at<char>(id * _buffer_size); }
+
+    //! Give a buffer back to the kernel, once the data it received has been used
+    void recycle_buffer(const uint16_t id);
+
+    //! \name An IoUring cannot be copied or moved
+    //!@{
+    IoUring(const IoUring &other) = delete;
+    IoUring &operator=(const IoUring &other) = delete;
+    //!@}
+};
+
+#endif  // HAVE_IO_URING
+
+#endif  // SPONGE_LIBSPONGE_IO_URING_HH
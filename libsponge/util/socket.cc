@@ -2,6 +2,8 @@
 
 #include "util.hh"
 
+#include <algorithm>
+#include <climits>
 #include <cstddef>
 #include <stdexcept>
 #include <unistd.h>
@@ -88,14 +90,17 @@ void Socket::shutdown(const int how) {
 void UDPSocket::recv(received_datagram &datagram, const size_t mtu) {
     // receive source address and payload
     Address::Raw datagram_source_address;
-    datagram.payload.resize(mtu);
+
+    // receive into a buffer that is reused, so the payload is allocated (and copied) at its own size
+    thread_local string buffer;
+    if (buffer.size() < mtu) {
+        buffer.resize(mtu);
+    }
 
     socklen_t fromlen = sizeof(datagram_source_address);
 
     const ssize_t recv_len = SystemCall(
-        "recvfrom",
-        ::recvfrom(
-            fd_num(), datagram.payload.data(), datagram.payload.size(), MSG_TRUNC, datagram_source_address, &fromlen));
+        "recvfrom", ::recvfrom(fd_num(), buffer.data(), mtu, MSG_TRUNC, datagram_source_address, &fromlen));
 
     if (recv_len > ssize_t(mtu)) {
         throw runtime_error("recvfrom (oversized datagram)");
@@ -103,7 +108,51 @@ void UDPSocket::recv(received_datagram &datagram, const size_t mtu) {
 
     register_read();
     datagram.source_address = {datagram_source_address, fromlen};
-    datagram.payload.resize(recv_len);
+    datagram.payload.assign(buffer.data(), recv_len);
+}
+
+//! \note If `mtu` is too small to hold a received datagram, this method throws a std::runtime_error
+size_t UDPSocket::recv_batch(vector<received_datagram> &datagrams, const size_t max_datagrams, const size_t mtu) {
+    // receive into buffers that are reused, as in recv()
+    thread_local string buffer;
+    thread_local vector<Address::Raw> source_addresses;
+    thread_local vector<iovec> iovecs;
+    thread_local vector<mmsghdr> messages;
+    if (buffer.size() < max_datagrams * mtu) {
+        buffer.resize(max_datagrams * mtu);
+    }
+    source_addresses.resize(max_datagrams);
+    iovecs.resize(max_datagrams);
+    messages.resize(max_datagrams);
+    for (size_t i = 0; i < max_datagrams; i++) {
+        iovecs[i] = {buffer.data() + i * mtu, mtu};
+        messages[i] = {};
+        messages[i].msg_hdr.msg_name = static_cast<sockaddr *>(source_addresses[i]);
+        messages[i].msg_hdr.msg_namelen = sizeof(source_addresses[i].storage);
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // wait for the first datagram only
+    const int count = SystemCall(
+        "recvmmsg", ::recvmmsg(fd_num(), messages.data(), max_datagrams, MSG_WAITFORONE, nullptr));
+    register_read();
+
+    for (int i = 0; i < count; i++) {
+        const msghdr &header = messages[i].msg_hdr;
+        if (header.msg_flags & MSG_TRUNC) {
+            throw runtime_error("recvmmsg (oversized datagram)");
+        }
+        const Address source{source_addresses[i], header.msg_namelen};
+        const char *const payload = buffer.data() + i * mtu;
+        if (static_cast<size_t>(i) < datagrams.size()) {
+            datagrams[i].source_address = source;
+            datagrams[i].payload.assign(payload, messages[i].msg_len);
+        } else {
+            datagrams.push_back({source, string(payload, messages[i].msg_len)});
+        }
+    }
+    return count;
 }
 
 UDPSocket::received_datagram UDPSocket::recv(const size_t mtu) {
@@ -136,6 +185,32 @@ void UDPSocket::sendto(const Address &destination, const BufferViewList &payload
     register_write();
 }
 
+void UDPSocket::sendto_batch(const Address &destination, const vector<BufferViewList> &payloads) {
+    vector<vector<iovec>> iovecs;
+    vector<mmsghdr> messages(payloads.size());
+    iovecs.reserve(payloads.size());
+    for (size_t i = 0; i < payloads.size(); i++) {
+        iovecs.push_back(payloads[i].as_iovecs());
+        msghdr &header = messages[i].msg_hdr;
+        header.msg_name = const_cast<sockaddr *>(static_cast<const sockaddr *>(destination));
+        header.msg_namelen = destination.size();
+        header.msg_iov = iovecs.back().data();
+        header.msg_iovlen = iovecs.back().size();
+    }
+
+    // sendmmsg(2) may send fewer than asked (reporting an error with the next call)
+    for (size_t sent = 0; sent < messages.size();) {
+        const unsigned batch = min(messages.size() - sent, size_t(UIO_MAXIOV));
+        const int count = SystemCall("sendmmsg", ::sendmmsg(fd_num(), messages.data() + sent, batch, 0));
+        for (int i = 0; i < count; i++, sent++) {
+            if (messages[sent].msg_len != payloads[sent].size()) {
+                throw runtime_error("datagram payload too big for sendmmsg()");
+            }
+        }
+    }
+    register_write();
+}
+
 void UDPSocket::send(const BufferViewList &payload) {
     sendmsg_helper(fd_num(), nullptr, 0, payload);
     register_write();
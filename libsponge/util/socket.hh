@@ -8,6 +8,7 @@
 #include <functional>
 #include <string>
 #include <sys/socket.h>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
@@ -70,9 +71,17 @@ class UDPSocket : public Socket {
     //! Receive a datagram and the Address of its sender (caller can allocate storage)
     void recv(received_datagram &datagram, const size_t mtu = 65536);
 
+    //! \brief Receive up to `max_datagrams` datagrams that are waiting, with one system call
+    //! \details Blocks (if the socket is blocking) until there is at least one.
+    //! \returns the number of datagrams received, which are the first elements of `datagrams`
+    size_t recv_batch(std::vector<received_datagram> &datagrams, const size_t max_datagrams, const size_t mtu = 65536);
+
     //! Send a datagram to specified Address
     void sendto(const Address &destination, const BufferViewList &payload);
 
+    //! Send datagrams to specified Address, many per system call
+    void sendto_batch(const Address &destination, const std::vector<BufferViewList> &payloads);
+
     //! Send datagram to the socket's connected address (must call connect() first)
     void send(const BufferViewList &payload);
 };
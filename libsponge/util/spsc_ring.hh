@@ -0,0 +1,79 @@
+#ifndef SPONGE_LIBSPONGE_SPSC_RING_HH
+#define SPONGE_LIBSPONGE_SPSC_RING_HH
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+//! \brief A bounded, lock-free queue between exactly one producer thread and one consumer thread
+//!
+//! Only the producer may call push() and only the consumer may call pop(). Each side keeps a
+//! private copy of the other side's index and only reads the shared one when the ring looks
+//! full (or empty), so in the steady state the two threads do not contend for a cache line.
+template <typename T>
+class SPSCRing {
+  private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::vector<T> _slots;
+    size_t _mask;
+
+    //! next slot to read; written only by the consumer
+    alignas(CACHE_LINE) std::atomic<size_t> _head{0};
+    //! the consumer's copy of `_tail`
+    size_t _tail_cache{0};
+
+    //! next slot to write; written only by the producer
+    alignas(CACHE_LINE) std::atomic<size_t> _tail{0};
+    //! the producer's copy of `_head`
+    size_t _head_cache{0};
+
+    static size_t round_up_to_power_of_two(const size_t n) {
+        size_t ret = 1;
+        while (ret < n) {
+            ret <<= 1;
+        }
+        return ret;
+    }
+
+  public:
+    //! \param[in] capacity the most items the ring holds (rounded up to a power of two)
+    explicit SPSCRing(const size_t capacity)
+        : _slots(round_up_to_power_of_two(capacity)), _mask(_slots.size() - 1) {}
+
+    //! \brief Append an item (producer only)
+    //! \returns false, leaving `item` untouched, if the ring is full
+    bool push(T &&item) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head_cache == _slots.size()) {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if (tail - _head_cache == _slots.size()) {
+                return false;
+            }
+        }
+        _slots[tail & _mask] = std::move(item);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! \brief Remove the oldest item (consumer only)
+    //! \returns false if the ring is empty
+    bool pop(T &item) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail_cache) {
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            if (head == _tail_cache) {
+                return false;
+            }
+        }
+        item = std::move(_slots[head & _mask]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //! \brief The most items the ring holds
+    size_t capacity() const { return _slots.size(); }
+};
+
+#endif  // SPONGE_LIBSPONGE_SPSC_RING_HH
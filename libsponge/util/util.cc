@@ -3,11 +3,16 @@
 #include <array>
 #include <cctype>
 #include <chrono>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <sys/socket.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 //! \returns the number of milliseconds since the program started
@@ -86,16 +91,163 @@ mt19937 get_random_generator() {
 //! on the Internet checksum, and consult the [IP](\ref rfc::rfc791) and [TCP](\ref rfc::rfc793) RFCs.
 InternetChecksum::InternetChecksum(const uint32_t initial_sum) : _sum(initial_sum) {}
 
-void InternetChecksum::add(std::string_view data) {
-    for (size_t i = 0; i < data.size(); i++) {
-        uint16_t val = uint8_t(data[i]);
-        if (not _parity) {
-            val <<= 8;
+namespace {
+
+//! Fold a one's-complement sum down to 16 bits (end-around carry)
+uint16_t fold_sum(uint64_t sum) {
+    while (sum > 0xffff) {
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+    return sum;
+}
+
+//! \brief One's-complement sum of the 16-bit words at `data`, loaded in host byte order;
+//! if `COPY`, the bytes are also copied to `dest` as they are summed
+//! \details The one's-complement sum commutes with byte swapping, so the caller can swap the
+//! folded result instead of every word. `len` must be even.
+template <bool COPY>
+uint16_t sum_words_scalar(const uint8_t *data, size_t len, uint8_t *dest) {
+    uint64_t sum = 0;
+    for (; len >= 8; data += 8, dest += COPY ? 8 : 0, len -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        if (COPY) {
+            memcpy(dest, &word, sizeof(word));
+        }
+        sum += word;
+        sum += (sum < word);  // end-around carry (cannot overflow again)
+    }
+    for (; len >= 2; data += 2, dest += COPY ? 2 : 0, len -= 2) {
+        uint16_t word;
+        memcpy(&word, data, sizeof(word));
+        if (COPY) {
+            memcpy(dest, &word, sizeof(word));
+        }
+        sum += word;
+        sum += (sum < word);
+    }
+    return fold_sum(sum);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+//! Blocks a vector accumulator of 32-bit lanes can take: each block adds at most 2 * 0xffff to a lane
+constexpr size_t MAX_SIMD_BLOCKS = size_t{1} << 15;
+
+template <bool COPY>
+[[gnu::target("sse2")]] uint16_t sum_words_sse2(const uint8_t *data, size_t len, uint8_t *dest) {
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    while (len >= 16) {
+        const size_t blocks = min(len / 16, MAX_SIMD_BLOCKS);
+        __m128i acc = zero;
+        for (size_t i = 0; i < blocks; i++, data += 16, dest += COPY ? 16 : 0) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+            if (COPY) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), v);
+            }
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        len -= blocks * 16;
+        alignas(16) array<uint32_t, 4> lanes{};
+        _mm_store_si128(reinterpret_cast<__m128i *>(lanes.data()), acc);
+        for (const auto lane : lanes) {
+            sum += lane;
+        }
+    }
+    return fold_sum(sum + sum_words_scalar<COPY>(data, len, dest));
+}
+
+template <bool COPY>
+[[gnu::target("avx2")]] uint16_t sum_words_avx2(const uint8_t *data, size_t len, uint8_t *dest) {
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    while (len >= 32) {
+        const size_t blocks = min(len / 32, MAX_SIMD_BLOCKS);
+        __m256i acc = zero;
+        for (size_t i = 0; i < blocks; i++, data += 32, dest += COPY ? 32 : 0) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+            if (COPY) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), v);
+            }
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+        }
+        len -= blocks * 32;
+        alignas(32) array<uint32_t, 8> lanes{};
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes.data()), acc);
+        for (const auto lane : lanes) {
+            sum += lane;
         }
-        _sum += val;
-        _parity = !_parity;
     }
+    // the tail goes to the scalar code: legacy SSE code here would pay an AVX-SSE transition penalty
+    return fold_sum(sum + sum_words_scalar<COPY>(data, len, dest));
 }
+#endif
+
+using SumWords = uint16_t (*)(const uint8_t *, size_t, uint8_t *);
+
+//! Pick the fastest implementation the CPU supports
+template <bool COPY>
+SumWords select_sum_words() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return sum_words_avx2<COPY>;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return sum_words_sse2<COPY>;
+    }
+#endif
+    return sum_words_scalar<COPY>;
+}
+
+//! Add `data` to a running checksum (and copy it to `dest`, if `COPY`)
+template <bool COPY>
+void add_to_sum(uint32_t &sum, bool &parity, string_view data, char *dest) {
+    static const SumWords sum_words = select_sum_words<COPY>();
+
+    const auto *bytes = reinterpret_cast<const uint8_t *>(data.data());
+    auto *out = reinterpret_cast<uint8_t *>(dest);
+    size_t len = data.size();
+
+    // an odd number of bytes so far: the first byte completes the current word
+    if (parity and len > 0) {
+        sum += bytes[0];
+        if (COPY) {
+            *out++ = bytes[0];
+        }
+        bytes++;
+        len--;
+        parity = false;
+    }
+
+    uint16_t words = sum_words(bytes, len & ~size_t{1}, out);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    words = __builtin_bswap16(words);
+#endif
+    sum += words;
+
+    if (len & 1) {
+        sum += uint16_t(bytes[len - 1]) << 8;
+        if (COPY) {
+            out[len - 1] = bytes[len - 1];
+        }
+        parity = true;
+    }
+
+    sum = (sum >> 16) + (sum & 0xffff);
+}
+
+}  // namespace
+
+//! \details Bytes at even offsets (counting every byte passed to add() so far) are the high
+//! halves of 16-bit words, so data may be added in pieces of any length.
+void InternetChecksum::add(std::string_view data) { add_to_sum<false>(_sum, _parity, data, nullptr); }
+
+//! \param[in] data is the bytes to add to the checksum
+//! \param[out] dest is where to copy them (at least `data.size()` bytes)
+void InternetChecksum::add_and_copy(std::string_view data, char *dest) { add_to_sum<true>(_sum, _parity, data, dest); }
 
 uint16_t InternetChecksum::value() const {
     uint32_t ret = _sum;
@@ -60,6 +60,14 @@ class InternetChecksum {
   public:
     InternetChecksum(const uint32_t initial_sum = 0);
     void add(std::string_view data);
+
+    //! Add `data` to the checksum while copying it to `dest`, touching each byte once
+    void add_and_copy(std::string_view data, char *dest);
+
+    //! The running (unfolded, uncomplemented) sum, which can seed another InternetChecksum
+    //! \note Only meaningful for combining with data that starts at an even offset.
+    uint32_t sum() const { return _sum; }
+
     uint16_t value() const;
 };
 
@@ -45,6 +45,50 @@ void ByteStreamAction::execute(ByteStream &) const {}
 
 ByteStreamAction::~ByteStreamAction() {}
 
+// PeekViews
+static std::string chunks_to_string(const std::vector<std::string> &chunks) {
+    std::string ret;
+    for (const auto &chunk : chunks) {
+        ret += " \"" + chunk + "\"";
+    }
+    return chunks.empty() ? " nothing" : ret;
+}
+PeekViews::PeekViews(const std::vector<std::string> &views) : _views(views) {}
+std::string PeekViews::description() const { return "views" + chunks_to_string(_views) + " at the front of the stream"; }
+void PeekViews::execute(ByteStream &bs) const {
+    size_t len = 0;
+    for (const auto &view : _views) {
+        len += view.size();
+    }
+    std::vector<std::string> views;
+    for (const auto &iov : bs.peek_views(len).as_iovecs()) {
+        views.emplace_back(static_cast<const char *>(iov.iov_base), iov.iov_len);
+    }
+    if (views != _views) {
+        throw ByteStreamExpectationViolation("Expected views" + chunks_to_string(_views) +
+                                             " at the front of the stream, but found" + chunks_to_string(views));
+    }
+}
+
+// ReadBuffers
+ReadBuffers::ReadBuffers(const std::vector<std::string> &buffers) : _buffers(buffers) {}
+std::string ReadBuffers::description() const { return "read Buffers" + chunks_to_string(_buffers); }
+void ReadBuffers::execute(ByteStream &bs) const {
+    size_t len = 0;
+    for (const auto &buffer : _buffers) {
+        len += buffer.size();
+    }
+    const BufferList read = bs.read_buffers(len);
+    std::vector<std::string> buffers;
+    for (const auto &buffer : read.buffers()) {
+        buffers.push_back(buffer.copy());
+    }
+    if (buffers != _buffers) {
+        throw ByteStreamExpectationViolation("Expected to read Buffers" + chunks_to_string(_buffers) +
+                                             ", but read" + chunks_to_string(buffers));
+    }
+}
+
 ByteStreamTestHarness::ByteStreamTestHarness(const std::string &test_name, const size_t capacity)
     : _test_name(test_name), _byte_stream(capacity) {
     std::ostringstream ss;
@@ -97,6 +141,44 @@ void Write::execute(ByteStream &bs) const {
     }
 }
 
+// WriteBuffer
+WriteBuffer::WriteBuffer(const std::string &data) : _data(data) {}
+WriteBuffer &WriteBuffer::with_bytes_written(const size_t bytes_written) {
+    _bytes_written = bytes_written;
+    return *this;
+}
+std::string WriteBuffer::description() const { return "write Buffer \"" + _data + "\" to the stream"; }
+void WriteBuffer::execute(ByteStream &bs) const {
+    auto bytes_written = bs.write(Buffer{string(_data)});
+    if (_bytes_written and bytes_written != _bytes_written.value()) {
+        throw ByteStreamExpectationViolation::property("bytes_written", _bytes_written.value(), bytes_written);
+    }
+}
+
+// WriteBufferList
+WriteBufferList::WriteBufferList(const std::vector<std::string> &chunks) : _chunks(chunks) {}
+WriteBufferList &WriteBufferList::with_bytes_written(const size_t bytes_written) {
+    _bytes_written = bytes_written;
+    return *this;
+}
+std::string WriteBufferList::description() const {
+    std::string chunks;
+    for (const auto &chunk : _chunks) {
+        chunks += " \"" + chunk + "\"";
+    }
+    return "write BufferList" + chunks + " to the stream";
+}
+void WriteBufferList::execute(ByteStream &bs) const {
+    BufferList data;
+    for (const auto &chunk : _chunks) {
+        data.append(BufferList{string(chunk)});
+    }
+    auto bytes_written = bs.write(data);
+    if (_bytes_written and bytes_written != _bytes_written.value()) {
+        throw ByteStreamExpectationViolation::property("bytes_written", _bytes_written.value(), bytes_written);
+    }
+}
+
 // Pop
 Pop::Pop(const size_t len) : _len(len) {}
 std::string Pop::description() const { return "pop " + to_string(_len); }
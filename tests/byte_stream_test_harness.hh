@@ -10,6 +10,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 struct ByteStreamTestStep {
     virtual operator std::string() const;
@@ -56,6 +57,26 @@ struct Write : public ByteStreamAction {
     void execute(ByteStream &) const override;
 };
 
+struct WriteBuffer : public ByteStreamAction {
+    std::string _data;
+    std::optional<size_t> _bytes_written{};
+
+    WriteBuffer(const std::string &data);
+    WriteBuffer &with_bytes_written(const size_t bytes_written);
+    std::string description() const override;
+    void execute(ByteStream &) const override;
+};
+
+struct WriteBufferList : public ByteStreamAction {
+    std::vector<std::string> _chunks;
+    std::optional<size_t> _bytes_written{};
+
+    WriteBufferList(const std::vector<std::string> &chunks);
+    WriteBufferList &with_bytes_written(const size_t bytes_written);
+    std::string description() const override;
+    void execute(ByteStream &) const override;
+};
+
 struct Pop : public ByteStreamAction {
     size_t _len;
 
@@ -128,6 +149,22 @@ struct Peek : public ByteStreamExpectation {
     void execute(ByteStream &) const override;
 };
 
+struct PeekViews : public ByteStreamExpectation {
+    std::vector<std::string> _views;
+
+    PeekViews(const std::vector<std::string> &views);
+    std::string description() const override;
+    void execute(ByteStream &) const override;
+};
+
+struct ReadBuffers : public ByteStreamAction {
+    std::vector<std::string> _buffers;
+
+    ReadBuffers(const std::vector<std::string> &buffers);
+    std::string description() const override;
+    void execute(ByteStream &) const override;
+};
+
 class ByteStreamTestHarness {
     std::string _test_name;
     ByteStream _byte_stream;
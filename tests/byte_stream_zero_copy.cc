@@ -0,0 +1,144 @@
+#include "buffer.hh"
+#include "byte_stream.hh"
+#include "byte_stream_test_harness.hh"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+//! Buffer::remove_suffix trims the end of one copy without affecting the others
+static void test_remove_suffix() {
+    Buffer whole{"abcdef"};
+    Buffer head = whole;
+    head.remove_suffix(2);
+    if (head.str() != "abcd" or whole.str() != "abcdef") {
+        throw runtime_error("remove_suffix changed the wrong Buffer");
+    }
+    if (head.str().data() != whole.str().data()) {
+        throw runtime_error("remove_suffix copied the bytes");
+    }
+
+    head.remove_prefix(1);
+    head.remove_suffix(1);
+    if (head.str() != "bc") {
+        throw runtime_error("remove_prefix and remove_suffix don't combine");
+    }
+
+    bool threw = false;
+    try {
+        head.remove_suffix(3);
+    } catch (const out_of_range &) {
+        threw = true;
+    }
+    if (not threw) {
+        throw runtime_error("remove_suffix past the start should throw");
+    }
+
+    head.remove_suffix(2);
+    if (head.size() != 0 or head.storage_size() != 0) {
+        throw runtime_error("an empty Buffer should release its storage");
+    }
+}
+
+//! Views and read Buffers point into the storage of the Buffer that was written
+static void test_shared_storage() {
+    ByteStream bs{10};
+    const Buffer data{"hello"};
+    bs.write(data);
+    if (bs.peek_views(5).as_iovecs().at(0).iov_base != data.str().data()) {
+        throw runtime_error("peek_views copied the bytes");
+    }
+    const BufferList head = bs.read_buffers(2);
+    if (head.buffers().at(0).str().data() != data.str().data()) {
+        throw runtime_error("read_buffers copied the bytes");
+    }
+    if (bs.peek_views(3).as_iovecs().at(0).iov_base != data.str().data() + 2) {
+        throw runtime_error("read_buffers copied the rest of a split Buffer");
+    }
+}
+
+int main() {
+    try {
+        test_remove_suffix();
+        test_shared_storage();
+
+        {
+            ByteStreamTestHarness test{"write-buffer-at-capacity", 5};
+
+            test.execute(WriteBuffer{"abc"}.with_bytes_written(3));
+            test.execute(WriteBuffer{"defg"}.with_bytes_written(2));
+            test.execute(WriteBuffer{"h"}.with_bytes_written(0));
+
+            test.execute(BytesWritten{5});
+            test.execute(RemainingCapacity{0});
+            test.execute(BufferSize{5});
+            test.execute(Peek{"abcde"});
+
+            test.execute(Pop{4});
+            test.execute(WriteBuffer{"xyz"}.with_bytes_written(3));
+            test.execute(BytesWritten{8});
+            test.execute(Peek{"exyz"});
+        }
+
+        {
+            ByteStreamTestHarness test{"write-empty-buffer", 2};
+
+            test.execute(WriteBuffer{""}.with_bytes_written(0));
+            test.execute(BufferEmpty{true});
+            test.execute(WriteBufferList{{}}.with_bytes_written(0));
+            test.execute(BufferEmpty{true});
+        }
+
+        {
+            ByteStreamTestHarness test{"write-buffer-list", 10};
+
+            test.execute(WriteBufferList{{"ab", "cde", "f"}}.with_bytes_written(6));
+            test.execute(BytesWritten{6});
+            test.execute(Peek{"abcdef"});
+
+            // stops partway through a Buffer at capacity, and takes nothing after it
+            test.execute(WriteBufferList{{"gh", "ijk", "lm"}}.with_bytes_written(4));
+            test.execute(BytesWritten{10});
+            test.execute(RemainingCapacity{0});
+            test.execute(Peek{"abcdefghij"});
+
+            test.execute(Pop{10});
+            test.execute(EndInput{});
+            test.execute(Eof{true});
+        }
+
+        {
+            ByteStreamTestHarness test{"views-and-buffers", 10};
+
+            test.execute(WriteBuffer{"abc"});
+            test.execute(WriteBuffer{"de"});
+            test.execute(Write{"fgh"});
+
+            // views span several chunks, and the last one may be cut short
+            test.execute(PeekViews{{"abc", "de", "f"}});
+            test.execute(Pop{1});
+            test.execute(PeekViews{{"bc", "de"}});
+            test.execute(BufferSize{7});
+
+            // a read that ends inside a chunk splits it
+            test.execute(ReadBuffers{{"bc", "d"}});
+            test.execute(BytesRead{4});
+            test.execute(PeekViews{{"e", "fgh"}});
+            test.execute(RemainingCapacity{6});
+
+            test.execute(ReadBuffers{{"e", "fg"}});
+            test.execute(ReadBuffers{{"h"}});
+            test.execute(BufferEmpty{true});
+            test.execute(BytesRead{8});
+            test.execute(ReadBuffers{{}});
+        }
+    } catch (const exception &e) {
+        cerr << "Exception: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
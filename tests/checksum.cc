@@ -0,0 +1,134 @@
+#include "ipv4_datagram.hh"
+#include "tcp_segment.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+//! The byte-at-a-time definition of the Internet checksum
+static uint16_t reference_checksum(const string &data) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        sum += uint8_t(data[i]) << (i % 2 == 0 ? 8 : 0);
+    }
+    while (sum > 0xffff) {
+        sum = (sum >> 16) + (sum & 0xffff);
+    }
+    return ~sum;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // lengths around the vector widths, with the data added in random pieces
+        for (size_t len = 0; len < 300; len++) {
+            string data(len, 0);
+            for (auto &ch : data) {
+                ch = rd();
+            }
+            InternetChecksum whole;
+            whole.add(data);
+            InternetChecksum pieces;
+            for (size_t pos = 0; pos < len;) {
+                const size_t n = min<size_t>(len - pos, rd() % 40);
+                pieces.add(string_view(data).substr(pos, n));
+                pos += n;
+            }
+            if (whole.value() != reference_checksum(data) or pieces.value() != reference_checksum(data)) {
+                throw runtime_error("wrong checksum for " + to_string(len) + " bytes");
+            }
+        }
+
+        // all-ones words, enough of them to overflow any 32-bit accumulator lane that is not flushed
+        const string ones(5 * 1024 * 1024 + 3, '\xff');
+        InternetChecksum big;
+        big.add(string_view(ones).substr(1));
+        big.add(string_view(ones).substr(0, 1));
+        if (big.value() != reference_checksum(ones)) {
+            throw runtime_error("wrong checksum for a large buffer");
+        }
+
+        // a payload checksummed while it is joined, then replaced, must still serialize with the right checksum
+        {
+            const uint32_t pseudo_cksum = rd() & 0xffff;
+            BufferList pieces;
+            pieces.append(Buffer(string("abc")));
+            pieces.append(Buffer(string(1001, 'x')));
+            pieces.append(Buffer(string("defg")));
+
+            TCPSegment seg;
+            seg.header().seqno = WrappingInt32{static_cast<uint32_t>(rd())};
+            auto check_roundtrip = [&] {
+                TCPSegment parsed;
+                if (parsed.parse(seg.serialize(pseudo_cksum).concatenate(), pseudo_cksum) != ParseResult::NoError) {
+                    throw runtime_error("serialized segment has a bad checksum");
+                }
+                if (parsed.payload().str() != seg.payload().str()) {
+                    throw runtime_error("serialized segment has the wrong payload");
+                }
+            };
+
+            seg.set_payload(pieces);
+            if (seg.payload().str() != "abc" + string(1001, 'x') + "defg") {
+                throw runtime_error("set_payload() joined the buffers incorrectly");
+            }
+            check_roundtrip();
+            seg.payload() = Buffer(string("abcdefg"));
+            check_roundtrip();
+            seg.payload().remove_prefix(1);
+            check_roundtrip();
+        }
+
+        // decrementing the TTL of a received datagram must give the same bytes as rebuilding it from scratch
+        for (unsigned i = 0; i < 10000; i++) {
+            InternetDatagram original;
+            original.header().ttl = 1 + rd() % 255;
+            original.header().id = rd();
+            original.header().tos = rd();
+            original.header().src = rd();
+            original.header().dst = rd();
+            original.payload() = string(rd() % 64, 'x');
+            original.header().len = IPv4Header::LENGTH + original.payload().size();
+
+            InternetDatagram forwarded;
+            if (forwarded.parse(original.serialize().concatenate()) != ParseResult::NoError) {
+                throw runtime_error("could not parse a serialized datagram");
+            }
+            forwarded.decrement_ttl();
+
+            InternetDatagram rebuilt;
+            rebuilt.header() = original.header();
+            rebuilt.header().ttl--;
+            rebuilt.payload() = original.payload();
+
+            const string expected = rebuilt.serialize().concatenate();
+            if (forwarded.serialize().concatenate() != expected) {
+                throw runtime_error("incremental checksum update disagrees with recomputing it");
+            }
+            InternetDatagram reparsed;
+            if (reparsed.parse(string(expected)) != ParseResult::NoError or reparsed.header() != forwarded.header()) {
+                throw runtime_error("decrement_ttl() left the header fields wrong");
+            }
+
+            // once the header is changed some other way, the received bytes must not be reused
+            forwarded.header().dst ^= 1;
+            rebuilt.header().dst ^= 1;
+            if (forwarded.serialize().concatenate() != rebuilt.serialize().concatenate()) {
+                throw runtime_error("stale header bytes reused after the header changed");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,383 @@
+#include "eventloop.hh"
+#include "socket.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+//! A pipe's read and write ends
+static pair<FileDescriptor, FileDescriptor> make_pipe() {
+    int fds[2];
+    SystemCall("pipe", ::pipe(fds));
+    return {FileDescriptor(fds[0]), FileDescriptor(fds[1])};
+}
+
+static void expect(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+static string backend_name(const EventLoop::Backend backend) {
+    switch (backend) {
+        case EventLoop::Backend::Epoll:
+            return "epoll: ";
+        case EventLoop::Backend::IoUring:
+            return "io_uring: ";
+        default:
+            return "poll: ";
+    }
+}
+
+static void test(const EventLoop::Backend backend) {
+    const string name = backend_name(backend);
+
+    // a readable pipe is served, and the rule is canceled once the writer hangs up
+    {
+        EventLoop loop(backend);
+        auto pipe = make_pipe();
+        auto &read_end = pipe.first;
+        auto &write_end = pipe.second;
+        string received;
+        bool canceled = false;
+        loop.add_rule(
+            read_end, Direction::In, [&] { received += read_end.read(); }, [] { return true; }, [&] { canceled = true; });
+
+        expect(loop.wait_next_event(0) == EventLoop::Result::Timeout, name + "an empty pipe was ready");
+        write_end.write("hello");
+        expect(loop.wait_next_event(-1) == EventLoop::Result::Success, name + "a written pipe was not ready");
+        expect(received == "hello", name + "wrong data read");
+
+        write_end.close();
+        while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+        }
+        expect(canceled, name + "rule not canceled after hangup");
+    }
+
+    // a rule that is not interested is not served, and interest can come and go
+    {
+        EventLoop loop(backend);
+        auto pipe = make_pipe();
+        auto &read_end = pipe.first;
+        auto &write_end = pipe.second;
+        bool interested = false;
+        size_t served = 0;
+        loop.add_rule(
+            read_end, Direction::In, [&] { read_end.read(), served++; }, [&] { return interested; });
+
+        write_end.write("x");
+        expect(loop.wait_next_event(0) == EventLoop::Result::Exit and served == 0, name + "uninterested rule served");
+        interested = true;
+        expect(loop.wait_next_event(0) == EventLoop::Result::Success and served == 1, name + "interested rule ignored");
+        interested = false;
+        write_end.write("y");
+        expect(loop.wait_next_event(0) == EventLoop::Result::Exit and served == 1, name + "interest not withdrawn");
+        interested = true;
+        expect(loop.wait_next_event(0) == EventLoop::Result::Success and served == 2, name + "interest not renewed");
+    }
+
+    // one fd can have a rule in each direction
+    {
+        EventLoop loop(backend);
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        FileDescriptor a(fds[0]), b(fds[1]);
+        size_t reads = 0, writes = 0;
+        bool want_write = true;
+        loop.add_rule(a, Direction::In, [&] { a.read(), reads++; });
+        loop.add_rule(
+            a, Direction::Out, [&] { a.write("ping"), writes++, want_write = false; }, [&] { return want_write; });
+
+        expect(loop.wait_next_event(0) == EventLoop::Result::Success and writes == 1 and reads == 0,
+               name + "writable socket not served");
+        b.write("pong");
+        expect(loop.wait_next_event(0) == EventLoop::Result::Success and writes == 1 and reads == 1,
+               name + "readable socket not served");
+        expect(b.read() == "ping", name + "wrong data written");
+    }
+
+    // a hangup cancels an Out rule even while it is not interested, rather than ending every wait
+    {
+        EventLoop loop(backend);
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        FileDescriptor a(fds[0]), b(fds[1]);
+        auto pipe = make_pipe();
+        auto &read_end = pipe.first;
+        bool canceled = false;
+        loop.add_rule(
+            a, Direction::Out, [] {}, [] { return false; }, [&] { canceled = true; });
+        loop.add_rule(read_end, Direction::In, [&] { read_end.read(); });
+
+        b.close();
+        loop.wait_next_event(10);
+        expect(canceled, name + "uninterested rule not canceled after hangup");
+        expect(loop.wait_next_event(10) == EventLoop::Result::Timeout, name + "hangup still reported");
+    }
+
+    // a peer that only stops writing ends no wait for a rule that is not interested in reading
+    {
+        EventLoop loop(backend);
+        int fds[2];
+        SystemCall("socketpair", ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+        FileDescriptor a(fds[0]), b(fds[1]);
+        auto pipe = make_pipe();
+        auto &read_end = pipe.first;
+        loop.add_rule(
+            a, Direction::Out, [] {}, [] { return false; });
+        loop.add_rule(read_end, Direction::In, [&] { read_end.read(); });
+
+        SystemCall("shutdown", ::shutdown(b.fd_num(), SHUT_WR));
+        expect(loop.wait_next_event(10) == EventLoop::Result::Timeout and
+                   loop.wait_next_event(10) == EventLoop::Result::Timeout,
+               name + "half-closed socket ended the wait");
+    }
+
+    // with many idle fds, only the ready one is served
+    {
+        EventLoop loop(backend);
+        vector<pair<FileDescriptor, FileDescriptor>> pipes;
+        vector<size_t> served(200);
+        pipes.reserve(served.size());  // the callbacks refer to the elements
+        for (size_t i = 0; i < served.size(); i++) {
+            pipes.push_back(make_pipe());
+            auto &read_end = pipes.back().first;
+            loop.add_rule(read_end, Direction::In, [&, i] { read_end.read(), served[i]++; });
+        }
+        for (unsigned round = 0; round < 3; round++) {
+            const size_t ready = (round * 71 + 13) % served.size();
+            pipes[ready].second.write("z");
+            expect(loop.wait_next_event(-1) == EventLoop::Result::Success, name + "ready pipe not found");
+            for (size_t i = 0; i < served.size(); i++) {
+                expect(served[i] == (i == ready ? 1 : 0), name + "pipe " + to_string(i) + " served wrongly");
+            }
+            served.assign(served.size(), 0);
+        }
+    }
+
+    // a regular file (which epoll cannot watch) is always ready, as with poll
+    {
+        char path[] = "/tmp/sponge_eventloop_XXXXXX";
+        FileDescriptor file(SystemCall("mkstemp", ::mkstemp(path)));
+        SystemCall("unlink", ::unlink(path));
+        file.write("contents");
+        SystemCall("lseek", static_cast<int>(::lseek(file.fd_num(), 0, SEEK_SET)));
+
+        EventLoop loop(backend);
+        string received;
+        loop.add_rule(file, Direction::In, [&] { received += file.read(); });
+        while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+        }
+        expect(received == "contents", name + "regular file not read");
+    }
+
+    // closing an fd cancels its rules, and a new fd can take its number
+    {
+        EventLoop loop(backend);
+        auto pipe = make_pipe();  // the write end stays open, so the read end never reaches EOF
+        auto &read_end = pipe.first;
+        bool canceled = false;
+        loop.add_rule(
+            read_end, Direction::In, [&] { read_end.read(); }, [] { return true; }, [&] { canceled = true; });
+        expect(loop.wait_next_event(0) == EventLoop::Result::Timeout, name + "empty pipe was ready");
+        const int number = read_end.fd_num();
+        read_end.close();
+
+        auto new_pipe = make_pipe();
+        auto &new_read_end = new_pipe.first;
+        auto &new_write_end = new_pipe.second;
+        expect(new_read_end.fd_num() == number, name + "fd number not reused");
+        string received;
+        loop.add_rule(new_read_end, Direction::In, [&] { received += new_read_end.read(); });
+        new_write_end.write("again");
+        expect(loop.wait_next_event(-1) == EventLoop::Result::Success and canceled and received == "again",
+               name + "reused fd number not watched");
+    }
+
+    // a one-shot timer fires once, no earlier than its delay, even with no rules
+    {
+        EventLoop loop(backend);
+        size_t fired = 0;
+        const uint64_t start = timestamp_ms();
+        loop.add_timer(30, [&] { fired++; });
+        expect(loop.wait_next_event(0) == EventLoop::Result::Timeout and fired == 0, name + "timer fired early");
+        expect(loop.wait_next_event(-1) == EventLoop::Result::Success and fired == 1, name + "timer did not fire");
+        expect(timestamp_ms() - start >= 30, name + "timer fired before its delay");
+        expect(loop.wait_next_event(-1) == EventLoop::Result::Exit and fired == 1, name + "timer fired twice");
+    }
+
+    // a timer ends the wait for an idle fd, and canceled timers don't fire
+    {
+        EventLoop loop(backend);
+        auto pipe = make_pipe();
+        auto &read_end = pipe.first;
+        loop.add_rule(read_end, Direction::In, [&] { read_end.read(); });
+        bool fired = false;
+        const auto canceled = loop.add_timer(10, [] { throw runtime_error("canceled timer fired"); });
+        loop.add_timer(20, [&] { fired = true; });
+        loop.cancel_timer(canceled);
+        expect(loop.wait_next_event(-1) == EventLoop::Result::Success and fired, name + "timer did not end the wait");
+        expect(loop.wait_next_event(5) == EventLoop::Result::Timeout, name + "no timeout after the timer fired");
+    }
+
+    // a periodic timer fires until it cancels itself; a timer added by a callback waits for the next call
+    {
+        EventLoop loop(backend);
+        size_t ticks = 0, immediate = 0;
+        EventLoop::TimerId periodic = 0;
+        periodic = loop.add_periodic_timer(5, [&] {
+            if (++ticks == 4) {
+                loop.cancel_timer(periodic);
+            }
+            loop.add_timer(0, [&] { immediate++; });
+            expect(immediate + 1 == ticks, "timer added by a callback ran in the same call");
+        });
+        while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+        }
+        expect(ticks == 4 and immediate == 4, name + "wrong number of periodic timer ticks");
+    }
+
+    // timers fire in order of their deadlines, however many were canceled
+    {
+        EventLoop loop(backend);
+        vector<EventLoop::TimerId> ids;
+        vector<uint64_t> deadlines;
+        vector<size_t> order;
+        for (size_t i = 0; i < 1000; i++) {
+            const uint64_t delay = 20 - i % 20;
+            deadlines.push_back(timestamp_ms() + delay);
+            ids.push_back(loop.add_timer(delay, [&order, i] { order.push_back(i); }));
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (i % 101 != 0) {
+                loop.cancel_timer(ids[i]);
+            }
+        }
+        while (loop.wait_next_event(-1) != EventLoop::Result::Exit) {
+        }
+        expect(order.size() == 10, name + "wrong timers fired");
+        for (size_t k = 0; k < order.size(); k++) {
+            // (the clock may tick between reading it here and in add_timer)
+            expect(order[k] % 101 == 0 and (k == 0 or deadlines[order[k - 1]] <= deadlines[order[k]] + 1),
+                   name + "timers fired out of order");
+        }
+    }
+}
+
+//! Datagram rules receive every datagram, with its source, and EventLoop::send_datagram sends them
+static void test_datagrams(const EventLoop::Backend backend) {
+    const string name = backend_name(backend);
+
+    UDPSocket receiver, sender;
+    receiver.bind(Address("127.0.0.1", 0));
+    sender.bind(Address("127.0.0.1", 0));
+    const Address destination = receiver.local_address();
+
+    EventLoop loop(backend);
+    vector<pair<Address, string>> received;
+    bool interested = true;
+    loop.add_datagram_rule(
+        receiver,
+        [&](const Address &source, const string_view payload) { received.emplace_back(source, string(payload)); },
+        [&] { return interested; });
+
+    // datagrams sent in one go arrive in order, from the sender
+    for (unsigned i = 0; i < 100; i++) {
+        loop.send_datagram(sender, destination, "datagram " + to_string(i));
+    }
+    while (received.size() < 100) {
+        expect(loop.wait_next_event(1000) == EventLoop::Result::Success, name + "datagrams not received");
+    }
+    for (unsigned i = 0; i < received.size(); i++) {
+        expect(received[i].first == sender.local_address(), name + "wrong source address");
+        expect(received[i].second == "datagram " + to_string(i), name + "wrong datagram received");
+    }
+
+    // a batch of datagrams goes out together, and the poll and epoll backends receive many per wakeup
+    received.clear();
+    vector<string> strings;
+    for (unsigned i = 0; i < 100; i++) {
+        strings.push_back(string(i, 'b'));
+    }
+    loop.send_datagrams(sender, destination, {strings.begin(), strings.end()});
+    expect(loop.wait_next_event(1000) == EventLoop::Result::Success, name + "batch not received");
+    expect(backend == EventLoop::Backend::IoUring or received.size() == EventLoop::DATAGRAM_BATCH,
+           name + "datagrams not received in a batch");
+    while (received.size() < strings.size()) {
+        expect(loop.wait_next_event(1000) == EventLoop::Result::Success, name + "batch not received");
+    }
+    for (unsigned i = 0; i < received.size(); i++) {
+        expect(received[i].second == strings[i], name + "wrong datagram in batch received");
+    }
+
+    // without interest, datagrams wait in the socket
+    interested = false;
+    received.clear();
+    sender.sendto(destination, "later");
+    expect(loop.wait_next_event(20) == EventLoop::Result::Exit and received.empty(),
+           name + "datagram delivered without interest");
+    interested = true;
+    while (received.empty()) {
+        expect(loop.wait_next_event(1000) == EventLoop::Result::Success, name + "waiting datagram not received");
+    }
+    expect(received.size() == 1 and received[0].second == "later", name + "wrong waiting datagram");
+
+    // sends from inside a callback go out too, and so do empty datagrams
+    received.clear();
+    UDPSocket echo;
+    echo.bind(Address("127.0.0.1", 0));
+    loop.add_datagram_rule(echo, [&](const Address &source, const string_view payload) {
+        loop.send_datagram(echo, source, string(payload) + "!");
+    });
+    vector<string> echoed;
+    loop.add_datagram_rule(sender, [&](const Address &, const string_view payload) { echoed.emplace_back(payload); });
+    sender.sendto(echo.local_address(), "");
+    sender.sendto(echo.local_address(), "echo");
+    while (echoed.size() < 2) {
+        expect(loop.wait_next_event(1000) == EventLoop::Result::Success, name + "echoed datagrams not sent");
+    }
+    expect(echoed[0] == "!" and echoed[1] == "echo!", name + "wrong datagrams echoed");
+
+    // closing the socket cancels its rule
+    bool canceled = false;
+    UDPSocket closing;
+    loop.add_datagram_rule(
+        closing, [](const Address &, const string_view) {}, [] { return true; }, [&] { canceled = true; });
+    loop.wait_next_event(0);
+    closing.close();
+    loop.wait_next_event(0);
+    expect(canceled, name + "datagram rule not canceled after close");
+}
+
+int main() {
+    try {
+        vector<EventLoop::Backend> backends{EventLoop::Backend::Poll, EventLoop::Backend::Epoll};
+        if (EventLoop::io_uring_supported()) {
+            backends.push_back(EventLoop::Backend::IoUring);
+        } else {
+            cerr << "io_uring not supported, skipping its tests\n";
+        }
+        for (const auto backend : backends) {
+            test(backend);
+            test_datagrams(backend);
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
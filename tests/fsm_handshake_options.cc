@@ -0,0 +1,171 @@
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static void expect(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+//! Delivers `from`'s segments to `to`, passing each through `edit` first
+static void deliver(
+    TCPConnection &from, TCPConnection &to, const function<void(TCPSegment &)> &edit = [](TCPSegment &) {}) {
+    while (not from.segments_out().empty()) {
+        TCPSegment seg = from.segments_out().front();
+        from.segments_out().pop();
+        edit(seg);
+        to.segment_received(seg);
+    }
+}
+
+//! The payload size of the first segment that `x` sends after being written more than its MSS
+static size_t first_payload_size(TCPConnection &x) {
+    x.write(string(3000, 'x'));
+    expect(not x.segments_out().empty(), "no segment sent");
+    return x.segments_out().front().payload().size();
+}
+
+//! Sends three segments from `from` to `to` but drops the first; returns the SACK blocks on `to`'s last reply
+static size_t sack_count_after_loss(TCPConnection &from, TCPConnection &to) {
+    from.write(string(3 * TCPConfig::MAX_PAYLOAD_SIZE, 'x'));
+    expect(from.segments_out().size() == 3, "expected three segments");
+    from.segments_out().pop();
+    deliver(from, to);
+    expect(not to.segments_out().empty(), "no ACK sent");
+    return to.segments_out().back().header().options.sack_count;
+}
+
+//! Handshakes `x` with `y`, keeping a copy of `y`'s SYN/ACK in `syn_ack`
+static void handshake(TCPConnection &x, TCPConnection &y, TCPSegment &syn_ack) {
+    x.connect();
+    deliver(x, y);
+    syn_ack = y.segments_out().front();
+    deliver(y, x);
+    deliver(x, y);
+}
+
+int main() {
+    try {
+        // a SYN that advertises an MSS of 0 gets the sanity floor instead
+        {
+            TCPConnection x{TCPConfig{}}, y{TCPConfig{}};
+            x.connect();
+            deliver(x, y, [](TCPSegment &seg) { seg.header().options.mss = 0; });
+            deliver(y, x);
+            deliver(x, y);
+            expect(first_payload_size(y) == TCPConfig::MIN_PEER_MSS, "MSS of 0 not raised to the floor");
+        }
+
+        // a small MSS above the floor is honoured, never raised
+        {
+            TCPConnection x{TCPConfig{}}, y{TCPConfig{}};
+            x.connect();
+            deliver(x, y, [](TCPSegment &seg) { seg.header().options.mss = 100; });
+            deliver(y, x);
+            deliver(x, y);
+            expect(first_payload_size(y) == 100, "peer's MSS of 100 not honoured");
+        }
+
+        // a SYN/ACK retransmitted after the handshake does not renegotiate the MSS
+        {
+            TCPConnection x{TCPConfig{}}, y{TCPConfig{}};
+            x.connect();
+            deliver(x, y);
+            TCPSegment syn_ack = y.segments_out().front();
+            deliver(y, x);
+            deliver(x, y);
+
+            syn_ack.header().options.mss = 600;
+            x.segment_received(syn_ack);
+            deliver(x, y);
+            expect(first_payload_size(x) == TCPConfig::MAX_PAYLOAD_SIZE, "late SYN/ACK changed the MSS");
+        }
+
+        // a SYN/ACK retransmitted after the handshake does not change the window scale
+        {
+            TCPConfig scaled;
+            scaled.recv_capacity = TCPConfig::LARGE_CAPACITY;
+            scaled.send_capacity = TCPConfig::LARGE_CAPACITY;
+            scaled.window_scaling = true;
+
+            TCPConnection x{scaled}, y{scaled};
+            x.connect();
+            deliver(x, y);
+            TCPSegment syn_ack = y.segments_out().front();
+            deliver(y, x);
+            deliver(x, y);
+
+            syn_ack.header().options.wscale.reset();
+            x.segment_received(syn_ack);
+            deliver(x, y);
+            syn_ack.header().options.wscale = 0;
+            x.segment_received(syn_ack);
+            deliver(x, y);
+
+            const string data(1024 * 1024, 'x');
+            x.write(data);
+            size_t max_in_flight = 0;
+            while (x.bytes_in_flight() > 0 or not x.segments_out().empty()) {
+                max_in_flight = max(max_in_flight, x.bytes_in_flight());
+                deliver(x, y);
+                y.inbound_stream().read(y.inbound_stream().buffer_size());
+                deliver(y, x);
+            }
+            expect(y.inbound_stream().bytes_written() == data.size(), "not all data arrived");
+            expect(max_in_flight > numeric_limits<uint16_t>::max(), "late SYN/ACK changed the window scale");
+        }
+
+        TCPConfig sack;
+        sack.sack = true;
+
+        // SACK blocks are sent only when both SYNs offered SACK
+        {
+            TCPConnection x{sack}, y{sack};
+            TCPSegment syn_ack;
+            handshake(x, y, syn_ack);
+            expect(syn_ack.header().options.sack_permitted, "SYN/ACK should permit SACK");
+            expect(sack_count_after_loss(x, y) == 1, "SACK blocks should follow a lost segment");
+        }
+        {
+            TCPConnection x{sack}, y{TCPConfig{}};
+            TCPSegment syn_ack;
+            handshake(x, y, syn_ack);
+            expect(not syn_ack.header().options.sack_permitted, "SYN/ACK should not permit SACK");
+            expect(sack_count_after_loss(y, x) == 0, "SACK blocks sent to a peer that did not permit them");
+        }
+        {
+            TCPConnection x{TCPConfig{}}, y{sack};
+            TCPSegment syn_ack;
+            handshake(x, y, syn_ack);
+            expect(sack_count_after_loss(x, y) == 0, "SACK blocks sent to a peer that did not offer them");
+        }
+
+        // a SYN/ACK retransmitted after the handshake without the option does not turn SACK off
+        {
+            TCPConnection x{sack}, y{sack};
+            TCPSegment syn_ack;
+            handshake(x, y, syn_ack);
+            syn_ack.header().options.sack_permitted = false;
+            x.segment_received(syn_ack);
+            deliver(x, y);
+            expect(sack_count_after_loss(y, x) == 1, "late SYN/ACK turned SACK off");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
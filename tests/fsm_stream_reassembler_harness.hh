@@ -10,6 +10,7 @@
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 class ReassemblerExpectationViolation : public std::runtime_error {
   public:
@@ -137,6 +138,31 @@ struct NotAtEof : public ReassemblerExpectation {
     }
 };
 
+struct PendingRanges : public ReassemblerExpectation {
+    std::vector<std::pair<uint64_t, uint64_t>> _ranges;
+
+    PendingRanges(std::vector<std::pair<uint64_t, uint64_t>> &&ranges) : _ranges(std::move(ranges)) {}
+
+    static std::string ranges_to_string(const std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+        std::ostringstream ss;
+        for (const auto &[first, second] : ranges) {
+            ss << "[" << first << ", " << second << ") ";
+        }
+        return ranges.empty() ? "none" : ss.str();
+    }
+
+    std::string description() const { return "pending ranges " + ranges_to_string(_ranges); }
+
+    void execute(StreamReassembler &reassembler) const {
+        const auto ranges = reassembler.pending_ranges();
+        if (ranges != _ranges) {
+            throw ReassemblerExpectationViolation("The reassembler reported pending ranges " +
+                                                  ranges_to_string(ranges) + ", but they were expected to be " +
+                                                  ranges_to_string(_ranges));
+        }
+    }
+};
+
 struct SubmitSegment : public ReassemblerAction {
     std::string _data;
     size_t _index;
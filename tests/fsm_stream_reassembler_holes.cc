@@ -131,6 +131,26 @@ int main() {
             test.execute(BytesAvailable(""));
             test.execute(AtEof{});
         }
+
+        {
+            ReassemblerTestHarness test{65000};
+
+            test.execute(PendingRanges({}));
+
+            test.execute(SubmitSegment{"fg", 5});
+            test.execute(SubmitSegment{"b", 1});
+            test.execute(PendingRanges({{1, 2}, {5, 7}}));
+
+            // adjacent and overlapping substrings are reported as one range
+            test.execute(SubmitSegment{"cd", 2});
+            test.execute(SubmitSegment{"efg", 4});
+            test.execute(PendingRanges({{1, 7}}));
+            test.execute(UnassembledBytes(6));
+
+            test.execute(SubmitSegment{"a", 0});
+            test.execute(PendingRanges({}));
+            test.execute(BytesAvailable("abcdefg"));
+        }
     } catch (const exception &e) {
         cerr << "Exception: " << e.what() << endl;
         return EXIT_FAILURE;
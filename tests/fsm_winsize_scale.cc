@@ -0,0 +1,81 @@
+#include "tcp_config.hh"
+#include "tcp_connection.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static void deliver(TCPConnection &from, TCPConnection &to) {
+    while (not from.segments_out().empty()) {
+        to.segment_received(from.segments_out().front());
+        from.segments_out().pop();
+    }
+}
+
+//! Handshake two connections and send `data` from `x` to `y`; returns the most bytes `x` ever had in flight
+static size_t max_bytes_in_flight(const TCPConfig &x_cfg, const TCPConfig &y_cfg, const string &data) {
+    TCPConnection x{x_cfg}, y{y_cfg};
+    x.connect();
+    const auto &syn = x.segments_out().front().header();
+    if (x_cfg.window_scaling and syn.options.wscale != 10) {
+        throw runtime_error("SYN should offer a shift of 10 for a 32 MiB window");
+    }
+    deliver(x, y);
+    deliver(y, x);
+    deliver(x, y);
+
+    if (x.write(data) != data.size()) {
+        throw runtime_error("short write");
+    }
+    size_t max_in_flight = 0;
+    while (x.bytes_in_flight() > 0 or not x.segments_out().empty()) {
+        max_in_flight = max(max_in_flight, x.bytes_in_flight());
+        deliver(x, y);
+        y.inbound_stream().read(y.inbound_stream().buffer_size());
+        deliver(y, x);
+    }
+    if (y.inbound_stream().bytes_written() != data.size()) {
+        throw runtime_error("not all data arrived");
+    }
+    return max_in_flight;
+}
+
+int main() {
+    try {
+        const string data(4 * 1024 * 1024, 'x');
+        constexpr size_t max_unscaled = numeric_limits<uint16_t>::max();
+
+        TCPConfig scaled;
+        scaled.recv_capacity = TCPConfig::LARGE_CAPACITY;
+        scaled.send_capacity = TCPConfig::LARGE_CAPACITY;
+        scaled.window_scaling = true;
+
+        TCPConfig unscaled = scaled;
+        unscaled.window_scaling = false;
+
+        // the SYN's window is never scaled, so the first flight is still limited to 64 KiB
+        if (max_bytes_in_flight(scaled, scaled, data) <= max_unscaled) {
+            throw runtime_error("window scaling should allow more than 64 KiB in flight");
+        }
+
+        if (max_bytes_in_flight(scaled, unscaled, data) > max_unscaled) {
+            throw runtime_error("window scaling must not be used unless both SYNs carry the option");
+        }
+
+        if (max_bytes_in_flight(unscaled, scaled, data) > max_unscaled) {
+            throw runtime_error("the passive side must not answer a SYN without window scaling");
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+#include "prefix_trie.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Prefix {
+    uint32_t prefix;
+    uint8_t length;
+};
+
+//! Longest-prefix match by scanning every prefix; the first one added wins a tie
+static optional<size_t> reference_lookup(const vector<Prefix> &prefixes, const uint32_t address) {
+    optional<size_t> best;
+    for (size_t i = 0; i < prefixes.size(); i++) {
+        const auto &p = prefixes[i];
+        const bool matches = p.length == 0 or ((p.prefix ^ address) >> (32 - p.length)) == 0;
+        if (matches and (not best.has_value() or p.length > prefixes[best.value()].length)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // an empty table matches nothing
+        {
+            PrefixTrie trie;
+            if (trie.lookup(0).has_value() or trie.lookup(0xffffffff).has_value()) {
+                throw runtime_error("empty table matched an address");
+            }
+        }
+
+        // /0 and /32 at the edges of the address space
+        {
+            PrefixTrie trie;
+            trie.add(0xffffffff, 32, 1);
+            trie.add(0x12345678, 0, 0);
+            if (trie.lookup(0xffffffff) != 1u or trie.lookup(0xfffffffe) != 0u or trie.lookup(0) != 0u) {
+                throw runtime_error("wrong match with a /0 and a /32");
+            }
+        }
+
+        // random tables, with prefixes of every length added in random order, clustered so that they nest
+        for (unsigned round = 0; round < 20; round++) {
+            vector<Prefix> prefixes;
+            PrefixTrie trie;
+            const uint32_t base = rd();
+            for (unsigned i = 0; i < 300; i++) {
+                const uint8_t length = rd() % 33;
+                // share the high bits with `base` most of the time, so prefixes overlap
+                const uint32_t prefix = (rd() % 4 == 0) ? static_cast<uint32_t>(rd()) : base ^ (rd() & 0xfffff);
+                prefixes.push_back({prefix, length});
+                trie.add(prefix, length, i);
+            }
+            if (trie.size() != prefixes.size()) {
+                throw runtime_error("wrong size");
+            }
+            vector<uint32_t> addresses(20000);
+            for (auto &address : addresses) {
+                address = (rd() % 2) ? static_cast<uint32_t>(rd()) : base ^ (rd() & 0xfffff);
+                if (trie.lookup(address) != reference_lookup(prefixes, address)) {
+                    throw runtime_error("wrong match for " + to_string(address));
+                }
+            }
+
+            // the batched lookup must agree, including for a count that is not a multiple of its chunk size
+            const size_t count = addresses.size() - rd() % 64;
+            vector<optional<size_t>> values(count);
+            trie.lookup(addresses.data(), values.data(), count);
+            for (size_t i = 0; i < count; i++) {
+                if (values[i] != trie.lookup(addresses[i])) {
+                    throw runtime_error("batched lookup disagrees for " + to_string(addresses[i]));
+                }
+            }
+        }
+
+        // removing prefixes, with the longest remaining prefix that covers each one taking over its addresses
+        for (unsigned round = 0; round < 20; round++) {
+            vector<Prefix> prefixes;
+            PrefixTrie trie;
+            const uint32_t base = rd();
+            for (unsigned i = 0; i < 300; i++) {
+                const uint8_t length = rd() % 33;
+                const uint32_t prefix = base ^ (rd() & 0xfffff);
+                // keep the prefixes distinct, as a route table would
+                const uint32_t mask = length == 0 ? 0 : ~((uint64_t(1) << (32 - length)) - 1);
+                bool duplicate = false;
+                for (const auto &p : prefixes) {
+                    duplicate |= p.length == length and ((p.prefix ^ prefix) & mask) == 0;
+                }
+                if (not duplicate) {
+                    trie.add(prefix, length, prefixes.size());
+                    prefixes.push_back({prefix, length});
+                }
+            }
+
+            // removed prefixes stay in the list, with a length no address can match
+            constexpr uint8_t REMOVED = 64;
+            size_t removed = 0;
+            for (size_t i = 0; i < prefixes.size(); i += 1 + rd() % 3) {
+                auto &p = prefixes[i];
+                optional<size_t> fallback;
+                for (size_t j = 0; j < prefixes.size(); j++) {
+                    const auto &q = prefixes[j];
+                    const bool covers = q.length < p.length and
+                                        (q.length == 0 or ((q.prefix ^ p.prefix) >> (32 - q.length)) == 0);
+                    if (covers and (not fallback.has_value() or q.length > prefixes[fallback.value()].length)) {
+                        fallback = j;
+                    }
+                }
+                const uint8_t fallback_length = fallback.has_value() ? prefixes[fallback.value()].length : 0;
+                trie.remove(p.prefix, p.length, fallback, fallback_length);
+                p.length = REMOVED;
+                removed++;
+            }
+            if (trie.size() != prefixes.size() - removed) {
+                throw runtime_error("wrong size after removal");
+            }
+
+            for (unsigned k = 0; k < 20000; k++) {
+                const uint32_t address = (rd() % 4 == 0) ? static_cast<uint32_t>(rd()) : base ^ (rd() & 0xfffff);
+                optional<size_t> expected;
+                for (size_t i = 0; i < prefixes.size(); i++) {
+                    const auto &p = prefixes[i];
+                    const bool matches =
+                        p.length == 0 or (p.length <= 32 and ((p.prefix ^ address) >> (32 - p.length)) == 0);
+                    if (matches and (not expected.has_value() or p.length > prefixes[expected.value()].length)) {
+                        expected = i;
+                    }
+                }
+                if (trie.lookup(address) != expected) {
+                    throw runtime_error("wrong match after removal for " + to_string(address));
+                }
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
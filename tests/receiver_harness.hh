@@ -13,6 +13,8 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 struct ReceiverTestStep {
     virtual std::string to_string() const { return "ReceiverTestStep"; }
@@ -167,6 +169,35 @@ struct ExpectBytes : public ReceiverExpectation {
     }
 };
 
+struct ExpectSackBlocks : public ReceiverExpectation {
+    std::vector<std::pair<WrappingInt32, WrappingInt32>> _blocks;
+
+    ExpectSackBlocks(std::vector<std::pair<WrappingInt32, WrappingInt32>> &&blocks) : _blocks(std::move(blocks)) {}
+
+    static std::string blocks_to_string(const std::vector<std::pair<WrappingInt32, WrappingInt32>> &blocks) {
+        std::ostringstream ss;
+        for (const auto &[left, right] : blocks) {
+            ss << "[" << left << ", " << right << ") ";
+        }
+        return blocks.empty() ? "none" : ss.str();
+    }
+
+    std::string description() const { return "SACK blocks " + blocks_to_string(_blocks); }
+
+    void execute(TCPReceiver &receiver) const {
+        TCPOptions options;
+        receiver.sack_blocks(options);
+        std::vector<std::pair<WrappingInt32, WrappingInt32>> reported;
+        for (size_t i = 0; i < options.sack_count; i++) {
+            reported.emplace_back(options.sack_blocks[i].left, options.sack_blocks[i].right);
+        }
+        if (reported != _blocks) {
+            throw ReceiverExpectationViolation("The TCPReceiver reported SACK blocks " + blocks_to_string(reported) +
+                                               ", but they were expected to be " + blocks_to_string(_blocks));
+        }
+    }
+};
+
 struct ReceiverAction : public ReceiverTestStep {
     std::string to_string() const { return "Action:      " + description(); }
     virtual std::string description() const { return "description missing"; }
@@ -0,0 +1,89 @@
+#include "receiver_harness.hh"
+#include "util.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        // Nothing held out of order: no blocks
+        {
+            uint32_t isn = uniform_int_distribution<uint32_t>{0, UINT32_MAX}(rd);
+            TCPReceiverTestHarness test{4000};
+            test.execute(ExpectSackBlocks{{}});
+            test.execute(SegmentArrives{}.with_syn().with_seqno(isn).with_result(SegmentArrives::Result::OK));
+            test.execute(SegmentArrives{}.with_seqno(isn + 1).with_data("abcd").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{}});
+        }
+
+        // The block holding the most recent segment comes first, the rest in sequence order
+        {
+            uint32_t isn = uniform_int_distribution<uint32_t>{0, UINT32_MAX}(rd);
+            WrappingInt32 base{isn};
+            TCPReceiverTestHarness test{4000};
+            test.execute(SegmentArrives{}.with_syn().with_seqno(isn).with_result(SegmentArrives::Result::OK));
+            test.execute(
+                SegmentArrives{}.with_seqno(isn + 11).with_data("abcd").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{{base + 11, base + 15}}});
+
+            test.execute(SegmentArrives{}.with_seqno(isn + 21).with_data("ef").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{{base + 21, base + 23}, {base + 11, base + 15}}});
+
+            test.execute(SegmentArrives{}.with_seqno(isn + 31).with_data("gh").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{{base + 31, base + 33}, {base + 11, base + 15}, {base + 21, base + 23}}});
+
+            // a segment that extends an existing block moves that block to the front
+            test.execute(SegmentArrives{}.with_seqno(isn + 15).with_data("ij").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{{base + 11, base + 17}, {base + 21, base + 23}, {base + 31, base + 33}}});
+            test.execute(ExpectAckno{base + 1});
+        }
+
+        // No more blocks than fit in the options, and the most recent one is never left out
+        {
+            uint32_t isn = uniform_int_distribution<uint32_t>{0, UINT32_MAX}(rd);
+            WrappingInt32 base{isn};
+            TCPReceiverTestHarness test{4000};
+            test.execute(SegmentArrives{}.with_syn().with_seqno(isn).with_result(SegmentArrives::Result::OK));
+            for (uint32_t i = 1; i <= 6; i++) {
+                test.execute(
+                    SegmentArrives{}.with_seqno(isn + 1 + 10 * i).with_data("x").with_result(SegmentArrives::Result::OK));
+            }
+            test.execute(ExpectSackBlocks{{{base + 61, base + 62},
+                                           {base + 11, base + 12},
+                                           {base + 21, base + 22},
+                                           {base + 31, base + 32}}});
+        }
+
+        // Filling the hole in front of the blocks clears them
+        {
+            uint32_t isn = uniform_int_distribution<uint32_t>{0, UINT32_MAX}(rd);
+            WrappingInt32 base{isn};
+            TCPReceiverTestHarness test{4000};
+            test.execute(SegmentArrives{}.with_syn().with_seqno(isn).with_result(SegmentArrives::Result::OK));
+            test.execute(SegmentArrives{}.with_seqno(isn + 3).with_data("cd").with_result(SegmentArrives::Result::OK));
+            test.execute(SegmentArrives{}.with_seqno(isn + 7).with_data("gh").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{{base + 7, base + 9}, {base + 3, base + 5}}});
+
+            test.execute(SegmentArrives{}.with_seqno(isn + 1).with_data("ab").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{{base + 7, base + 9}}});
+
+            test.execute(SegmentArrives{}.with_seqno(isn + 5).with_data("ef").with_result(SegmentArrives::Result::OK));
+            test.execute(ExpectSackBlocks{{}});
+            test.execute(ExpectBytes{"abcdefgh"});
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
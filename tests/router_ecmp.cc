@@ -0,0 +1,195 @@
+#include "router.hh"
+#include "router_harness.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t NUM_INTERFACES = 3;
+
+//! The four paths of the default route: two next hops on interface 1 and two on interface 2
+static const vector<pair<size_t, size_t>> PATHS = {{1, 2}, {1, 3}, {2, 2}, {2, 3}};
+
+//! A datagram of one flow, with the ports at the start of its payload
+static InternetDatagram datagram(
+    const uint32_t src, const uint32_t dst, const uint8_t proto, const uint16_t src_port, const uint16_t dst_port) {
+    InternetDatagram dgram;
+    dgram.header().src = src;
+    dgram.header().dst = dst;
+    dgram.header().proto = proto;
+    dgram.header().ttl = 64;
+    string payload(20, '\0');
+    payload[0] = static_cast<char>(src_port >> 8);
+    payload[1] = static_cast<char>(src_port & 0xff);
+    payload[2] = static_cast<char>(dst_port >> 8);
+    payload[3] = static_cast<char>(dst_port & 0xff);
+    dgram.payload() = move(payload);
+    dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+    return dgram;
+}
+
+//! Route one datagram and return the index (in PATHS) of the path it took
+static size_t path_taken(Router &router, const InternetDatagram &dgram) {
+    router.interface(0).datagrams_out().push(dgram);
+    router.route();
+
+    optional<size_t> taken;
+    for (size_t i = 0; i < NUM_INTERFACES; i++) {
+        auto &frames = router.interface(i).frames_out();
+        while (not frames.empty()) {
+            for (size_t p = 0; p < PATHS.size(); p++) {
+                if (PATHS[p].first == i and
+                    frames.front().header().dst == next_hop_ethernet_address(i, PATHS[p].second)) {
+                    if (taken.has_value()) {
+                        throw runtime_error("a datagram was forwarded twice");
+                    }
+                    taken = p;
+                }
+            }
+            frames.pop();
+        }
+    }
+    if (not taken.has_value()) {
+        throw runtime_error("a datagram was not forwarded to any of the paths");
+    }
+    return taken.value();
+}
+
+struct Flow {
+    uint32_t src;
+    uint32_t dst;
+    uint8_t proto;
+    uint16_t src_port;
+    uint16_t dst_port;
+};
+
+static void test(const size_t batch_size) {
+    auto rd = get_random_generator();
+
+    Router router;
+    router.set_batch_size(batch_size);
+    add_interfaces(router, NUM_INTERFACES);
+
+    // tell the interfaces their next hops' Ethernet addresses
+    for (const auto &[i, host] : PATHS) {
+        learn_next_hop(router, i, host);
+    }
+
+    vector<RoutePath> paths;
+    for (const auto &[i, host] : PATHS) {
+        paths.push_back({Address::from_ipv4_numeric(address(i, host)), i});
+    }
+    router.add_route(0, 0, paths);
+
+    // many flows, differing in any one field of the 5-tuple
+    vector<Flow> flows;
+    for (unsigned k = 0; k < 4000; k++) {
+        Flow flow{static_cast<uint32_t>(rd()),
+                  static_cast<uint32_t>(rd()),
+                  rd() % 2 ? IPv4Header::PROTO_TCP : IPv4Header::PROTO_UDP,
+                  static_cast<uint16_t>(rd()),
+                  static_cast<uint16_t>(rd())};
+        if (k % 2 == 1) {
+            flow = flows.back();
+            switch (rd() % 3) {
+                case 0:
+                    flow.src_port++;
+                    break;
+                case 1:
+                    flow.dst_port++;
+                    break;
+                default:
+                    flow.src++;
+                    break;
+            }
+        }
+        flows.push_back(flow);
+    }
+
+    // every datagram of a flow takes the same path, and the flows spread evenly over the paths
+    vector<size_t> flow_path(flows.size());
+    vector<size_t> counts(PATHS.size());
+    for (unsigned pass = 0; pass < 3; pass++) {
+        for (size_t k = 0; k < flows.size(); k++) {
+            const auto &f = flows[k];
+            const size_t p = path_taken(router, datagram(f.src, f.dst, f.proto, f.src_port, f.dst_port));
+            if (pass == 0) {
+                flow_path[k] = p;
+                counts[p]++;
+            } else if (flow_path[k] != p) {
+                throw runtime_error("a flow changed paths");
+            }
+        }
+    }
+    // a flow and the next one, which differs in one field, should often take different paths
+    size_t moved = 0;
+    for (size_t k = 1; k < flows.size(); k += 2) {
+        moved += flow_path[k] != flow_path[k - 1];
+    }
+    if (moved < flows.size() / 2 / 2) {
+        throw runtime_error("flows that differ in one field mostly take the same path");
+    }
+    for (const size_t count : counts) {
+        if (count < flows.size() / PATHS.size() * 3 / 4 or count > flows.size() / PATHS.size() * 5 / 4) {
+            throw runtime_error("flows are spread unevenly: " + to_string(count) + " of " + to_string(flows.size()) +
+                                " took one path");
+        }
+    }
+
+    // the fragments of a datagram take the same path, though only the first carries the ports
+    for (unsigned k = 0; k < 500; k++) {
+        auto first = datagram(rd(), rd(), IPv4Header::PROTO_TCP, rd(), rd());
+        first.header().df = false;
+        first.header().mf = true;
+        auto second = first;
+        second.header().mf = false;
+        second.header().offset = 3;
+        second.payload() = string(8, 'x');
+        second.header().len = second.header().hlen * 4 + second.payload().size();
+        if (path_taken(router, first) != path_taken(router, second)) {
+            throw runtime_error("the fragments of a datagram took different paths");
+        }
+    }
+
+    // other protocols spread by address alone
+    vector<size_t> icmp_counts(PATHS.size());
+    for (unsigned k = 0; k < 2000; k++) {
+        icmp_counts[path_taken(router, datagram(rd(), rd(), 1, 0, 0))]++;
+    }
+    for (const size_t count : icmp_counts) {
+        if (count == 0) {
+            throw runtime_error("ICMP datagrams did not use every path");
+        }
+    }
+
+    // replacing the route with a single path moves every flow to it
+    RouteUpdate update;
+    update.replace(0, 0, Address::from_ipv4_numeric(address(2, 3)), 2);
+    router.update_routes(update);
+    for (unsigned k = 0; k < 200; k++) {
+        const auto &f = flows[k];
+        if (path_taken(router, datagram(f.src, f.dst, f.proto, f.src_port, f.dst_port)) != 3) {
+            throw runtime_error("a datagram did not take the only path");
+        }
+    }
+}
+
+int main() {
+    try {
+        test(1);
+        test(8);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#ifndef SPONGE_ROUTER_HARNESS_HH
+#define SPONGE_ROUTER_HARNESS_HH
+
+#include "arp_message.hh"
+#include "ethernet_frame.hh"
+#include "router.hh"
+
+#include <cstddef>
+#include <cstdint>
+
+//! Interface `i` of a test router is 10.i.0.1 on the network 10.i.0.0/16; its next hops are 10.i.0.2 and up
+inline uint32_t address(const size_t i, const uint32_t host) {
+    return (10u << 24) | (static_cast<uint32_t>(i) << 16) | host;
+}
+
+//! The Ethernet address of interface `i`
+inline EthernetAddress ethernet_address(const size_t i) { return {2, 0, 0, 0, 0, static_cast<uint8_t>(i + 1)}; }
+
+//! The Ethernet address of the next hop at address(i, host)
+inline EthernetAddress next_hop_ethernet_address(const size_t i, const uint32_t host) {
+    return {2, 0, 0, 1, static_cast<uint8_t>(i), static_cast<uint8_t>(host)};
+}
+
+//! Add interfaces 0 to count - 1, each with the addresses above
+inline void add_interfaces(Router &router, const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        router.add_interface({ethernet_address(i), Address::from_ipv4_numeric(address(i, 1))});
+    }
+}
+
+//! Tell interface `i` the Ethernet address of its next hop at address(i, host), as an ARP reply would
+inline void learn_next_hop(Router &router, const size_t i, const uint32_t host) {
+    ARPMessage arp;
+    arp.opcode = ARPMessage::OPCODE_REPLY;
+    arp.sender_ethernet_address = next_hop_ethernet_address(i, host);
+    arp.sender_ip_address = address(i, host);
+    arp.target_ethernet_address = ethernet_address(i);
+    arp.target_ip_address = address(i, 1);
+    EthernetFrame frame;
+    frame.header().type = EthernetHeader::TYPE_ARP;
+    frame.header().src = arp.sender_ethernet_address;
+    frame.header().dst = arp.target_ethernet_address;
+    frame.payload() = arp.serialize();
+    router.interface(i).recv_frame(frame);
+}
+
+#endif  // SPONGE_ROUTER_HARNESS_HH
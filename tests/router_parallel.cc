@@ -0,0 +1,214 @@
+#include "router.hh"
+#include "router_harness.hh"
+#include "util.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t NUM_INTERFACES = 4;
+constexpr size_t DATAGRAMS_PER_INTERFACE = 3000;
+
+//! At most this many datagrams are in the router at once, so no ring overflows however the threads are scheduled
+constexpr size_t MAX_IN_FLIGHT = 256;
+
+//! Each interface has one next hop, address(i, 2)
+constexpr uint32_t NEXT_HOP = 2;
+
+//! Another network, routed to the last interface while the workers are running
+constexpr uint32_t LATE_PREFIX = (10u << 24) | (200u << 16);
+
+//! An IPv4 datagram in an Ethernet frame addressed to interface `i`, carrying `id` as its payload
+static EthernetFrame frame_to(const size_t i, const uint32_t dst, const size_t id) {
+    InternetDatagram dgram;
+    dgram.header().src = address(i, 100);
+    dgram.header().dst = dst;
+    dgram.header().ttl = 64;
+    dgram.payload() = to_string(id);
+    dgram.header().len = dgram.header().hlen * 4 + dgram.payload().size();
+
+    EthernetFrame frame;
+    frame.header().type = EthernetHeader::TYPE_IPv4;
+    frame.header().src = next_hop_ethernet_address(i, NEXT_HOP);
+    frame.header().dst = ethernet_address(i);
+    frame.payload() = dgram.serialize().concatenate();
+    return frame;
+}
+
+//! Inputs and outputs of one interface, touched only by its worker thread while the router runs
+struct Wire {
+    vector<EthernetFrame> to_send{};
+    size_t next_to_send = 0;
+    vector<EthernetFrame> received{};
+};
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        Router router;
+        router.set_route_cache_size(1024);
+        add_interfaces(router, NUM_INTERFACES);
+        for (size_t i = 0; i < NUM_INTERFACES; i++) {
+            router.add_route(address(i, 0), 16, Address::from_ipv4_numeric(address(i, NEXT_HOP)), i);
+            learn_next_hop(router, i, NEXT_HOP);
+        }
+
+        // every interface sends datagrams to random interfaces (including itself); ids are unique
+        vector<Wire> wires(NUM_INTERFACES);
+        size_t id = 0;
+        for (size_t i = 0; i < NUM_INTERFACES; i++) {
+            for (size_t k = 0; k < DATAGRAMS_PER_INTERFACE; k++) {
+                const uint32_t dst = address(rd() % NUM_INTERFACES, 1000 + rd() % 1000);
+                wires[i].to_send.push_back(frame_to(i, dst, id++));
+            }
+        }
+
+        atomic<size_t> sent{0}, received{0};
+        atomic<bool> send_late{false};
+        const size_t late_first_id = id;
+        constexpr size_t LATE_DATAGRAMS = 100;
+
+        router.start([&](const size_t i, AsyncNetworkInterface &interface) {
+            auto &wire = wires[i];
+            // once the late route is in, interface 0 sends datagrams that need it
+            if (i == 0 and send_late.exchange(false)) {
+                for (size_t k = 0; k < LATE_DATAGRAMS; k++) {
+                    wire.to_send.push_back(frame_to(0, LATE_PREFIX | (1000 + k), late_first_id + k));
+                }
+            }
+            while (wire.next_to_send < wire.to_send.size() and sent - received < MAX_IN_FLIGHT) {
+                interface.recv_frame(wire.to_send[wire.next_to_send++]);
+                sent++;
+            }
+            while (not interface.frames_out().empty()) {
+                wire.received.push_back(move(interface.frames_out().front()));
+                interface.frames_out().pop();
+                received++;
+            }
+        });
+
+        const auto wait_for = [&](const size_t count) {
+            const auto deadline = chrono::steady_clock::now() + chrono::seconds(20);
+            while (received < count) {
+                if (chrono::steady_clock::now() > deadline) {
+                    throw runtime_error("timed out with " + to_string(received) + " of " + to_string(count) +
+                                        " datagrams forwarded");
+                }
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+        };
+
+        // meanwhile, keep adding, replacing and withdrawing more-specific routes that send the datagrams to the
+        // same places, so the workers switch tables over and over while they forward
+        for (unsigned update_count = 0; update_count < 10000 and received < NUM_INTERFACES * DATAGRAMS_PER_INTERFACE;
+             update_count++) {
+            RouteUpdate update;
+            for (size_t i = 0; i < NUM_INTERFACES; i++) {
+                const auto next_hop = Address::from_ipv4_numeric(address(i, NEXT_HOP));
+                const uint32_t subnet = address(i, (rd() % 8) << 8);
+                switch (rd() % 3) {
+                    case 0:
+                        update.add(subnet, 24, next_hop, i);
+                        break;
+                    case 1:
+                        update.replace(address(i, 0), 16, next_hop, i);
+                        break;
+                    default:
+                        update.withdraw(subnet, 24);
+                        break;
+                }
+            }
+            router.update_routes(update);
+        }
+        wait_for(NUM_INTERFACES * DATAGRAMS_PER_INTERFACE);
+
+        // change the routes without stopping the workers
+        const size_t last = NUM_INTERFACES - 1;
+        router.add_route(LATE_PREFIX, 16, Address::from_ipv4_numeric(address(last, NEXT_HOP)), last);
+        send_late = true;
+        wait_for(NUM_INTERFACES * DATAGRAMS_PER_INTERFACE + LATE_DATAGRAMS);
+
+        router.stop();
+
+        if (router.handoff_drops() != 0) {
+            throw runtime_error("datagrams were dropped between workers");
+        }
+
+        set<size_t> ids;
+        for (size_t i = 0; i < NUM_INTERFACES; i++) {
+            for (const auto &frame : wires[i].received) {
+                if (frame.header().type != EthernetHeader::TYPE_IPv4 or
+                    frame.header().dst != next_hop_ethernet_address(i, NEXT_HOP)) {
+                    throw runtime_error("interface " + to_string(i) + " sent a frame to the wrong place");
+                }
+                InternetDatagram dgram;
+                if (dgram.parse(frame.payload().concatenate()) != ParseResult::NoError) {
+                    throw runtime_error("interface " + to_string(i) + " sent a bad datagram");
+                }
+                const bool late = (dgram.header().dst >> 16) == (LATE_PREFIX >> 16);
+                const size_t expected_interface = late ? last : (dgram.header().dst >> 16) & 0xff;
+                if (expected_interface != i or dgram.header().ttl != 63) {
+                    throw runtime_error("datagram for " + Address::from_ipv4_numeric(dgram.header().dst).ip() +
+                                        " left on interface " + to_string(i) + " with TTL " +
+                                        to_string(dgram.header().ttl));
+                }
+                if (not ids.insert(stoul(dgram.payload().concatenate())).second) {
+                    throw runtime_error("a datagram was forwarded twice");
+                }
+            }
+        }
+        if (ids.size() != late_first_id + LATE_DATAGRAMS) {
+            throw runtime_error("wrong number of datagrams forwarded: " + to_string(ids.size()));
+        }
+
+        // each datagram was looked up once, by the worker of the interface it arrived on
+        if (router.route_cache_hits() + router.route_cache_misses() != ids.size() or router.route_cache_hits() == 0) {
+            throw runtime_error("wrong route cache counts: " + to_string(router.route_cache_hits()) + " hits and " +
+                                to_string(router.route_cache_misses()) + " misses");
+        }
+
+        // a worker that throws stops on its own, and stop() rethrows the exception once all are joined
+        {
+            Router failing;
+            add_interfaces(failing, NUM_INTERFACES);
+            atomic<size_t> polls{0};
+            failing.start([&](const size_t i, AsyncNetworkInterface &) {
+                if (i == 1) {
+                    throw runtime_error("poll failed");
+                }
+                polls++;
+            });
+            // the other workers keep running
+            const size_t before = polls;
+            while (polls < before + 100) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+
+            bool rethrown = false;
+            try {
+                failing.stop();
+            } catch (const runtime_error &e) {
+                rethrown = string(e.what()) == "poll failed";
+            }
+            if (not rethrown or failing.running()) {
+                throw runtime_error("stop() should rethrow the worker's exception");
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
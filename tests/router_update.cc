@@ -0,0 +1,186 @@
+#include "router.hh"
+#include "router_harness.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+constexpr size_t NUM_INTERFACES = 4;
+constexpr size_t NEXT_HOPS_PER_INTERFACE = 4;
+
+//! What the test expects of a route
+struct Route {
+    size_t interface_num;
+    size_t next_hop;
+};
+
+//! Longest-prefix match by scanning every route; keys are (masked prefix << 8 | length)
+static optional<Route> reference_lookup(const map<uint64_t, Route> &routes, const uint32_t address) {
+    optional<Route> best;
+    int best_length = -1;
+    for (const auto &[key, route] : routes) {
+        const uint32_t prefix = key >> 8;
+        const int length = key & 0xff;
+        const bool matches = length == 0 or ((prefix ^ address) >> (32 - length)) == 0;
+        if (matches and length > best_length) {
+            best = route;
+            best_length = length;
+        }
+    }
+    return best;
+}
+
+static uint64_t key_of(const uint32_t prefix, const uint8_t length) {
+    const uint32_t mask = length == 0 ? 0 : ~((uint64_t(1) << (32 - length)) - 1);
+    return (uint64_t(prefix & mask) << 8) | length;
+}
+
+//! Apply random route updates, in place and while the worker threads run, and check where datagrams go
+static void test(const size_t cache_size) {
+    auto rd = get_random_generator();
+
+    Router router;
+    router.set_route_cache_size(cache_size);
+    add_interfaces(router, NUM_INTERFACES);
+
+    // tell the interfaces their next hops' Ethernet addresses
+    for (size_t i = 0; i < NUM_INTERFACES; i++) {
+        for (size_t j = 0; j < NEXT_HOPS_PER_INTERFACE; j++) {
+            learn_next_hop(router, i, j + 2);
+        }
+    }
+
+    // random prefixes, clustered so that they nest
+    const uint32_t base = rd();
+    map<uint64_t, Route> reference;
+    const auto random_prefix = [&]() -> pair<uint32_t, uint8_t> {
+        if (not reference.empty() and rd() % 2 == 0) {
+            // one that is (most likely) in the table
+            auto it = reference.begin();
+            advance(it, rd() % reference.size());
+            return {static_cast<uint32_t>(it->first >> 8), static_cast<uint8_t>(it->first & 0xff)};
+        }
+        const uint8_t length = rd() % 20 == 0 ? rd() % 33 : 8 + rd() % 25;
+        return {base ^ (rd() & 0xffff), length};
+    };
+
+    for (unsigned round = 0; round < 30; round++) {
+        // every other round updates the routes while the worker threads run
+        const bool running = round % 2 == 1;
+        if (running) {
+            router.start([](const size_t, AsyncNetworkInterface &) {});
+        }
+
+        for (unsigned batch = 0; batch < 5; batch++) {
+            RouteUpdate update;
+            const unsigned count = 1 + rd() % 50;
+            for (unsigned k = 0; k < count; k++) {
+                const auto [prefix, length] = random_prefix();
+                const uint64_t key = key_of(prefix, length);
+                const Route route{rd() % NUM_INTERFACES, rd() % NEXT_HOPS_PER_INTERFACE};
+                const auto next_hop = Address::from_ipv4_numeric(address(route.interface_num, route.next_hop + 2));
+                switch (rd() % 3) {
+                    case 0:
+                        update.add(prefix, length, next_hop, route.interface_num);
+                        reference.emplace(key, route);
+                        break;
+                    case 1:
+                        update.replace(prefix, length, next_hop, route.interface_num);
+                        reference[key] = route;
+                        break;
+                    default:
+                        update.withdraw(prefix, length);
+                        reference.erase(key);
+                        break;
+                }
+            }
+            router.update_routes(update);
+        }
+
+        if (running) {
+            router.stop();
+        }
+
+        // a next-hop group is kept exactly as long as some route uses it
+        set<pair<size_t, size_t>> paths_in_use;
+        for (const auto &[key, route] : reference) {
+            paths_in_use.emplace(route.interface_num, route.next_hop);
+        }
+        if (router.next_hop_groups() != paths_in_use.size()) {
+            throw runtime_error("round " + to_string(round) + ": " + to_string(router.next_hop_groups()) +
+                                " next-hop groups for " + to_string(paths_in_use.size()) + " sets of paths");
+        }
+
+        // send datagrams one at a time and see where each one goes; every other one goes to an earlier destination
+        vector<uint32_t> destinations;
+        for (unsigned probe = 0; probe < 300; probe++) {
+            uint32_t dst = rd() % 8 == 0 ? static_cast<uint32_t>(rd()) : base ^ (rd() & 0xffff);
+            if (probe % 2 == 1) {
+                dst = destinations[rd() % destinations.size()];
+            }
+            destinations.push_back(dst);
+            InternetDatagram dgram;
+            dgram.header().src = address(0, 100);
+            dgram.header().dst = dst;
+            dgram.header().ttl = 64;
+            dgram.header().len = dgram.header().hlen * 4;
+            router.interface(0).datagrams_out().push(dgram);
+            router.route();
+
+            optional<Route> actual;
+            for (size_t i = 0; i < NUM_INTERFACES; i++) {
+                auto &frames = router.interface(i).frames_out();
+                while (not frames.empty()) {
+                    for (size_t j = 0; j < NEXT_HOPS_PER_INTERFACE; j++) {
+                        if (frames.front().header().dst == next_hop_ethernet_address(i, j + 2)) {
+                            if (actual.has_value()) {
+                                throw runtime_error("a datagram was forwarded twice");
+                            }
+                            actual = Route{i, j};
+                        }
+                    }
+                    frames.pop();
+                }
+            }
+
+            const auto expected = reference_lookup(reference, dst);
+            if (expected.has_value() != actual.has_value() or
+                (expected.has_value() and (expected->interface_num != actual->interface_num or
+                                           expected->next_hop != actual->next_hop))) {
+                throw runtime_error("round " + to_string(round) + ": datagram for " +
+                                    Address::from_ipv4_numeric(dst).ip() + " was routed wrongly");
+            }
+        }
+    }
+
+    // every probe was one lookup
+    if (cache_size > 0 and (router.route_cache_hits() + router.route_cache_misses() != 30 * 300 or
+                            router.route_cache_hits() == 0)) {
+        throw runtime_error("wrong route cache counts: " + to_string(router.route_cache_hits()) + " hits and " +
+                            to_string(router.route_cache_misses()) + " misses");
+    }
+}
+
+int main() {
+    try {
+        test(0);
+        // a small cache, so that destinations evict each other
+        test(64);
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
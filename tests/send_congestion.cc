@@ -0,0 +1,123 @@
+#include "sender_harness.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        const size_t MSS = TCPConfig::MAX_PAYLOAD_SIZE;
+        const size_t IW = TCPConfig::INITIAL_CWND_SEGMENTS * MSS;
+
+        for (const auto algorithm :
+             {TCPConfig::CongestionControlAlgorithm::Reno, TCPConfig::CongestionControlAlgorithm::Cubic}) {
+            const string name = algorithm == TCPConfig::CongestionControlAlgorithm::Reno ? "Reno" : "CUBIC";
+
+            {
+                TCPConfig cfg;
+                WrappingInt32 isn(rd());
+                cfg.fixed_isn = isn;
+                cfg.congestion_control = algorithm;
+
+                TCPSenderTestHarness test{name + ": initial window limits bytes in flight", cfg};
+                test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+                test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(60000));
+                test.execute(WriteBytes{string(4 * IW, 'a')});
+                // slow start has grown the window by the one byte of the acknowledged SYN
+                test.execute(ExpectBytesInFlight{IW + 1});
+                for (size_t i = 0; i < TCPConfig::INITIAL_CWND_SEGMENTS; i++) {
+                    test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(isn + 1 + i * MSS));
+                }
+                test.execute(ExpectSegment{}.with_payload_size(1));
+                test.execute(ExpectNoSegment{});
+            }
+
+            {
+                TCPConfig cfg;
+                WrappingInt32 isn(rd());
+                cfg.fixed_isn = isn;
+                cfg.congestion_control = algorithm;
+
+                TCPSenderTestHarness test{name + ": slow start grows the window with each ACK", cfg};
+                test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+                test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(60000));
+                test.execute(WriteBytes{string(4 * IW, 'a')});
+                for (size_t i = 0; i < TCPConfig::INITIAL_CWND_SEGMENTS + 1; i++) {
+                    test.execute(ExpectSegment{});
+                }
+                test.execute(ExpectNoSegment{});
+                test.execute(AckReceived{WrappingInt32{isn + 1 + uint32_t(MSS)}}.with_win(60000));
+                // one MSS acknowledged and one MSS of growth: two more segments fit
+                test.execute(ExpectBytesInFlight{IW + 1 + MSS});
+                test.execute(ExpectSegment{}.with_payload_size(MSS));
+                test.execute(ExpectSegment{}.with_payload_size(MSS));
+                test.execute(ExpectNoSegment{});
+            }
+
+            {
+                TCPConfig cfg;
+                WrappingInt32 isn(rd());
+                cfg.fixed_isn = isn;
+                cfg.congestion_control = algorithm;
+
+                TCPSenderTestHarness test{name + ": timeout collapses the window", cfg};
+                test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+                test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(60000));
+                test.execute(WriteBytes{string(4 * IW, 'a')});
+                for (size_t i = 0; i < TCPConfig::INITIAL_CWND_SEGMENTS + 1; i++) {
+                    test.execute(ExpectSegment{});
+                }
+                test.execute(Tick{cfg.rt_timeout});
+                test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(isn + 1));
+                test.execute(ExpectNoSegment{});
+                // after the first segment is acknowledged, the window is still far below the bytes in flight
+                test.execute(AckReceived{WrappingInt32{isn + 1 + uint32_t(MSS)}}.with_win(60000));
+                test.execute(ExpectBytesInFlight{IW + 1 - MSS});
+                test.execute(ExpectNoSegment{});
+            }
+
+            {
+                TCPConfig cfg;
+                WrappingInt32 isn(rd());
+                cfg.fixed_isn = isn;
+                cfg.congestion_control = algorithm;
+
+                TCPSenderTestHarness test{name + ": fast retransmit and NewReno partial ACKs", cfg};
+                test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+                test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(60000));
+                test.execute(WriteBytes{string(5 * MSS, 'a')});
+                for (size_t i = 0; i < 5; i++) {
+                    test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(isn + 1 + i * MSS));
+                }
+                test.execute(AckReceived{WrappingInt32{isn + 1 + uint32_t(MSS)}}.with_win(60000));
+                test.execute(AckReceived{WrappingInt32{isn + 1 + uint32_t(MSS)}}.with_win(60000));
+                test.execute(AckReceived{WrappingInt32{isn + 1 + uint32_t(MSS)}}.with_win(60000));
+                test.execute(ExpectNoSegment{});
+                // third duplicate ACK
+                test.execute(AckReceived{WrappingInt32{isn + 1 + uint32_t(MSS)}}.with_win(60000));
+                test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(isn + 1 + MSS));
+                test.execute(ExpectNoSegment{});
+                // partial ACK: the next hole is retransmitted right away
+                test.execute(AckReceived{WrappingInt32{isn + 1 + 2 * uint32_t(MSS)}}.with_win(60000));
+                test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(isn + 1 + 2 * MSS));
+                test.execute(ExpectNoSegment{});
+                test.execute(AckReceived{WrappingInt32{isn + 1 + 5 * uint32_t(MSS)}}.with_win(60000));
+                test.execute(ExpectBytesInFlight{0});
+                test.execute(ExpectNoSegment{});
+            }
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+#include "sender_harness.hh"
+#include "tcp_header.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+
+        {
+            TCPHeader header;
+            header.syn = true;
+            header.options.mss = 1460;
+            header.options.wscale = 7;
+            header.options.sack_permitted = true;
+            header.options.timestamps = true;
+            header.options.tsval = rd();
+            header.options.tsecr = rd();
+            header.doff = header.doff_with_options();
+
+            TCPHeader parsed;
+            Buffer wire{header.serialize()};
+            NetParser p{wire};
+            if (parsed.parse(p) != ParseResult::NoError) {
+                throw runtime_error("header with options failed to parse");
+            }
+            if (parsed.doff != header.doff || !(parsed.options == header.options)) {
+                throw runtime_error("options did not survive a serialize/parse round trip");
+            }
+
+            // options that do not fit in doff are dropped rather than overrunning the payload
+            header.doff = TCPHeader::LENGTH / 4;
+            if (header.serialize().size() != TCPHeader::LENGTH) {
+                throw runtime_error("options were serialized beyond doff");
+            }
+        }
+
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            cfg.fixed_isn = isn;
+            cfg.mss = 3;
+
+            TCPSenderTestHarness test{"Payloads are split at the MSS", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(100));
+            test.execute(WriteBytes{"abcdefg"});
+            test.execute(ExpectSegment{}.with_data("abc"));
+            test.execute(ExpectSegment{}.with_data("def"));
+            test.execute(ExpectSegment{}.with_data("g"));
+            test.execute(ExpectNoSegment{});
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+#include "sender_harness.hh"
+#include "wrapping_integers.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+int main() {
+    try {
+        auto rd = get_random_generator();
+        const uint32_t MSS = TCPConfig::MAX_PAYLOAD_SIZE;
+
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            cfg.fixed_isn = isn;
+            cfg.congestion_control = TCPConfig::CongestionControlAlgorithm::Reno;
+            cfg.sack = true;
+
+            // segment i covers [seg(i), seg(i + 1)); segments 1 and 4 are lost
+            auto seg = [&](const uint32_t i) { return isn + 1 + i * MSS; };
+
+            TCPSenderTestHarness test{"SACK scoreboard retransmits only the holes", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(60000));
+            test.execute(WriteBytes{string(10 * MSS, 'a')});
+            for (uint32_t i = 0; i < 10; i++) {
+                test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(seg(i)));
+            }
+            test.execute(AckReceived{seg(1)}.with_win(60000));
+            test.execute(AckReceived{seg(1)}.with_win(60000).with_sack(seg(2), seg(3)));
+            test.execute(AckReceived{seg(1)}.with_win(60000).with_sack(seg(2), seg(4)));
+            test.execute(ExpectNoSegment{});
+            // third duplicate ACK: the first hole is retransmitted, but not segment 4 (too little SACKed above it)
+            test.execute(AckReceived{seg(1)}.with_win(60000).with_sack(seg(5), seg(6)).with_sack(seg(2), seg(4)));
+            test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(seg(1)));
+            test.execute(ExpectNoSegment{});
+            test.execute(AckReceived{seg(1)}.with_win(60000).with_sack(seg(5), seg(7)).with_sack(seg(2), seg(4)));
+            test.execute(ExpectNoSegment{});
+            // enough data SACKed above segment 4: it is lost, and retransmitted without waiting for a partial ACK
+            test.execute(AckReceived{seg(1)}.with_win(60000).with_sack(seg(5), seg(8)).with_sack(seg(2), seg(4)));
+            test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(seg(4)));
+            test.execute(ExpectNoSegment{});
+            test.execute(AckReceived{seg(1)}.with_win(60000).with_sack(seg(5), seg(10)).with_sack(seg(2), seg(4)));
+            test.execute(ExpectNoSegment{});
+            // the partial ACK does not resend segment 4 again, and SACKed segments are never resent
+            test.execute(AckReceived{seg(4)}.with_win(60000).with_sack(seg(5), seg(10)));
+            test.execute(ExpectNoSegment{});
+            test.execute(AckReceived{seg(10)}.with_win(60000));
+            test.execute(ExpectBytesInFlight{0});
+            test.execute(ExpectNoSegment{});
+        }
+
+        {
+            TCPConfig cfg;
+            WrappingInt32 isn(rd());
+            cfg.fixed_isn = isn;
+            cfg.congestion_control = TCPConfig::CongestionControlAlgorithm::Reno;
+            cfg.sack = true;
+
+            auto seg = [&](const uint32_t i) { return isn + 1 + i * MSS; };
+
+            TCPSenderTestHarness test{"SACK information is discarded on timeout", cfg};
+            test.execute(ExpectSegment{}.with_no_flags().with_syn(true).with_payload_size(0).with_seqno(isn));
+            test.execute(AckReceived{WrappingInt32{isn + 1}}.with_win(60000));
+            test.execute(WriteBytes{string(3 * MSS, 'a')});
+            for (uint32_t i = 0; i < 3; i++) {
+                test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(seg(i)));
+            }
+            test.execute(AckReceived{seg(0)}.with_win(60000).with_sack(seg(1), seg(3)));
+            test.execute(ExpectBytesInFlight{3 * MSS});
+            test.execute(Tick{TCPConfig::TIMEOUT_DFLT});
+            test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(seg(0)));
+            // the receiver may have dropped what it SACKed, so segment 1 is retransmitted on the next timeout
+            test.execute(AckReceived{seg(1)}.with_win(60000));
+            test.execute(Tick{2 * TCPConfig::TIMEOUT_DFLT});
+            test.execute(ExpectSegment{}.with_payload_size(MSS).with_seqno(seg(1)));
+        }
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -15,6 +15,8 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 const unsigned int DEFAULT_TEST_WINDOW = 137;
 
@@ -191,11 +193,15 @@ struct Tick : public SenderAction {
 struct AckReceived : public SenderAction {
     WrappingInt32 _ackno;
     std::optional<uint16_t> _window_advertisement{};
+    std::vector<std::pair<WrappingInt32, WrappingInt32>> _sack_blocks{};
 
     AckReceived(WrappingInt32 ackno) : _ackno(ackno) {}
     std::string description() const {
         std::ostringstream ss;
         ss << "ack " << _ackno.raw_value() << " winsize " << _window_advertisement.value_or(DEFAULT_TEST_WINDOW);
+        for (const auto &[left, right] : _sack_blocks) {
+            ss << " sack " << left.raw_value() << "-" << right.raw_value();
+        }
         return ss.str();
     }
 
@@ -204,7 +210,15 @@ struct AckReceived : public SenderAction {
         return *this;
     }
 
+    AckReceived &with_sack(WrappingInt32 left, WrappingInt32 right) {
+        _sack_blocks.emplace_back(left, right);
+        return *this;
+    }
+
     void execute(TCPSender &sender, std::queue<TCPSegment> &) const {
+        for (const auto &[left, right] : _sack_blocks) {
+            sender.sack_received(left, right);
+        }
         sender.ack_received(_ackno, _window_advertisement.value_or(DEFAULT_TEST_WINDOW));
         sender.fill_window();
     }
@@ -394,9 +408,17 @@ class TCPSenderTestHarness {
   public:
     TCPSenderTestHarness(const std::string &name_, TCPConfig config)
         : outbound_segments()
-        , sender(config.send_capacity, config.rt_timeout, config.fixed_isn)
+        , sender(config.send_capacity,
+                 config.rt_timeout,
+                 config.fixed_isn,
+                 config.congestion_control,
+                 config.adaptive_rto,
+                 config.rto_min,
+                 config.rto_max)
         , steps_executed()
         , name(name_) {
+        sender.set_mss(config.mss);
+        sender.set_sack_enabled(config.sack);
         sender.fill_window();
         collect_output();
         std::ostringstream ss;
@@ -0,0 +1,289 @@
+#include "arp_message.hh"
+#include "network_interface.hh"
+#include "tcp_sender.hh"
+#include "timer_wheel.hh"
+#include "util.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+static void expect(const bool condition, const string &what) {
+    if (not condition) {
+        throw runtime_error(what);
+    }
+}
+
+//! Random starts, stops and advances, checked against a map of the running timers
+static void test_random(const uint64_t start_time) {
+    auto rd = get_random_generator();
+
+    TimerWheel wheel;
+    wheel.advance(start_time, [](uint64_t, uint64_t) { throw runtime_error("empty wheel expired a timer"); });
+    expect(wheel.now() == start_time, "empty wheel not advanced");
+
+    map<TimerWheel::TimerId, tuple<uint64_t, uint64_t, uint64_t>> running;  // deadline, tag and cookie
+    vector<TimerWheel::TimerId> stopped;
+    uint64_t next_cookie = 0;
+
+    const auto random_delay = [&]() -> uint64_t {
+        switch (rd() % 8) {
+            case 0:
+                return 1 + rd() % 3;
+            case 1:
+                return 1 + rd() % (1 << 20);
+            case 2:
+                return rd() % 64 == 0 ? UINT32_MAX : 1 + rd() % (1 << 26);
+            default:
+                return 1 + rd() % 1000;
+        }
+    };
+    const auto start = [&] {
+        const uint64_t delay = random_delay();
+        const uint64_t tag = rd() % 4;
+        const uint64_t cookie = next_cookie++;
+        const auto id = wheel.start(delay, tag, cookie);
+        expect(running.emplace(id, make_tuple(wheel.now() + delay, tag, cookie)).second, "TimerId reused");
+    };
+    const auto stop_one = [&] {
+        if (running.empty()) {
+            return;
+        }
+        auto it = running.begin();
+        advance(it, rd() % running.size());
+        wheel.stop(it->first);
+        stopped.push_back(it->first);
+        running.erase(it);
+    };
+
+    for (unsigned round = 0; round < 3000; round++) {
+        const unsigned op = rd() % 10;
+        if (op < 5) {
+            start();
+        } else if (op < 7) {
+            stop_one();
+        } else {
+            const uint64_t ms = rd() % 4 == 0 ? rd() % 5000 : rd() % 300;
+            uint64_t last_deadline = 0;
+            wheel.advance(ms, [&](const uint64_t tag, const uint64_t cookie) {
+                // the wheel's clock reads the timer's deadline while it expires
+                expect(wheel.now() >= last_deadline, "timers expired out of order");
+                last_deadline = wheel.now();
+                bool found = false;
+                for (auto it = running.begin(); it != running.end(); ++it) {
+                    if (get<2>(it->second) == cookie) {
+                        expect(get<0>(it->second) == wheel.now() and get<1>(it->second) == tag,
+                               "timer expired at the wrong time or with the wrong tag");
+                        running.erase(it);
+                        found = true;
+                        break;
+                    }
+                }
+                expect(found, "a timer that is not running expired");
+
+                // the callback may start and stop timers
+                if (rd() % 4 == 0) {
+                    start();
+                }
+                if (rd() % 4 == 0) {
+                    stop_one();
+                }
+            });
+        }
+
+        expect(wheel.size() == running.size(), "wrong number of running timers");
+        for (const auto &[id, timer] : running) {
+            expect(get<0>(timer) > wheel.now(), "a timer did not expire by its deadline");
+            expect(wheel.running(id) and wheel.time_remaining(id) == get<0>(timer) - wheel.now(),
+                   "wrong time remaining");
+        }
+        // (including after their entries are reused)
+        for (const auto id : stopped) {
+            expect(not wheel.running(id) and not wheel.time_remaining(id).has_value(), "stopped timer running");
+        }
+        if (stopped.size() > 500) {
+            stopped.erase(stopped.begin(), stopped.begin() + 250);
+        }
+    }
+
+    // the rest expire in order, however far away
+    uint64_t last_deadline = 0;
+    wheel.advance(uint64_t(UINT32_MAX) + 1, [&](uint64_t, const uint64_t cookie) {
+        expect(wheel.now() >= last_deadline, "timers expired out of order");
+        last_deadline = wheel.now();
+        for (auto it = running.begin(); it != running.end(); ++it) {
+            if (get<2>(it->second) == cookie) {
+                expect(get<0>(it->second) == wheel.now(), "far timer expired at the wrong time");
+                running.erase(it);
+                return;
+            }
+        }
+        throw runtime_error("a timer that is not running expired");
+    });
+    expect(running.empty() and wheel.size() == 0, "far timers did not expire");
+
+    // a timer with no delay expires on the next advance, even one by no time
+    size_t expired = 0;
+    wheel.start(0, 0, 0);
+    wheel.advance(0, [&](uint64_t, uint64_t) { expired++; });
+    expect(expired == 1, "timer with no delay did not expire");
+}
+
+//! A single timer, advanced to in small steps, expires exactly at its deadline from any level
+static void test_small_steps() {
+    auto rd = get_random_generator();
+    for (const uint64_t start_time : {uint64_t(0), uint64_t(200), uint64_t(65530), uint64_t(UINT32_MAX) - 3}) {
+        for (const uint64_t delay : {1, 255, 256, 257, 300, 65535, 65536, 70000}) {
+            TimerWheel wheel;
+            wheel.advance(start_time, [](uint64_t, uint64_t) {});
+            wheel.start(delay, 0, 0);
+            optional<uint64_t> expired_at;
+            while (not expired_at.has_value() and wheel.now() < start_time + delay + 1000) {
+                wheel.advance(1 + rd() % 7, [&](uint64_t, uint64_t) { expired_at = wheel.now(); });
+            }
+            expect(expired_at == start_time + delay, "timer with delay " + to_string(delay) + " started at " +
+                                                         to_string(start_time) + " expired at the wrong time");
+        }
+    }
+}
+
+//! Only the sender whose timer expires on a shared wheel retransmits
+static void test_shared_senders() {
+    auto wheel = make_shared<TimerWheel>();
+    vector<TCPSender> senders;
+    for (uint64_t tag = 0; tag < 2; tag++) {
+        senders.emplace_back(TCPConfig::DEFAULT_CAPACITY, 1000, WrappingInt32{0});
+        senders.back().set_timer_wheel(wheel, tag);
+    }
+    const auto advance = [&](const uint64_t ms) {
+        wheel->advance(ms, [&](const uint64_t tag, const uint64_t cookie) {
+            expect(cookie == TCPSender::RETRANSMISSION_TIMER, "wrong cookie");
+            senders.at(tag).timer_expired();
+        });
+    };
+
+    senders[0].fill_window();
+    advance(500);
+    senders[1].fill_window();
+    expect(senders[0].segments_out().size() == 1 and senders[1].segments_out().size() == 1, "SYN not sent");
+    expect(senders[1].time_until_timeout() == 1000, "wrong time until timeout");
+
+    advance(500);
+    expect(senders[0].segments_out().size() == 2 and senders[1].segments_out().size() == 1,
+           "wrong sender retransmitted");
+    expect(senders[0].consecutive_retransmissions() == 1, "retransmission not counted");
+    expect(senders[0].time_until_timeout() == 2000, "timeout not doubled");
+
+    // the SYN is acknowledged, so the timer stops
+    senders[1].ack_received(WrappingInt32{1}, 1000);
+    advance(10000);
+    expect(senders[1].segments_out().size() == 1, "acknowledged SYN retransmitted");
+    expect(senders[0].consecutive_retransmissions() > 1, "retransmission timer not restarted");
+
+    // a sender on a shared wheel is not ticked, and can't move to another wheel once sending
+    bool threw = false;
+    try {
+        senders[0].tick(1);
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    expect(threw, "tick() on a shared wheel did not throw");
+    threw = false;
+    try {
+        senders[0].set_timer_wheel(make_shared<TimerWheel>(), 0);
+    } catch (const runtime_error &) {
+        threw = true;
+    }
+    expect(threw, "set_timer_wheel() after sending did not throw");
+}
+
+//! An interface's ARP entries and requests time out on a shared wheel
+static void test_shared_interface() {
+    const EthernetAddress local_eth{2, 0, 0, 0, 0, 1};
+    const EthernetAddress remote_eth{2, 0, 0, 0, 0, 2};
+    const Address local_ip("10.0.0.1", 0);
+    const Address remote_ip("10.0.0.2", 0);
+
+    auto wheel = make_shared<TimerWheel>();
+    NetworkInterface interface(local_eth, local_ip);
+    interface.set_timer_wheel(wheel, 7);
+    const auto advance = [&](const uint64_t ms) {
+        wheel->advance(ms, [&](const uint64_t tag, const uint64_t cookie) {
+            expect(tag == 7, "wrong tag");
+            interface.timer_expired(cookie);
+        });
+    };
+    const auto arp_requests = [&] {
+        size_t count = 0;
+        for (; not interface.frames_out().empty(); interface.frames_out().pop()) {
+            count += interface.frames_out().front().header().type == EthernetHeader::TYPE_ARP;
+        }
+        return count;
+    };
+
+    InternetDatagram dgram;
+    dgram.header().src = local_ip.ipv4_numeric();
+    dgram.header().dst = remote_ip.ipv4_numeric();
+    dgram.header().len = dgram.header().hlen * 4;
+
+    interface.send_datagram(dgram, remote_ip);
+    expect(arp_requests() == 1, "no ARP request");
+    advance(1000);
+    interface.send_datagram(dgram, remote_ip);
+    expect(arp_requests() == 0, "ARP request repeated while waiting for a reply");
+
+    ARPMessage reply;
+    reply.opcode = ARPMessage::OPCODE_REPLY;
+    reply.sender_ethernet_address = remote_eth;
+    reply.sender_ip_address = remote_ip.ipv4_numeric();
+    reply.target_ethernet_address = local_eth;
+    reply.target_ip_address = local_ip.ipv4_numeric();
+    EthernetFrame frame;
+    frame.header().type = EthernetHeader::TYPE_ARP;
+    frame.header().src = remote_eth;
+    frame.header().dst = local_eth;
+    frame.payload() = reply.serialize();
+    interface.recv_frame(frame);
+    expect(interface.frames_out().size() == 2, "waiting datagrams not sent");
+    arp_requests();
+
+    // the entry lasts ARP_ENTRY_TTL_MS from the reply
+    advance(NetworkInterface::ARP_ENTRY_TTL_MS - 1);
+    interface.send_datagram(dgram, remote_ip);
+    expect(interface.frames_out().size() == 1 and arp_requests() == 0, "ARP entry expired early");
+    advance(1);
+    interface.send_datagram(dgram, remote_ip);
+    expect(arp_requests() == 1, "ARP entry did not expire");
+
+    // with no reply, the waiting datagram is dropped
+    advance(NetworkInterface::ARP_RESPONSE_TTL_MS);
+    interface.recv_frame(frame);
+    expect(interface.frames_out().empty(), "datagram sent after its ARP request timed out");
+    expect(wheel->size() == 1, "stale ARP timers left on the wheel");
+}
+
+int main() {
+    try {
+        test_random(0);
+        // the clock's low 32 bits wrap around during the test
+        test_random(uint64_t(UINT32_MAX) - 100000);
+        test_small_steps();
+        test_shared_senders();
+        test_shared_interface();
+    } catch (const exception &e) {
+        cerr << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}